@@ -0,0 +1,83 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include "arena.hpp"
+
+using namespace templet::nodes;
+
+NodeArena::NodeArena(std::size_t blockSize)
+    : _blockSize(std::max<std::size_t>(blockSize, 64)) {
+
+}
+
+NodeArena::~NodeArena() {
+    // Objects are destroyed in reverse order of construction
+    for(auto finalizer = _finalizers; finalizer != nullptr; finalizer = finalizer->next) {
+        finalizer->destroy(finalizer->object);
+    }
+    while(_blocks != nullptr) {
+        auto next = _blocks->next;
+        ::operator delete(_blocks);
+        _blocks = next;
+    }
+}
+
+void NodeArena::grow(std::size_t size) {
+    // Memory after the block header is aligned for any type
+    const std::size_t headerSize = (sizeof(Block) + alignof(std::max_align_t) - 1) &
+            ~(alignof(std::max_align_t) - 1);
+    const auto capacity = std::max(size, _blockSize);
+    auto block = static_cast<Block*>(::operator new(headerSize + capacity));
+    block->next = _blocks;
+    block->size = capacity;
+    _blocks = block;
+    _current = reinterpret_cast<char*>(block) + headerSize;
+    _available = capacity;
+    ++_blockCount;
+}
+
+void* NodeArena::allocate(std::size_t size, std::size_t align) {
+    auto padding = static_cast<std::size_t>(-reinterpret_cast<std::uintptr_t>(_current) & (align - 1));
+    if(_current == nullptr || padding + size > _available) {
+        grow(size + align);
+        padding = static_cast<std::size_t>(-reinterpret_cast<std::uintptr_t>(_current) & (align - 1));
+    }
+    auto memory = _current + padding;
+    _current += padding + size;
+    _available -= padding + size;
+    _used += size;
+    return memory;
+}
+
+std::size_t NodeArena::bytesUsed() const {
+    return _used;
+}
+
+std::size_t NodeArena::blockCount() const {
+    return _blockCount;
+}
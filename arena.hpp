@@ -0,0 +1,146 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace templet {
+namespace nodes {
+
+/**
+ * @brief The NodeArena class owns all nodes of a compiled template
+ *
+ * Nodes are placement constructed into large blocks that are bump
+ * allocated, so a template is a handful of allocations instead of one
+ * per node. Destroying the arena destroys all of its objects and frees
+ * the blocks at once. Objects can't be freed individually.
+ */
+class NodeArena {
+private:
+    /**
+     * @brief Header of a memory block, the memory follows it
+     */
+    struct Block {
+        Block* next;
+        std::size_t size;
+    };
+
+    /**
+     * @brief Destroys an object when the arena is destroyed
+     */
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+        Finalizer* next;
+    };
+
+    std::size_t _blockSize;
+    Block* _blocks {nullptr};
+    char* _current {nullptr};
+    std::size_t _available {0};
+    std::size_t _used {0};
+    std::size_t _blockCount {0};
+    Finalizer* _finalizers {nullptr};
+
+    template <class T>
+    static void destroy(void* object) {
+        static_cast<T*>(object)->~T();
+    }
+
+    void grow(std::size_t size);
+
+public:
+    /**
+     * @brief Construct an empty arena
+     * @param blockSize Size of each memory block in bytes
+     */
+    explicit NodeArena(std::size_t blockSize = 4096);
+
+    ~NodeArena();
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    /**
+     * @brief Allocate uninitialized memory
+     * @param size Number of bytes
+     * @param align Alignment, must be a power of two
+     * @return Pointer to the memory, owned by the arena
+     */
+    void* allocate(std::size_t size, std::size_t align);
+
+    /**
+     * @brief Construct an object in the arena
+     *
+     * The object is destroyed when the arena is destroyed
+     *
+     * @param args Constructor arguments
+     * @return Pointer to the object, owned by the arena
+     */
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+        auto finalizer = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+        auto object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        finalizer->destroy = &destroy<T>;
+        finalizer->object = object;
+        finalizer->next = _finalizers;
+        _finalizers = finalizer;
+        return object;
+    }
+
+    /**
+     * @brief Allocate an array of trivial values, e.g. pointers
+     * @param count Number of elements
+     * @return Pointer to the uninitialized array, owned by the arena
+     */
+    template <class T>
+    T* allocateArray(std::size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena arrays are never destroyed");
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    /**
+     * @brief Get the number of bytes allocated from the arena
+     * @return Number of bytes
+     */
+    std::size_t bytesUsed() const;
+
+    /**
+     * @brief Get the number of memory blocks held by the arena
+     * @return Number of blocks
+     */
+    std::size_t blockCount() const;
+};
+
+} // namespace nodes
+} // namespace templet
+
+#endif // ARENA_HPP
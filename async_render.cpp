@@ -0,0 +1,120 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdexcept>
+#include <utility>
+#include "async_render.hpp"
+
+using namespace templet;
+
+AsyncRender::AsyncRender(CompiledTemplatePtr compiled, const DataMap& values, AsyncSink& sink,
+                         Executor executor, RenderOptions options, std::size_t chunkSize)
+    : _cursor(std::move(compiled), values, options),
+      _sink(sink),
+      _executor(std::move(executor)),
+      _chunkSize(chunkSize) {
+    if(_chunkSize == 0) {
+        throw std::runtime_error("Chunk size must not be zero");
+    }
+}
+
+std::shared_ptr<AsyncRender> AsyncRender::start(CompiledTemplatePtr compiled, const DataMap& values, AsyncSink& sink,
+                                                Executor executor, RenderOptions options, std::size_t chunkSize) {
+    auto render = std::make_shared<AsyncRender>(std::move(compiled), values, sink, std::move(executor),
+                                                options, chunkSize);
+    render->resume();
+    return render;
+}
+
+void AsyncRender::resume() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_state == State::Running) {
+            _state = State::Resumed;
+            return;
+        }
+        if(_state != State::Paused) {
+            return;
+        }
+        _state = State::Running;
+    }
+    schedule();
+}
+
+void AsyncRender::schedule() {
+    if(!_executor) {
+        run();
+        return;
+    }
+
+    // The step keeps the render alive until it has run
+    auto self = shared_from_this();
+    _executor([self]() { self->run(); });
+}
+
+bool AsyncRender::pause() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_state == State::Resumed) {
+        _state = State::Running;
+        return true;
+    }
+    _state = State::Paused;
+    return false;
+}
+
+void AsyncRender::run() {
+    try {
+        while(_cursor.next(_chunk, _chunkSize)) {
+            {
+                // Only a resume during or after this write means the sink has room
+                std::lock_guard<std::mutex> lock(_mutex);
+                _state = State::Running;
+            }
+            if(!_sink.write(_chunk.data(), _chunk.size()) && !pause()) {
+                return;
+            }
+        }
+    }
+    catch(...) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _state = State::Done;
+        }
+        _sink.failed(std::current_exception());
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _state = State::Done;
+    }
+    _sink.finished();
+}
+
+bool AsyncRender::done() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _state == State::Done;
+}
@@ -0,0 +1,328 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef ASYNC_RENDER_HPP
+#define ASYNC_RENDER_HPP
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "compiled.hpp"
+#include "cursor.hpp"
+#include "options.hpp"
+#include "types.hpp"
+
+#if defined(TEMPLET_COROUTINES)
+#include <coroutine>
+#include <utility>
+#endif
+
+namespace templet {
+
+/**
+ * @brief The AsyncSink class receives the output of an AsyncRender
+ *
+ * Implemented by the owner of the connection, e.g. a socket with a
+ * bounded write buffer. Its functions are called from whichever thread
+ * runs the render, never from two threads at once.
+ */
+class AsyncSink {
+public:
+    virtual ~AsyncSink() = default;
+
+    /**
+     * @brief Take the next chunk of output
+     *
+     * The chunk is always accepted. Returning false pauses the render
+     * until AsyncRender::resume() is called, so the sink buffers at most
+     * one chunk past its own limit.
+     *
+     * @param data First character of the chunk
+     * @param size Size of the chunk, never zero
+     * @return True if the sink can take more output now, false to pause
+     */
+    virtual bool write(const char* data, std::size_t size) = 0;
+
+    /**
+     * @brief Called once after the last chunk
+     */
+    virtual void finished() = 0;
+
+    /**
+     * @brief Called instead of finished() if rendering throws
+     * @param error Exception thrown by the render
+     */
+    virtual void failed(std::exception_ptr error) = 0;
+};
+
+/**
+ * @brief The AsyncRender class renders a compiled template into a sink
+ * that applies backpressure
+ *
+ * Output is produced in chunks with a \link RenderCursor \endlink. The
+ * render runs until the sink reports that it's full and then returns,
+ * holding no thread. The sink calls resume() once it has room again and
+ * the render continues on the executor where it stopped.
+ *
+ * Renders are owned by shared pointers, a paused render can be dropped
+ * at any time.
+ *
+ * Example usage:
+ *
+ * auto render = templet::AsyncRender::start(compiled, values, connection, post);\n
+ * // Later, when the socket has drained\n
+ * render->resume();
+ */
+class AsyncRender : public std::enable_shared_from_this<AsyncRender> {
+public:
+    /**
+     * @brief Runs a step of the render, e.g. by posting it to a thread pool
+     */
+    using Executor = std::function<void(std::function<void()>)>;
+
+private:
+    enum class State {
+        Paused,
+        Running,
+        // resume() was called during a write, keep going after it
+        Resumed,
+        Done
+    };
+
+    RenderCursor _cursor;
+    AsyncSink& _sink;
+    Executor _executor;
+    std::size_t _chunkSize;
+    std::string _chunk;
+    mutable std::mutex _mutex;
+    State _state {State::Paused};
+
+    /**
+     * @brief Render and write chunks until the sink pauses or the template is done
+     */
+    void run();
+
+    /**
+     * @brief Run the next step on the executor
+     */
+    void schedule();
+
+    /**
+     * @brief Leave the running state after the sink paused
+     * @return True if resume() was called in the meantime
+     */
+    bool pause();
+
+public:
+    /**
+     * @brief Construct a paused render, see \link start \endlink
+     */
+    AsyncRender(CompiledTemplatePtr compiled, const DataMap& values, AsyncSink& sink,
+                Executor executor, RenderOptions options, std::size_t chunkSize);
+
+    AsyncRender(const AsyncRender&) = delete;
+    AsyncRender& operator=(const AsyncRender&) = delete;
+
+    /**
+     * @brief Start rendering a compiled template
+     *
+     * The first step runs on the executor, or before start returns if the
+     * executor is empty
+     *
+     * @param compiled Template to render
+     * @param values Values to reference, must outlive the render
+     * @param sink Sink to write to, must outlive the render
+     * @param executor Runs the render steps, empty runs them in the calling thread
+     * @param options Render options
+     * @param chunkSize Maximum size of each chunk
+     * @exception std::runtime_error if compiled is null or chunkSize is zero
+     * @return The render
+     */
+    static std::shared_ptr<AsyncRender> start(CompiledTemplatePtr compiled, const DataMap& values, AsyncSink& sink,
+                                              Executor executor = Executor(),
+                                              RenderOptions options = RenderOptions(),
+                                              std::size_t chunkSize = 16384);
+
+    /**
+     * @brief Continue a paused render
+     *
+     * Call once the sink has room after write() returned false. A call
+     * during that write also counts. Thread safe, does nothing if the
+     * render isn't paused or writing
+     */
+    void resume();
+
+    /**
+     * @brief Check if the render has finished or failed
+     * @return True if done, otherwise false
+     */
+    bool done() const;
+};
+
+#if defined(TEMPLET_COROUTINES)
+
+/**
+ * @brief The RenderTask class is a coroutine that renders a template
+ *
+ * Returned by \link render_chunks \endlink. The task starts when it's
+ * awaited, or when start() is called from code that isn't a coroutine,
+ * and must outlive its coroutine. Requires C++20 and TEMPLET_COROUTINES.
+ */
+class RenderTask {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        RenderTask get_return_object() {
+            return RenderTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            // The awaiting coroutine continues when the render is done
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> task) noexcept {
+                const auto continuation = task.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+
+    explicit RenderTask(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+public:
+    RenderTask(RenderTask&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+    RenderTask(const RenderTask&) = delete;
+    RenderTask& operator=(const RenderTask&) = delete;
+    RenderTask& operator=(RenderTask&&) = delete;
+
+    ~RenderTask() {
+        if(_handle) {
+            _handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return _handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        _handle.promise().continuation = caller;
+        return _handle;
+    }
+
+    /**
+     * @exception Anything thrown by the render or by the writes
+     */
+    void await_resume() const {
+        if(_handle.promise().error) {
+            std::rethrow_exception(_handle.promise().error);
+        }
+    }
+
+    /**
+     * @brief Start the task without awaiting it
+     */
+    void start() {
+        _handle.resume();
+    }
+
+    /**
+     * @brief Check if the task has finished
+     * @return True if done, otherwise false
+     */
+    bool done() const {
+        return _handle.done();
+    }
+
+    /**
+     * @brief Rethrow the exception the task finished with, if any
+     */
+    void get() const {
+        await_resume();
+    }
+};
+
+/**
+ * @brief Render a compiled template in chunks from a coroutine
+ *
+ * The coroutine suspends on each write until the awaitable returned by
+ * write completes, e.g. when a socket has room again.
+ *
+ * Example usage:
+ *
+ * co_await templet::render_chunks(compiled, values, [&](const std::string& chunk) {\n
+ *     return socket.async_write(chunk);\n
+ * });
+ *
+ * @param compiled Template to render
+ * @param values Values to reference, must outlive the task
+ * @param write Called with each chunk, returns an awaitable
+ * @param options Render options
+ * @param chunkSize Maximum size of each chunk
+ * @return Task that renders the template
+ */
+template <class Write>
+RenderTask render_chunks(CompiledTemplatePtr compiled, const DataMap& values, Write write,
+                         RenderOptions options = RenderOptions(), std::size_t chunkSize = 16384) {
+    RenderCursor cursor(std::move(compiled), values, options);
+    std::string chunk;
+    while(cursor.next(chunk, chunkSize)) {
+        co_await write(chunk);
+    }
+}
+
+#endif // TEMPLET_COROUTINES
+
+} // namespace templet
+
+#endif // ASYNC_RENDER_HPP
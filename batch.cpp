@@ -0,0 +1,116 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include "batch.hpp"
+
+using namespace templet;
+
+namespace {
+
+/**
+ * @brief Split a batch into tasks of consecutive contexts
+ *
+ * Several tasks per thread leave room for stealing, small batches get
+ * one context per task
+ *
+ * @param count Number of contexts
+ * @param threads Number of threads in the pool
+ * @return Number of contexts per task
+ */
+std::size_t grain_size(std::size_t count, std::size_t threads) {
+    return std::min<std::size_t>(64, std::max<std::size_t>(1, count / (threads * 16)));
+}
+
+/**
+ * @brief Run a function for each context of a batch on a pool
+ * @param pool Pool to run on
+ * @param count Number of contexts
+ * @param fn Called with each index
+ */
+void for_each_context(WorkerPool& pool, std::size_t count, const std::function<void(std::size_t)>& fn) {
+    const auto grain = grain_size(count, pool.size());
+    pool.run((count + grain - 1) / grain, [&](std::size_t task) {
+        const auto end = std::min(count, (task + 1) * grain);
+        for(auto i = task * grain; i < end; ++i) {
+            fn(i);
+        }
+    });
+}
+
+} // unnamed namespace
+
+void templet::render_batch(WorkerPool& pool, const CompiledTemplate& compiled, const std::vector<DataMap>& contexts,
+                           const std::function<void(std::size_t, std::string&)>& deliver,
+                           const RenderOptions& options) {
+    std::vector<std::string> results(contexts.size());
+    std::vector<char> ready(contexts.size(), 0);
+    std::size_t next = 0;
+    // Only the thread that holds the token delivers
+    bool delivering = false;
+    std::mutex mutex;
+
+    for_each_context(pool, contexts.size(), [&](std::size_t index) {
+        std::string result;
+        compiled.render(contexts[index], result, options);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        results[index] = std::move(result);
+        ready[index] = 1;
+        if(delivering) {
+            // The delivering thread picks it up before giving the token back
+            return;
+        }
+
+        delivering = true;
+        while(next < contexts.size() && ready[next]) {
+            // Claim the results that are ready and deliver them without the lock,
+            // no other thread writes to them again
+            const auto first = next;
+            while(next < contexts.size() && ready[next]) {
+                ++next;
+            }
+            const auto last = next;
+            lock.unlock();
+            for(auto i = first; i < last; ++i) {
+                deliver(i, results[i]);
+                std::string().swap(results[i]);
+            }
+            lock.lock();
+        }
+        delivering = false;
+    });
+}
+
+void templet::render_batch_to_sinks(WorkerPool& pool, const CompiledTemplate& compiled, const std::vector<DataMap>& contexts,
+                                    const std::function<Sink&(std::size_t)>& sinkFor,
+                                    const RenderOptions& options) {
+    for_each_context(pool, contexts.size(), [&](std::size_t index) {
+        compiled.render(contexts[index], sinkFor(index), options);
+    });
+}
@@ -0,0 +1,89 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "compiled.hpp"
+#include "options.hpp"
+#include "pool.hpp"
+#include "sink.hpp"
+#include "types.hpp"
+
+namespace templet {
+
+/**
+ * @brief Render a template once per context and deliver the results in order
+ *
+ * The contexts are rendered in parallel on the pool. deliver is called
+ * with each index and its result in ascending order, never from two
+ * threads at once, and may move the result out. It's called without
+ * holding a lock, so a slow deliver doesn't stop the other threads from
+ * finishing their renders.
+ *
+ * Only results that finish ahead of an earlier one are buffered, but
+ * there is no limit: if an early context is slow, most of the batch can
+ * be held in memory at once. Use render_batch_to_sinks for large batches
+ * that can be written out in any order.
+ *
+ * @param pool Pool to render on
+ * @param compiled Template to render
+ * @param contexts Values for each render
+ * @param deliver Receives the index of the context and its result
+ * @param options Render options
+ * @exception templet::exception::InvalidTagError if the values don't match the template
+ * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+ */
+void render_batch(WorkerPool& pool, const CompiledTemplate& compiled, const std::vector<DataMap>& contexts,
+                  const std::function<void(std::size_t, std::string&)>& deliver,
+                  const RenderOptions& options = RenderOptions());
+
+/**
+ * @brief Render a template once per context into a sink per context
+ *
+ * The contexts are rendered in parallel on the pool. sinkFor is called
+ * from the pool threads, once per index, and must return a sink that no
+ * other index writes to.
+ *
+ * @param pool Pool to render on
+ * @param compiled Template to render
+ * @param contexts Values for each render
+ * @param sinkFor Returns the sink for the index of a context
+ * @param options Render options
+ * @exception templet::exception::InvalidTagError if the values don't match the template
+ * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+ */
+void render_batch_to_sinks(WorkerPool& pool, const CompiledTemplate& compiled, const std::vector<DataMap>& contexts,
+                           const std::function<Sink&(std::size_t)>& sinkFor,
+                           const RenderOptions& options = RenderOptions());
+
+} // namespace templet
+
+#endif // BATCH_HPP
@@ -0,0 +1,186 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include "compiled.hpp"
+#include "templet.hpp"
+
+using namespace templet;
+
+namespace {
+
+std::atomic<std::uint64_t> next_template_id {1};
+
+/**
+ * @brief Tokenize and optimize a template source
+ * @param source Template source
+ * @param arena Arena that owns the nodes
+ * @param stats Optimizer statistics
+ * @return Top level nodes
+ */
+nodes::NodeRange tokenize_optimized(const SourcePtr& source, nodes::NodeArena& arena, nodes::OptimizeStats& stats) {
+    return nodes::optimize(tokenize(source, arena), arena, stats);
+}
+
+/**
+ * @brief Call a function and measure how long it takes
+ * @param nanoseconds Saves the time
+ * @param fn Function to call
+ * @return Result of the function
+ */
+template <class Function>
+auto measure(std::uint64_t& nanoseconds, Function fn) -> decltype(fn()) {
+    const auto start = std::chrono::steady_clock::now();
+    auto result = fn();
+    nanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                 std::chrono::steady_clock::now() - start).count());
+    return result;
+}
+
+} // unnamed namespace
+
+CompiledTemplate::CompiledTemplate(SourcePtr source)
+    : CompiledTemplate(std::move(source), tokenize_optimized) {
+
+}
+
+CompiledTemplate::CompiledTemplate(SourcePtr source, NodeBuilder build)
+    : _id(next_template_id.fetch_add(1, std::memory_order_relaxed)),
+      _source(source ? std::move(source) : make_source(std::string())),
+      _arena(),
+      _stats(),
+      _timings(),
+      _nodes(measure(_timings.buildNanoseconds, [&]() { return build(_source, _arena, _stats); })),
+      _program(measure(_timings.programNanoseconds, [&]() { return Program(_nodes); })) {
+
+}
+
+void CompiledTemplate::render(const Scope& scope, Sink& out) const {
+#if !defined(TEMPLET_NO_INSTRUMENTATION)
+    if(const auto instrumentation = scope.options().instrumentation) {
+        CountingSink counted(out);
+        const auto start = std::chrono::steady_clock::now();
+        // Tag events report the template through the scope
+        const Scope marked(scope, *this);
+        renderNodes(marked, counted);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        instrumentation->rendered(*this, counted.size(), static_cast<std::uint64_t>(elapsed));
+        return;
+    }
+#endif
+    renderNodes(scope, out);
+}
+
+void CompiledTemplate::renderNodes(const Scope& scope, Sink& out) const {
+    if(!scope.options().useNodeTree) {
+        _program.run(out, scope);
+        return;
+    }
+
+    for(auto node : _nodes) {
+        node->evaluate(out, scope);
+    }
+}
+
+void CompiledTemplate::render(const Scope& scope, std::string& out) const {
+    const auto before = out.size();
+    out.reserve(before + estimatedSize());
+    StringSink sink(out);
+    render(scope, sink);
+    recordSize(out.size() - before);
+}
+
+std::string CompiledTemplate::render(const Scope& scope) const {
+    std::string result;
+    render(scope, result);
+    return result;
+}
+
+void CompiledTemplate::render(const DataMap& values, Sink& out, const RenderOptions& options) const {
+    render(Scope(values, options), out);
+}
+
+void CompiledTemplate::render(const DataMap& values, Sink& out) const {
+    render(values, out, RenderOptions());
+}
+
+void CompiledTemplate::render(const DataMap& values, std::string& out, const RenderOptions& options) const {
+    render(Scope(values, options), out);
+}
+
+std::string CompiledTemplate::render(const DataMap& values, const RenderOptions& options) const {
+    return render(Scope(values, options));
+}
+
+std::string CompiledTemplate::render(const DataMap& values) const {
+    return render(values, RenderOptions());
+}
+
+void CompiledTemplate::recordSize(std::size_t size) const {
+    // Concurrent renders may overwrite each other's update, the
+    // estimate only has to be close
+    const auto estimate = _estimate.load(std::memory_order_relaxed);
+    _estimate.store(estimate == 0 ? size : estimate - estimate / 4 + size / 4, std::memory_order_relaxed);
+}
+
+std::size_t CompiledTemplate::estimatedSize() const {
+    const auto estimate = _estimate.load(std::memory_order_relaxed);
+    if(estimate == 0) {
+        return _program.staticSize();
+    }
+    return estimate + estimate / 8;
+}
+
+const SourcePtr& CompiledTemplate::source() const {
+    return _source;
+}
+
+nodes::NodeRange CompiledTemplate::nodes() const {
+    return _nodes;
+}
+
+const nodes::OptimizeStats& CompiledTemplate::stats() const {
+    return _stats;
+}
+
+const CompileTimings& CompiledTemplate::timings() const {
+    return _timings;
+}
+
+std::uint64_t CompiledTemplate::id() const {
+    return _id;
+}
+
+const Program& CompiledTemplate::program() const {
+    return _program;
+}
+
+const nodes::NodeArena& CompiledTemplate::arena() const {
+    return _arena;
+}
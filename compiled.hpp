@@ -0,0 +1,283 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef COMPILED_HPP
+#define COMPILED_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "arena.hpp"
+#include "instrument.hpp"
+#include "nodes.hpp"
+#include "optimizer.hpp"
+#include "options.hpp"
+#include "program.hpp"
+#include "scope.hpp"
+#include "sink.hpp"
+#include "source.hpp"
+#include "types.hpp"
+
+namespace templet {
+
+/**
+ * @brief The CompiledTemplate class holds a tokenized template
+ *
+ * A compiled template is immutable once constructed. All render state
+ * lives in the caller's sink and on the stack, so any number of threads
+ * can render the same compiled template at the same time without locks.
+ *
+ * All nodes live in one arena owned by the compiled template and link to
+ * each other with plain pointers. The tree is optimized once after
+ * tokenizing, see \link nodes::optimize \endlink, and flattened into a
+ * program, which is what render() runs unless the options ask for the
+ * node tree.
+ */
+class CompiledTemplate {
+private:
+    std::uint64_t _id;
+    SourcePtr _source;
+    nodes::NodeArena _arena;
+    nodes::OptimizeStats _stats;
+    CompileTimings _timings;
+    nodes::NodeRange _nodes;
+    Program _program;
+    mutable std::atomic<std::size_t> _estimate {0};
+
+    /**
+     * @brief Update the running estimate of the rendered size
+     * @param size Size of the last render in bytes
+     */
+    void recordSize(std::size_t size) const;
+
+    /**
+     * @brief Render into a sink with the engine selected by the options
+     * @param scope Values to reference and the render options
+     * @param out Sink to write to
+     */
+    void renderNodes(const Scope& scope, Sink& out) const;
+
+    // Included templates render without reporting a render of their own
+    friend class nodes::IncludeValue;
+
+public:
+    /**
+     * @brief Function that builds the nodes of a compiled template
+     *
+     * Returns the top level nodes, allocated in the arena, and fills in
+     * the optimizer statistics. The nodes may reference the source.
+     */
+    using NodeBuilder = nodes::NodeRange (*)(const SourcePtr& source, nodes::NodeArena& arena,
+                                             nodes::OptimizeStats& stats);
+
+    /**
+     * @brief Compile a template source
+     * @param source Template source
+     * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+     */
+    explicit CompiledTemplate(SourcePtr source);
+
+    /**
+     * @brief Build a compiled template with a custom node builder
+     *
+     * Used to load templates that were compiled ahead of time, see
+     * \link load_compiled \endlink
+     *
+     * @param source Source the nodes are built from
+     * @param build Node builder
+     * @exception Anything thrown by the builder
+     */
+    CompiledTemplate(SourcePtr source, NodeBuilder build);
+
+    CompiledTemplate(const CompiledTemplate&) = delete;
+    CompiledTemplate& operator=(const CompiledTemplate&) = delete;
+
+    /**
+     * @brief Render the template into a sink
+     *
+     * A FlatDataMap converts into a root scope with default options. With
+     * instrumentation in the options the bytes and the time are reported
+     * to Instrumentation::rendered().
+     *
+     * @param scope Values to reference and the render options
+     * @param out Sink to write to
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    void render(const Scope& scope, Sink& out) const;
+
+    /**
+     * @brief Render the template and append it to a string
+     * @param scope Values to reference and the render options
+     * @param out String to append to
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    void render(const Scope& scope, std::string& out) const;
+
+    /**
+     * @brief Render the template into a string
+     * @param scope Values to reference and the render options
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     * @return Rendered template
+     */
+    std::string render(const Scope& scope) const;
+
+    /**
+     * @brief Render the template into a sink
+     * @param values Map of key-value pairs for rendering the template
+     * @param out Sink to write to
+     * @param options Render options
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    void render(const DataMap& values, Sink& out, const RenderOptions& options) const;
+
+    /**
+     * @brief Render the template into a sink with default options
+     * @param values Map of key-value pairs for rendering the template
+     * @param out Sink to write to
+     */
+    void render(const DataMap& values, Sink& out) const;
+
+    /**
+     * @brief Render the template and append it to a string
+     *
+     * Capacity for the estimated size is reserved before rendering,
+     * so a string usually grows once
+     *
+     * @param values Map of key-value pairs for rendering the template
+     * @param out String to append to
+     * @param options Render options
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    void render(const DataMap& values, std::string& out, const RenderOptions& options) const;
+
+    /**
+     * @brief Render the template into a string
+     * @param values Map of key-value pairs for rendering the template
+     * @param options Render options
+     * @return Rendered template
+     */
+    std::string render(const DataMap& values, const RenderOptions& options) const;
+
+    /**
+     * @brief Render the template into a string with default options
+     * @param values Map of key-value pairs for rendering the template
+     * @return Rendered template
+     */
+    std::string render(const DataMap& values) const;
+
+    /**
+     * @brief Get the expected size of the next render into a string
+     *
+     * Before the first render this is the size of the static text, after
+     * that a running average of the previous renders with some headroom
+     *
+     * @return Size in bytes
+     */
+    std::size_t estimatedSize() const;
+
+    /**
+     * @brief Get the template source
+     *
+     * For a template loaded with a node builder this is the source the
+     * nodes were built from, e.g. a serialized template
+     *
+     * @return Template source
+     */
+    const SourcePtr& source() const;
+
+    /**
+     * @brief Get the top level nodes
+     * @return Range of nodes, owned by the compiled template
+     */
+    nodes::NodeRange nodes() const;
+
+    /**
+     * @brief Get the node counts before and after optimizing the tree
+     * @return Optimizer statistics
+     */
+    const nodes::OptimizeStats& stats() const;
+
+    /**
+     * @brief Get the time spent compiling the template
+     * @return Compile timings
+     */
+    const CompileTimings& timings() const;
+
+    /**
+     * @brief Get the id of the template
+     *
+     * Ids are never reused, unlike the address of a released template
+     *
+     * @return Id that is unique for the life of the process
+     */
+    std::uint64_t id() const;
+
+    /**
+     * @brief Get the program compiled from the nodes
+     * @return Program
+     */
+    const Program& program() const;
+
+    /**
+     * @brief Get the arena that owns the nodes
+     * @return Node arena
+     */
+    const nodes::NodeArena& arena() const;
+};
+
+using CompiledTemplatePtr = std::shared_ptr<const CompiledTemplate>;
+
+/**
+ * @brief Compile a template source
+ * @param source Template source
+ * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+ * @return Compiled template
+ */
+static inline CompiledTemplatePtr make_compiled(SourcePtr source) {
+    return std::make_shared<const CompiledTemplate>(std::move(source));
+}
+
+/**
+ * @brief Compile template text
+ * @param text Template text
+ * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+ * @return Compiled template
+ */
+static inline CompiledTemplatePtr make_compiled(std::string text) {
+    return make_compiled(make_source(std::move(text)));
+}
+
+} // namespace templet
+
+#endif // COMPILED_HPP
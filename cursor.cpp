@@ -0,0 +1,121 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include "cursor.hpp"
+
+using namespace templet;
+
+namespace {
+
+/**
+ * @brief The ChunkSink class fills a chunk and keeps the overflow
+ */
+class ChunkSink : public Sink {
+private:
+    std::string& _chunk;
+    std::string& _overflow;
+    std::size_t _maxBytes;
+
+public:
+    ChunkSink(std::string& chunk, std::string& overflow, std::size_t maxBytes)
+        : _chunk(chunk), _overflow(overflow), _maxBytes(maxBytes) {}
+
+    void write(const char* data, std::size_t size) override {
+        const auto room = _maxBytes - std::min(_maxBytes, _chunk.size());
+        const auto count = std::min(room, size);
+        _chunk.append(data, count);
+        _overflow.append(data + count, size - count);
+    }
+
+    bool full() const {
+        return _chunk.size() >= _maxBytes;
+    }
+};
+
+/**
+ * @brief Check that a compiled template is set
+ * @param compiled Compiled template
+ * @exception std::runtime_error if compiled is null
+ * @return The compiled template
+ */
+CompiledTemplatePtr checked(CompiledTemplatePtr compiled) {
+    if(!compiled) {
+        throw std::runtime_error("Render cursor needs a compiled template");
+    }
+    return compiled;
+}
+
+} // unnamed namespace
+
+RenderCursor::RenderCursor(CompiledTemplatePtr compiled, const DataMap& values, RenderOptions options)
+    : _compiled(checked(std::move(compiled))),
+      _options(options),
+      _scope(values, _options),
+      _marked(_scope, *_compiled),
+      _state(_compiled->program(), _options.instrumentation ? _marked : _scope) {
+    _state.serial();
+}
+
+RenderCursor::RenderCursor(CompiledTemplatePtr compiled, const FlatDataMap& values, RenderOptions options)
+    : _compiled(checked(std::move(compiled))),
+      _options(options),
+      _scope(values, _options),
+      _marked(_scope, *_compiled),
+      _state(_compiled->program(), _options.instrumentation ? _marked : _scope) {
+    _state.serial();
+}
+
+bool RenderCursor::next(std::string& chunk, std::size_t maxBytes) {
+    if(maxBytes == 0) {
+        throw std::runtime_error("Chunk size must not be zero");
+    }
+
+    chunk.clear();
+    // Output left over from the previous chunk comes first
+    if(_offset < _pending.size()) {
+        const auto count = std::min(maxBytes, _pending.size() - _offset);
+        chunk.assign(_pending, _offset, count);
+        _offset += count;
+    }
+    if(_offset == _pending.size()) {
+        _pending.clear();
+        _offset = 0;
+    }
+
+    if(!_finished && chunk.size() < maxBytes) {
+        ChunkSink out(chunk, _pending, maxBytes);
+        _finished = _compiled->program().resume(_state, out, [&out]() { return out.full(); });
+    }
+
+    return !chunk.empty();
+}
+
+bool RenderCursor::done() const {
+    return _finished && _pending.size() == _offset;
+}
@@ -0,0 +1,114 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef CURSOR_HPP
+#define CURSOR_HPP
+
+#include <cstddef>
+#include <string>
+#include "compiled.hpp"
+#include "options.hpp"
+#include "program.hpp"
+#include "scope.hpp"
+#include "types.hpp"
+
+namespace templet {
+
+/**
+ * @brief The RenderCursor class renders a compiled template in chunks
+ *
+ * Each call to next() continues where the previous one stopped, also
+ * inside of if blocks and for loops, until the chunk is full. The head
+ * of a document can be sent while its body is still being rendered.
+ *
+ * Output is split at any byte. Output of the last instruction that
+ * doesn't fit in a chunk is kept for the next call, so only that much
+ * is buffered in the cursor. The cursor always runs the program, the
+ * useNodeTree option is ignored. Loops are not split across the worker
+ * pool either, since that would buffer the whole loop.
+ *
+ * Example usage:
+ *
+ * templet::RenderCursor cursor(compiled, values);\n
+ * std::string chunk;\n
+ * while(cursor.next(chunk, 16384)) {\n
+ *     send(chunk);\n
+ * }
+ */
+class RenderCursor {
+private:
+    CompiledTemplatePtr _compiled;
+    RenderOptions _options;
+    Scope _scope;
+    // Marks the template for instrumentation
+    Scope _marked;
+    ProgramState _state;
+    std::string _pending;
+    std::size_t _offset {0};
+    bool _finished {false};
+
+public:
+    /**
+     * @brief Start rendering a compiled template
+     * @param compiled Template to render
+     * @param values Values to reference, must outlive the cursor
+     * @param options Render options
+     * @exception std::runtime_error if compiled is null
+     */
+    RenderCursor(CompiledTemplatePtr compiled, const DataMap& values, RenderOptions options = RenderOptions());
+
+    /**
+     * @brief \sa RenderCursor
+     */
+    RenderCursor(CompiledTemplatePtr compiled, const FlatDataMap& values, RenderOptions options = RenderOptions());
+
+    RenderCursor(const RenderCursor&) = delete;
+    RenderCursor& operator=(const RenderCursor&) = delete;
+
+    /**
+     * @brief Render the next chunk
+     *
+     * If rendering throws, the cursor must not be used any further
+     *
+     * @param chunk Receives the chunk, its previous contents are replaced
+     * @param maxBytes Maximum size of the chunk, must not be zero
+     * @exception std::runtime_error if maxBytes is zero
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     * @return True if chunk has output, false if the template is done
+     */
+    bool next(std::string& chunk, std::size_t maxBytes);
+
+    /**
+     * @brief Check if all output has been returned
+     * @return True if done, otherwise false
+     */
+    bool done() const;
+};
+
+} // namespace templet
+
+#endif // CURSOR_HPP
@@ -0,0 +1,120 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "filters.hpp"
+#include "scanner.hpp"
+
+namespace {
+
+/**
+ * @brief Write a value with HTML entities for the special characters
+ * @param out Sink to write to
+ * @param data Bytes to write
+ * @param size Number of bytes
+ */
+void escape_html(templet::Sink& out, const char* data, std::size_t size) {
+    std::size_t pos = 0;
+    while(pos < size) {
+        const auto special = templet::helpers::find_html_special(data, pos, size);
+        if(special > pos) {
+            out.write(data + pos, special - pos);
+        }
+        if(special == size) {
+            break;
+        }
+
+        switch(data[special]) {
+        case '&':
+            out.write("&amp;", 5);
+            break;
+        case '<':
+            out.write("&lt;", 4);
+            break;
+        case '>':
+            out.write("&gt;", 4);
+            break;
+        case '"':
+            out.write("&quot;", 6);
+            break;
+        default:
+            out.write("&#39;", 5);
+            break;
+        }
+        pos = special + 1;
+    }
+}
+
+/**
+ * @brief Write a value with everything but unreserved characters percent-encoded
+ * @param out Sink to write to
+ * @param data Bytes to write
+ * @param size Number of bytes
+ */
+void escape_url(templet::Sink& out, const char* data, std::size_t size) {
+    static const char digits[] = "0123456789ABCDEF";
+
+    std::size_t pos = 0;
+    while(pos < size) {
+        const auto special = templet::helpers::find_url_special(data, pos, size);
+        if(special > pos) {
+            out.write(data + pos, special - pos);
+        }
+        if(special == size) {
+            break;
+        }
+
+        // Encode the whole run of special bytes with one write
+        char encoded[96];
+        std::size_t length = 0;
+        pos = special;
+        do {
+            const auto c = static_cast<unsigned char>(data[pos]);
+            encoded[length] = '%';
+            encoded[length + 1] = digits[c >> 4];
+            encoded[length + 2] = digits[c & 0x0f];
+            length += 3;
+            ++pos;
+        } while(pos < size && length < sizeof(encoded) &&
+                templet::helpers::find_url_special(data, pos, pos + 1) == pos);
+        out.write(encoded, length);
+    }
+}
+
+} // unnamed namespace
+
+void templet::write_filtered(Sink& out, const char* data, std::size_t size, Filter filter) {
+    switch(filter) {
+    case Filter::Html:
+        escape_html(out, data, size);
+        break;
+    case Filter::Url:
+        escape_url(out, data, size);
+        break;
+    default:
+        out.write(data, size);
+        break;
+    }
+}
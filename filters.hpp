@@ -0,0 +1,61 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef FILTERS_HPP
+#define FILTERS_HPP
+
+#include <cstddef>
+#include "sink.hpp"
+
+namespace templet {
+
+/**
+ * @brief The Filter enum lists the output filters of value tags
+ *
+ * A filter is added to a value tag after a |, e.g. {$ name|html }
+ */
+enum class Filter {
+    None,   ///< Write the value as is
+    Html,   ///< Escape &, <, >, " and ' as HTML entities
+    Url     ///< Percent-encode everything except unreserved URL characters
+};
+
+/**
+ * @brief Write a value to a sink through a filter
+ *
+ * Runs of bytes that need no escaping are written as they are, so a
+ * value without special characters is written with a single call
+ *
+ * @param out Sink to write to
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @param filter Filter to apply
+ */
+void write_filtered(Sink& out, const char* data, std::size_t size, Filter filter);
+
+} // namespace templet
+
+#endif // FILTERS_HPP
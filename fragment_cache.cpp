@@ -0,0 +1,101 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <utility>
+#include "fragment_cache.hpp"
+
+using namespace templet;
+
+FragmentCache::FragmentCache(std::size_t maxBytes)
+    : _maxBytes(maxBytes) {
+
+}
+
+std::shared_ptr<const std::string> FragmentCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _index.find(key);
+    if(it == _index.end()) {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->second;
+}
+
+void FragmentCache::insert(std::string key, std::string output) {
+    const auto size = key.size() + output.size();
+    if(size > _maxBytes) {
+        return;
+    }
+
+    auto fragment = std::make_shared<const std::string>(std::move(output));
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _index.find(key);
+    if(it != _index.end()) {
+        // Another render stored the same fragment first
+        _bytes -= it->first.size() + it->second->second->size();
+        _entries.erase(it->second);
+        _index.erase(it);
+    }
+
+    while(!_entries.empty() && _bytes + size > _maxBytes) {
+        const auto& last = _entries.back();
+        _bytes -= last.first.size() + last.second->size();
+        _index.erase(last.first);
+        _entries.pop_back();
+    }
+
+    _entries.emplace_front(key, std::move(fragment));
+    _index.emplace(std::move(key), _entries.begin());
+    _bytes += size;
+}
+
+void FragmentCache::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+    _bytes = 0;
+}
+
+std::size_t FragmentCache::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+std::size_t FragmentCache::bytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+std::uint64_t FragmentCache::hits() const {
+    return _hits.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FragmentCache::misses() const {
+    return _misses.load(std::memory_order_relaxed);
+}
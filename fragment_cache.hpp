@@ -0,0 +1,124 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef FRAGMENT_CACHE_HPP
+#define FRAGMENT_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace templet {
+
+/**
+ * @brief The FragmentCache class keeps the output of cache blocks
+ *
+ * Output of {% cache key %}...{% endcache %} blocks is stored under the
+ * block and the value of its key. The least recently used fragments are
+ * evicted once the stored output grows past the byte limit. All methods
+ * can be called from several threads at once.
+ */
+class FragmentCache {
+private:
+    using Fragment = std::shared_ptr<const std::string>;
+    using Entry = std::pair<std::string, Fragment>;
+
+    mutable std::mutex _mutex;
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+    std::size_t _maxBytes;
+    std::size_t _bytes {0};
+    std::atomic<std::uint64_t> _hits {0};
+    std::atomic<std::uint64_t> _misses {0};
+
+public:
+    /**
+     * @brief Construct an empty cache
+     * @param maxBytes Most bytes of keys and output to keep
+     */
+    explicit FragmentCache(std::size_t maxBytes = 16 * 1024 * 1024);
+
+    FragmentCache(const FragmentCache&) = delete;
+    FragmentCache& operator=(const FragmentCache&) = delete;
+
+    /**
+     * @brief Find a fragment
+     *
+     * The fragment stays valid after it's evicted
+     *
+     * @param key Key of the fragment
+     * @return Fragment, or nullptr if not cached
+     */
+    std::shared_ptr<const std::string> find(const std::string& key);
+
+    /**
+     * @brief Store a fragment
+     *
+     * Fragments larger than the byte limit are not stored
+     *
+     * @param key Key of the fragment
+     * @param output Rendered output
+     */
+    void insert(std::string key, std::string output);
+
+    /**
+     * @brief Remove all fragments
+     */
+    void clear();
+
+    /**
+     * @brief Get the number of cached fragments
+     * @return Number of fragments
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Get the bytes of keys and output kept by the cache
+     * @return Number of bytes
+     */
+    std::size_t bytes() const;
+
+    /**
+     * @brief Get the number of lookups that found a fragment
+     * @return Number of hits
+     */
+    std::uint64_t hits() const;
+
+    /**
+     * @brief Get the number of lookups that found nothing
+     * @return Number of misses
+     */
+    std::uint64_t misses() const;
+};
+
+} // namespace templet
+
+#endif // FRAGMENT_CACHE_HPP
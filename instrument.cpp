@@ -0,0 +1,177 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "compiled.hpp"
+#include "instrument.hpp"
+#include "nodes.hpp"
+
+using namespace templet;
+
+namespace {
+
+/**
+ * @brief Add the paths of the value tags and loops of a tree to a list
+ * @param nodes Nodes to search, including their children
+ * @param paths List to add to, in source order
+ */
+void collect_tags(nodes::NodeRange nodes, std::vector<const nodes::TagPath*>& paths) {
+    for(auto node : nodes) {
+        switch(node->type()) {
+        case nodes::NodeType::Value:
+            paths.push_back(&static_cast<const nodes::Value*>(node)->path());
+            break;
+        case nodes::NodeType::IfValue:
+        case nodes::NodeType::ElifValue:
+            collect_tags(static_cast<const nodes::IfValue*>(node)->children(), paths);
+            break;
+        case nodes::NodeType::ElseValue:
+            collect_tags(static_cast<const nodes::ElseValue*>(node)->children(), paths);
+            break;
+        case nodes::NodeType::ForValue:
+            paths.push_back(&static_cast<const nodes::ForValue*>(node)->path());
+            collect_tags(static_cast<const nodes::ForValue*>(node)->children(), paths);
+            break;
+        case nodes::NodeType::StaticForValue:
+            paths.push_back(&static_cast<const nodes::StaticForValue*>(node)->path());
+            break;
+        case nodes::NodeType::CacheValue:
+            collect_tags(static_cast<const nodes::CacheValue*>(node)->children(), paths);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+} // unnamed namespace
+
+void Instrumentation::missingTag(const CompiledTemplate* /*compiled*/, const nodes::TagPath& /*path*/) {
+
+}
+
+void Instrumentation::loopFinished(const CompiledTemplate* /*compiled*/, const nodes::TagPath& /*path*/,
+                                   std::size_t /*items*/, std::uint64_t /*nanoseconds*/) {
+
+}
+
+void Instrumentation::rendered(const CompiledTemplate& /*compiled*/, std::size_t /*bytes*/,
+                               std::uint64_t /*nanoseconds*/) {
+
+}
+
+void RenderProfile::missingTag(const CompiledTemplate* compiled, const nodes::TagPath& path) {
+    _missingTags.fetch_add(1, std::memory_order_relaxed);
+    if(compiled == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_templates[compiled->id()].tags[&path].missing;
+}
+
+void RenderProfile::loopFinished(const CompiledTemplate* compiled, const nodes::TagPath& path, std::size_t items,
+                                 std::uint64_t nanoseconds) {
+    _loops.fetch_add(1, std::memory_order_relaxed);
+    _loopItems.fetch_add(items, std::memory_order_relaxed);
+    if(compiled == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& counters = _templates[compiled->id()].tags[&path];
+    ++counters.loops;
+    counters.loopItems += items;
+    counters.nanoseconds += nanoseconds;
+}
+
+void RenderProfile::rendered(const CompiledTemplate& compiled, std::size_t bytes, std::uint64_t nanoseconds) {
+    _renders.fetch_add(1, std::memory_order_relaxed);
+    _bytes.fetch_add(bytes, std::memory_order_relaxed);
+    _nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& counters = _templates[compiled.id()].renders;
+    ++counters.renders;
+    counters.bytes += bytes;
+    counters.nanoseconds += nanoseconds;
+}
+
+RenderCounters RenderProfile::totals() const {
+    RenderCounters counters;
+    counters.renders = _renders.load(std::memory_order_relaxed);
+    counters.bytes = _bytes.load(std::memory_order_relaxed);
+    counters.nanoseconds = _nanoseconds.load(std::memory_order_relaxed);
+    counters.missingTags = _missingTags.load(std::memory_order_relaxed);
+    counters.loops = _loops.load(std::memory_order_relaxed);
+    counters.loopItems = _loopItems.load(std::memory_order_relaxed);
+    return counters;
+}
+
+RenderCounters RenderProfile::counters(const CompiledTemplate& compiled) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _templates.find(compiled.id());
+    return it != _templates.end() ? it->second.renders : RenderCounters();
+}
+
+std::vector<TagCounters> RenderProfile::tags(const CompiledTemplate& compiled) const {
+    std::vector<TagCounters> result;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _templates.find(compiled.id());
+        if(it == _templates.end() || it->second.tags.empty()) {
+            return result;
+        }
+
+        // The paths are owned by the nodes of the template, which is alive
+        std::vector<const nodes::TagPath*> paths;
+        collect_tags(compiled.nodes(), paths);
+        for(std::size_t i = 0; i < paths.size(); ++i) {
+            const auto tag = it->second.tags.find(paths[i]);
+            if(tag != it->second.tags.end()) {
+                result.push_back(tag->second);
+                result.back().index = i;
+                result.back().tag = paths[i]->str();
+            }
+        }
+    }
+    return result;
+}
+
+void RenderProfile::forget(const CompiledTemplate& compiled) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _templates.erase(compiled.id());
+}
+
+void RenderProfile::reset() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _renders = 0;
+    _bytes = 0;
+    _nanoseconds = 0;
+    _missingTags = 0;
+    _loops = 0;
+    _loopItems = 0;
+    _templates.clear();
+}
@@ -0,0 +1,274 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Call an instrumentation hook if the options have one
+ *
+ * Defining TEMPLET_NO_INSTRUMENTATION removes every hook at compile time,
+ * otherwise a disabled hook costs one null pointer check
+ *
+ * @param options Render options
+ * @param call Member function call on the instrumentation
+ */
+#if defined(TEMPLET_NO_INSTRUMENTATION)
+#define TEMPLET_INSTRUMENT(options, call) ((void)0)
+#else
+#define TEMPLET_INSTRUMENT(options, call) \
+    do { \
+        if(::templet::Instrumentation* const templet_hook_ = (options).instrumentation) { \
+            templet_hook_->call; \
+        } \
+    } while(false)
+#endif
+
+namespace templet {
+
+class CompiledTemplate;
+
+namespace nodes {
+class TagPath;
+}
+
+class Instrumentation;
+
+/**
+ * @brief Read the clock for a hook that reports a duration
+ * @param hook Instrumentation of the render, may be null
+ * @return Nanoseconds on a steady clock, zero without instrumentation
+ */
+inline std::uint64_t hook_clock(const Instrumentation* hook) {
+#if defined(TEMPLET_NO_INSTRUMENTATION)
+    (void)hook;
+    return 0;
+#else
+    if(hook == nullptr) {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/**
+ * @brief The HookTimer class measures a duration for a hook
+ *
+ * The clock is only read when instrumentation is set
+ */
+class HookTimer {
+private:
+    const Instrumentation* _hook;
+    std::uint64_t _start;
+
+public:
+    /**
+     * @brief Start measuring
+     * @param hook Instrumentation of the render, may be null
+     */
+    explicit HookTimer(const Instrumentation* hook) : _hook(hook), _start(hook_clock(hook)) {}
+
+    /**
+     * @brief Get the time since the timer was started
+     * @return Nanoseconds, zero without instrumentation
+     */
+    std::uint64_t elapsed() const {
+        return hook_clock(_hook) - _start;
+    }
+};
+
+/**
+ * @brief The CompileTimings struct holds the time spent compiling a template
+ */
+struct CompileTimings {
+    std::uint64_t buildNanoseconds {0};     ///< Tokenizing and optimizing, or loading a serialized template
+    std::uint64_t programNanoseconds {0};   ///< Flattening the nodes into a program
+};
+
+/**
+ * @brief The Instrumentation class receives render events
+ *
+ * Set RenderOptions::instrumentation to enable it. The hooks are called
+ * from every thread that renders with the options, so implementations
+ * must be thread safe. All hooks do nothing by default.
+ *
+ * Tag events pass the template the tag belongs to and the path of the
+ * tag. Each path is owned by one node of the template, so it identifies
+ * the node for as long as the template is alive.
+ */
+class Instrumentation {
+public:
+    virtual ~Instrumentation() = default;
+
+    /**
+     * @brief Called for a value tag that is not found
+     * @param compiled Template of the tag, nullptr for static templates
+     * and nodes evaluated outside of a compiled template
+     * @param path Path of the tag
+     */
+    virtual void missingTag(const CompiledTemplate* compiled, const nodes::TagPath& path);
+
+    /**
+     * @brief Called when a for loop has rendered all of its items
+     *
+     * The time of a loop in a RenderCursor includes the pauses between chunks
+     *
+     * @param compiled Template of the loop, nullptr for static templates
+     * and nodes evaluated outside of a compiled template
+     * @param path Path of the list
+     * @param items Number of iterations
+     * @param nanoseconds Time spent in the loop
+     */
+    virtual void loopFinished(const CompiledTemplate* compiled, const nodes::TagPath& path, std::size_t items,
+                              std::uint64_t nanoseconds);
+
+    /**
+     * @brief Called after a compiled template has been rendered
+     *
+     * Not called for the chunks of a RenderCursor
+     *
+     * @param compiled Rendered template, see CompiledTemplate::timings() for the compile times
+     * @param bytes Number of bytes written
+     * @param nanoseconds Time spent rendering
+     */
+    virtual void rendered(const CompiledTemplate& compiled, std::size_t bytes, std::uint64_t nanoseconds);
+};
+
+/**
+ * @brief The RenderCounters struct holds counters collected by a RenderProfile
+ */
+struct RenderCounters {
+    std::uint64_t renders {0};      ///< Completed renders
+    std::uint64_t bytes {0};        ///< Bytes written
+    std::uint64_t nanoseconds {0};  ///< Time spent rendering
+    std::uint64_t missingTags {0};  ///< Value tags that were not found
+    std::uint64_t loops {0};        ///< Finished for loops
+    std::uint64_t loopItems {0};    ///< Iterations of all for loops
+};
+
+/**
+ * @brief The TagCounters struct holds the counters of one tag in a template
+ */
+struct TagCounters {
+    std::size_t index {0};          ///< Position among the value tags and loops of the template
+    std::string tag;                ///< Tag expression
+    std::uint64_t missing {0};      ///< Times the value was not found
+    std::uint64_t loops {0};        ///< Finished loops
+    std::uint64_t loopItems {0};    ///< Iterations of the loops
+    std::uint64_t nanoseconds {0};  ///< Time spent in the loops
+};
+
+/**
+ * @brief The RenderProfile class collects counters from render events
+ *
+ * Totals are atomic counters, the counters per template and per tag are
+ * kept in maps behind a mutex. Templates are told apart by their id, so
+ * counters are never merged, but they are kept until forget() is called.
+ * Events without a compiled template only count towards the totals.
+ */
+class RenderProfile : public Instrumentation {
+private:
+    std::atomic<std::uint64_t> _renders {0};
+    std::atomic<std::uint64_t> _bytes {0};
+    std::atomic<std::uint64_t> _nanoseconds {0};
+    std::atomic<std::uint64_t> _missingTags {0};
+    std::atomic<std::uint64_t> _loops {0};
+    std::atomic<std::uint64_t> _loopItems {0};
+
+    /**
+     * @brief Counters of a template and of its tags
+     */
+    struct TemplateCounters {
+        RenderCounters renders;
+        std::map<const nodes::TagPath*, TagCounters> tags;
+    };
+
+    mutable std::mutex _mutex;
+    std::map<std::uint64_t, TemplateCounters> _templates;
+
+public:
+    RenderProfile() = default;
+
+    RenderProfile(const RenderProfile&) = delete;
+    RenderProfile& operator=(const RenderProfile&) = delete;
+
+    void missingTag(const CompiledTemplate* compiled, const nodes::TagPath& path) override;
+    void loopFinished(const CompiledTemplate* compiled, const nodes::TagPath& path, std::size_t items,
+                      std::uint64_t nanoseconds) override;
+    void rendered(const CompiledTemplate& compiled, std::size_t bytes, std::uint64_t nanoseconds) override;
+
+    /**
+     * @brief Get the counters of all renders
+     * @return Counters
+     */
+    RenderCounters totals() const;
+
+    /**
+     * @brief Get the render counters of a template
+     *
+     * Only renders, bytes and nanoseconds are counted per template
+     *
+     * @param compiled Compiled template
+     * @return Counters, all zero if the template wasn't rendered
+     */
+    RenderCounters counters(const CompiledTemplate& compiled) const;
+
+    /**
+     * @brief Get the counters of the tags of a template
+     * @param compiled Compiled template
+     * @return Counters of the tags that had events, in source order
+     */
+    std::vector<TagCounters> tags(const CompiledTemplate& compiled) const;
+
+    /**
+     * @brief Drop the counters of a template
+     *
+     * Call before releasing a template that won't be rendered again,
+     * the totals are kept
+     *
+     * @param compiled Compiled template
+     */
+    void forget(const CompiledTemplate& compiled);
+
+    /**
+     * @brief Set all counters to zero
+     */
+    void reset();
+};
+
+} // namespace templet
+
+#endif // INSTRUMENT_HPP
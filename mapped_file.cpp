@@ -0,0 +1,99 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdexcept>
+#include "mapped_file.hpp"
+
+#if defined(_WIN32)
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace templet;
+
+#if defined(_WIN32)
+
+MappedSource::MappedSource(const std::string& path)
+    : Source(), _fallback(helpers::FileReader::fromFile(path)) {
+    _data = _fallback.data();
+    _size = _fallback.size();
+}
+
+MappedSource::~MappedSource() {
+
+}
+
+#else
+
+MappedSource::MappedSource(const std::string& path)
+    : Source() {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1) {
+        throw std::runtime_error("File not found: " + path);
+    }
+
+    struct stat info;
+    if(::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("File can't be read: " + path);
+    }
+
+    _size = static_cast<std::size_t>(info.st_size);
+    if(_size == 0) {
+        // Empty files can't be mapped
+        ::close(fd);
+        _data = _fallback.data();
+        return;
+    }
+
+    void* mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+        throw std::runtime_error("File can't be mapped: " + path);
+    }
+    _data = static_cast<const char*>(mapping);
+}
+
+MappedSource::~MappedSource() {
+    if(_size > 0) {
+        ::munmap(const_cast<char*>(_data), _size);
+    }
+}
+
+#endif
+
+const char* MappedSource::data() const {
+    return _data;
+}
+
+std::size_t MappedSource::size() const {
+    return _size;
+}
@@ -0,0 +1,104 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "source.hpp"
+#include "templet.hpp"
+
+namespace templet {
+
+/**
+ * @brief The MappedSource class maps a template file into memory
+ *
+ * The text nodes of a template compiled from a mapped source reference
+ * the mapping directly, so the file is never copied. The file should be
+ * replaced by renaming a new file over it rather than rewritten in place
+ * while it is mapped.
+ *
+ * Platforms without mmap read the file into memory instead.
+ */
+class MappedSource : public Source {
+private:
+    const char* _data {nullptr};
+    std::size_t _size {0};
+    std::string _fallback;
+
+public:
+    /**
+     * @brief Map a file into memory
+     * @param path Path to file
+     * @exception std::runtime_error Thrown if file can't be opened or mapped
+     */
+    explicit MappedSource(const std::string& path);
+
+    ~MappedSource();
+
+    MappedSource(const MappedSource&) = delete;
+    MappedSource& operator=(const MappedSource&) = delete;
+
+    const char* data() const override;
+    std::size_t size() const override;
+};
+
+namespace helpers {
+
+/**
+ * @brief Reads file contents by mapping the file into memory
+ *
+ * Can be used in place of FileReader, e.g.
+ * tpl.setTemplateFromFile<templet::helpers::MappedFileReader>(path)
+ */
+struct MappedFileReader {
+    /**
+     * @brief Map file contents
+     * @param path Path to file
+     * @exception std::runtime_error Thrown if file can't be opened
+     * @return Contents of the file as a source
+     */
+    static SourcePtr fromFile(const std::string& path) {
+        return std::make_shared<MappedSource>(path);
+    }
+
+    /**
+     * @brief Get the modification time of a file
+     * @param path Path to file
+     * @exception std::runtime_error Thrown if file can't be found
+     * @return Modification time in an unspecified unit
+     */
+    static std::int64_t lastModified(const std::string& path) {
+        return FileReader::lastModified(path);
+    }
+};
+
+} // namespace helpers
+} // namespace templet
+
+#endif // MAPPED_FILE_HPP
@@ -25,12 +25,16 @@ THE SOFTWARE.
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <functional>
+#include <limits>
 #include <memory>
-#include <sstream>
 #include <stdexcept>
 #include <utility>
+#include "compiled.hpp"
+#include "fragment_cache.hpp"
+#include "instrument.hpp"
 #include "nodes.hpp"
 #include "split.hpp"
 #include "strutils.hpp"
@@ -71,13 +75,42 @@ bool isValidNameExpression(const std::string& name) {
 
 /**
  * @brief Parse a string into a number
+ *
+ * Accepts an optional minus sign followed by decimal digits
+ *
  * @param text String to parse
  * @param results Save the parsed integer
  * @return True on success, otherwise false
  */
 bool parse_number(const std::string& text, int& result) {
-    std::istringstream parser {text};
-    return parser >> result >> std::ws && parser.peek() == EOF;
+    auto it = text.cbegin();
+    const bool negative = (it != text.cend() && *it == '-');
+    if(negative) {
+        ++it;
+    }
+    if(it == text.cend()) {
+        return false;
+    }
+
+    long long value = 0;
+    for(; it != text.cend(); ++it) {
+        if(*it < '0' || *it > '9') {
+            return false;
+        }
+        value = value * 10 + (*it - '0');
+        if(value > static_cast<long long>(std::numeric_limits<int>::max()) + 1) {
+            return false;
+        }
+    }
+    if(negative) {
+        value = -value;
+    }
+    if(value > std::numeric_limits<int>::max()) {
+        return false;
+    }
+
+    result = static_cast<int>(value);
+    return true;
 }
 
 /**
@@ -91,7 +124,7 @@ bool parse_number(const std::string& text, int& result) {
  * @exception templet::exception::InvalidTagError
  * @return Index as an int
  */
-int parse_array_index(std::string in) {
+int parse_array_index(const std::string& in) {
     if(!mylib::starts_with(in, "[") || !mylib::ends_with(in, "]")) {
         throw templet::exception::InvalidTagError("Invalid array syntax: Value must be enclosed with []");
     }
@@ -107,21 +140,16 @@ int parse_array_index(std::string in) {
 }
 
 /**
- * @brief Parse a full tag name
+ * @brief Compile a full tag name into path steps
  *
  * Parses a full tag name, e.g.: config.servers[1].users[6].username
  *
  * @param name String to parse
- * @param kv Map of values to reference
- * @exception templet::exception::MissingTagError If tag is not found in kv
  * @exception templet::exception::InvalidTagError
- * @return DataPtr to the parsed tag value
+ * @return Vector of path steps
  */
-templet::types::DataPtr parse_tag(std::string name, const DataMap& kv) {
-    // mapRef holds a reference to the current map level in dot notated tags
-    auto mapRef = std::cref(kv);
-    // lastItem holds a pointer to the last evaluated value in the tag
-    templet::types::DataPtr lastItem;
+std::vector<PathStep> compile_tag(std::string name) {
+    std::vector<PathStep> steps;
     while(!name.empty()) {
         const auto pos = name.find('.');
         // Parse the first found tag name which may contain [n]...[n]
@@ -143,110 +171,159 @@ templet::types::DataPtr parse_tag(std::string name, const DataMap& kv) {
         else if(!isValidName(tagName)) {
             throw templet::exception::InvalidTagError("Invalid syntax: " + tag);
         }
-        const auto& map = mapRef.get();
-        if(!map.count(tagName)) {
-            //throw templet::exception::MissingTagError("Tag name not found: " + tagName);
-            lastItem.reset();
-            break;
-        }
-        lastItem = map.at(tagName);
+        PathStep keyStep;
+        keyStep.kind = PathStep::Kind::Key;
+        keyStep.key = tagName;
+        keyStep.symbol = templet::types::intern(tagName);
+        steps.push_back(std::move(keyStep));
         // Parse the array index syntax
         if(arrPos != std::string::npos) {
-            if(lastItem->type() != templet::types::DataType::List) {
-                //throw templet::exception::InvalidTagError("Array syntax can only be used to access elements in lists");
-                lastItem.reset();
-                break;
-            }
-            auto listRef = std::cref(lastItem->getList());
             auto arr = tag.substr(arrPos);
             while(!arr.empty()) {
                 const auto arrEndPos = arr.find(']');
-                const std::size_t index = parse_array_index(arr.substr(0, arrEndPos + 1));
+                // Negative indexes wrap around and are never found
+                PathStep indexStep;
+                indexStep.kind = PathStep::Kind::Index;
+                indexStep.index = parse_array_index(arr.substr(0, arrEndPos + 1));
+                steps.push_back(std::move(indexStep));
                 arr.erase(0, arrEndPos + 1);
                 if(!arr.empty() && arr[0] != '[') {
                     // Valid e.g. for groups[0]users[1]
                     throw templet::exception::InvalidTagError("Invalid syntax: " + tag);
                 }
-                if(index >= listRef.get().size()) {
-                    //throw templet::exception::InvalidTagError("Array index out of bounds: " + tag);
-                    name.clear();
-                    lastItem.reset();
-                    break;
-                }
-                lastItem = listRef.get().at(index);
-                if(lastItem->type() != templet::types::DataType::List) {
-                    // All elements accessed via the array index sequence [n]...[m]
-                    // must be lists, with the exception of the last element
-                    // which may be a string, a map, or a list
-                    if(arr.empty()) {
-                        break;
-                    }
-                    //throw templet::exception::InvalidTagError("Array syntax can only be used to access elements in lists");
-                    name.clear();
-                    lastItem.reset();
-                    break;
-                }
-                listRef = std::cref(lastItem->getList());
             }
         }
-        // After the tag name has been parsed and evaluated, if the remaining
-        // tag name is not empty (implying dot notation), the last evaluated
-        // item must be a map value
-        if(!name.empty()) {
-            if(lastItem->type() != templet::types::DataType::Mapper) {
-                throw templet::exception::InvalidTagError("Dot notation can only be used on maps");
-            }
-
-            mapRef = std::cref(lastItem->getMap());
-        }
     }
-    return lastItem;
+    return steps;
 }
 
 /**
- * @brief A helper function for \link parse_tag \endlink that evaluates into a string
- * @param name Tag name to parse
- * @param kv Values to reference
- * @exception templet::exception::InvalidTagError if result is not a string
- * @return Parsed result as a string
+ * @brief A helper function for \link TagPath::resolve \endlink that evaluates into a list
+ * @param path Tag path to resolve
+ * @param scope Values to reference
+ * @exception templet::exception::InvalidTagError if result is not a list or a stream
+ * @return Parsed result, a list or a stream
  */
-std::string parse_tag_string(const std::string& name, const DataMap& kv) {
-    const auto& res = parse_tag(name, kv);
+const templet::types::Data& parse_tag_list(const TagPath& path, const Scope& scope) {
+    const auto res = path.resolve(scope);
     if(!res) {
-            throw templet::exception::MissingTagError("Tag name not found: " + name);
+            throw templet::exception::MissingTagError("Tag name not found: " + path.str());
     }
-    else if(res->type() != templet::types::DataType::String) {
-        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a string");
+    else if(res->type() != templet::types::DataType::List &&
+            res->type() != templet::types::DataType::Stream) {
+        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a list");
     }
 
-    return res->getValue();
+    return *res;
 }
 
 /**
- * @brief A helper function for \link parse_tag \endlink that evaluates into a vector
- * @param name Tag name to parse
- * @param kv Values to reference
- * @exception templet::exception::InvalidTagError if result is not a vector
- * @return Parsed result as a vector
+ * @brief Call a function for each item of a list or a stream
+ *
+ * Items of a stream are released after the function returns
+ *
+ * @param list List or stream
+ * @param fn Function to call with a pointer to each item
  */
-const templet::types::DataVector& parse_tag_list(const std::string& name, const DataMap& kv) {
-    const auto& res = parse_tag(name, kv);
-    if(!res) {
-            throw templet::exception::MissingTagError("Tag name not found: " + name);
-    }
-    else if(res->type() != templet::types::DataType::List) {
-        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a list");
+template <class Function>
+void for_each_item(const templet::types::Data& list, Function fn) {
+    if(list.type() == templet::types::DataType::Stream) {
+        const auto next = list.stream();
+        auto item = next();
+        while(item) {
+            fn(item.get());
+            // Release the item before the generator makes the next one
+            item.reset();
+            item = next();
+        }
+        return;
     }
 
-    return res->getList();
+    const auto size = list.listSize();
+    for(std::size_t i = 0; i < size; ++i) {
+        fn(list.listItem(i));
+    }
 }
 
 } // unnamed namespace
 
+TagPath::TagPath(std::string expression)
+    : _expression(std::move(expression)), _steps(compile_tag(_expression)) {
+
+}
+
+const std::string& TagPath::str() const {
+    return _expression;
+}
+
+const std::vector<PathStep>& TagPath::steps() const {
+    return _steps;
+}
+
+const templet::types::Data* TagPath::resolve(const Scope& scope) const {
+    // lastItem holds a pointer to the last evaluated value in the tag
+    const templet::types::Data* lastItem = nullptr;
+    for(const auto& step : _steps) {
+        if(step.kind == PathStep::Kind::Key) {
+            if(!lastItem) {
+                lastItem = scope.find(step.key, step.symbol);
+            }
+            else {
+                // Names after the first one use dot notation, so
+                // the last evaluated item must be a map value
+                if(lastItem->type() != templet::types::DataType::Mapper) {
+                    throw templet::exception::InvalidTagError("Dot notation can only be used on maps");
+                }
+                lastItem = lastItem->find(step.key, step.symbol);
+            }
+        }
+        else {
+            // All elements accessed via the array index sequence [n]...[m]
+            // must be lists, with the exception of the last element
+            // which may be a string, a map, or a list
+            if(lastItem->type() != templet::types::DataType::List) {
+                return nullptr;
+            }
+            if(step.index >= lastItem->listSize()) {
+                return nullptr;
+            }
+            lastItem = lastItem->listItem(step.index);
+        }
+        if(!lastItem) {
+            return nullptr;
+        }
+    }
+    return lastItem;
+}
+
+void NodeList::assign(NodeRange range) {
+    _owned.clear();
+    _pointers.clear();
+    _range = range;
+}
+
+void NodeList::assign(std::vector<std::shared_ptr<Node>> nodes) {
+    _pointers.clear();
+    for(const auto& node : nodes) {
+        _pointers.push_back(node.get());
+    }
+    _owned.swap(nodes);
+    _range = NodeRange(_pointers.data(), _pointers.size());
+}
+
 void Node::setChildren(std::vector<std::shared_ptr<Node>> /*children*/) {
     throw std::runtime_error("This Node type cannot have children");
 }
 
+void Node::setChildren(NodeRange /*children*/) {
+    throw std::runtime_error("This Node type cannot have children");
+}
+
+void Node::evaluate(std::ostream& os, const Scope& scope) const {
+    templet::OstreamSink out(os);
+    evaluate(out, scope);
+}
+
 NodeType Node::type() const {
     return NodeType::Invalid;
 }
@@ -256,37 +333,72 @@ void Node::setParent(Node* parent) {
 }
 
 Text::Text(std::string text)
-    : Node(), _in(std::move(text)) {
+    : Node(), _source(templet::make_source(std::move(text))),
+      _in(_source->data()), _size(_source->size()) {
 
 }
 
-void Text::evaluate(std::ostream& os, const DataMap& /*kv*/) const {
-    os << _in;
+Text::Text(templet::SourcePtr source, std::size_t pos, std::size_t size)
+    : Node(), _source(std::move(source)), _in(_source->data() + pos), _size(size) {
+
+}
+
+Text::Text(const char* text, std::size_t size)
+    : Node(), _source(), _in(text), _size(size) {
+
+}
+
+const char* Text::data() const {
+    return _in;
+}
+
+std::size_t Text::size() const {
+    return _size;
+}
+
+void Text::evaluate(Sink& out, const Scope& /*scope*/) const {
+    out.writeStatic(_in, _size);
 }
 
 NodeType Text::type() const {
     return NodeType::Text;
 }
 
-Value::Value(std::string name)
-    : Node(), _name(std::move(name)) {
-    if(!isValidNameExpression(_name)) {
+Value::Value(std::string name, Filter filter)
+    : Node(), _path(), _filter(filter) {
+    if(!isValidNameExpression(name)) {
         throw templet::exception::InvalidTagError("Variable tag name contains invalid characters");
     }
+    _path = TagPath(std::move(name));
 }
 
-void Value::evaluate(std::ostream& os, const DataMap& kv) const {
-    try {
-        os << parse_tag_string(_name, kv);
-    }
-    catch(const templet::exception::MissingTagError& ex) {
+const TagPath& Value::path() const {
+    return _path;
+}
+
+templet::Filter Value::filter() const {
+    return _filter;
+}
+
+void Value::evaluate(Sink& out, const Scope& scope) const {
+    const auto res = _path.resolve(scope);
+    if(!res) {
+        TEMPLET_INSTRUMENT(scope.options(), missingTag(scope.compiled(), _path));
         // Default behavior is to just ignore it, effectively
         // just removing the tag name from the output
-        // TODO: Add user config option to re-throw
+        if(scope.options().strictMissingTags) {
+            throw templet::exception::MissingTagError("Tag name not found: " + _path.str());
+        }
+        return;
     }
-    catch(...) {
-        throw;
+    else if(res->type() != templet::types::DataType::String) {
+        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a string");
     }
+
+    char buffer[templet::types::textBufferSize];
+    std::size_t size = 0;
+    const auto value = res->text(buffer, size);
+    write_filtered(out, value, size, _filter);
 }
 
 NodeType Value::type() const {
@@ -294,37 +406,53 @@ NodeType Value::type() const {
 }
 
 IfValue::IfValue(std::string name)
-    : Node(), _name(std::move(name)), _nodes() {
-    if(!isValidNameExpression(_name)) {
+    : Node(), _path(), _nodes() {
+    if(!isValidNameExpression(name)) {
         throw templet::exception::InvalidTagError("If expression tag name contains invalid characters");
     }
+    _path = TagPath(std::move(name));
 }
 
 void IfValue::setChildren(std::vector<std::shared_ptr<Node>> children) {
     for(auto& child : children) {
         child->setParent(this);
     }
-    _nodes.swap(children);
+    _nodes.assign(std::move(children));
+}
+
+void IfValue::setChildren(NodeRange children) {
+    for(auto child : children) {
+        child->setParent(this);
+    }
+    _nodes.assign(children);
+}
+
+const TagPath& IfValue::path() const {
+    return _path;
+}
+
+NodeRange IfValue::children() const {
+    return _nodes.range();
 }
 
-void IfValue::evaluate(std::ostream& os, const DataMap& kv) const {
+void IfValue::evaluate(Sink& out, const Scope& scope) const {
     // Check that the IF condition is TRUE (it's enough that it's been set)
-    const auto parsed_tag = parse_tag(_name, kv);
+    const auto parsed_tag = _path.resolve(scope);
     if(parsed_tag) {
-        for(auto& node : _nodes) {
+        for(auto node : _nodes) {
             if(node->type() == templet::nodes::NodeType::ElifValue ||
                     node->type() == templet::nodes::NodeType::ElseValue) {
                 break;
             }
-            node->evaluate(os, kv);
+            node->evaluate(out, scope);
         }
     }
     else {
         // Do Elif/else block
-        for(auto& node : _nodes) {
+        for(auto node : _nodes) {
             if(node->type() == templet::nodes::NodeType::ElifValue ||
                     node->type() == templet::nodes::NodeType::ElseValue) {
-                node->evaluate(os, kv);
+                node->evaluate(out, scope);
             }
         }
     }
@@ -339,7 +467,7 @@ ElifValue::ElifValue(std::string name)
 
 }
 
-void ElifValue::evaluate(std::ostream& os, const templet::types::DataMap& kv) const {
+void ElifValue::evaluate(Sink& out, const Scope& scope) const {
     if(_parent == nullptr) {
         throw templet::exception::InvalidTagError("ELIF statements cannot be declared without a preceding IF statement");
     }
@@ -350,21 +478,32 @@ void ElifValue::evaluate(std::ostream& os, const templet::types::DataMap& kv) co
         throw templet::exception::InvalidTagError("ELIF statements cannot be declared without a preceding IF statement");
     }
 
-    IfValue::evaluate(os, kv);
+    IfValue::evaluate(out, scope);
 }
 
 NodeType ElifValue::type() const {
     return NodeType::ElifValue;
 }
 
-void ElseValue::setChildren(std::vector<std::shared_ptr<Node> > children) {
+void ElseValue::setChildren(std::vector<std::shared_ptr<Node>> children) {
     for(auto& child : children) {
         child->setParent(this);
     }
-    _nodes.swap(children);
+    _nodes.assign(std::move(children));
+}
+
+void ElseValue::setChildren(NodeRange children) {
+    for(auto child : children) {
+        child->setParent(this);
+    }
+    _nodes.assign(children);
+}
+
+NodeRange ElseValue::children() const {
+    return _nodes.range();
 }
 
-void ElseValue::evaluate(std::ostream& os, const templet::types::DataMap& kv) const {
+void ElseValue::evaluate(Sink& out, const Scope& scope) const {
     if(_parent == nullptr) {
         throw templet::exception::InvalidTagError("ELSE statements cannot be declared without a preceding IF or ELIF statement");
     }
@@ -375,8 +514,8 @@ void ElseValue::evaluate(std::ostream& os, const templet::types::DataMap& kv) co
         throw templet::exception::InvalidTagError("ELSE statements cannot be declared without a preceding IF or ELIF statement");
     }
 
-    for(auto& node : _nodes) {
-        node->evaluate(os, kv);
+    for(auto node : _nodes) {
+        node->evaluate(out, scope);
     }
 }
 
@@ -386,44 +525,270 @@ NodeType ElseValue::type() const {
 
 
 ForValue::ForValue(std::string name, std::string alias)
-    : Node(), _name(std::move(name)), _alias(std::move(alias)), _nodes() {
+    : Node(), _path(), _alias(std::move(alias)), _aliasSymbol(types::invalidSymbol), _nodes() {
     // Validate names
-    if(!isValidNameExpression(_name)) {
+    if(!isValidNameExpression(name)) {
         throw templet::exception::InvalidTagError("For expression first tag name contains invalid characters");
     }
     else if(!isValidName(_alias)) {
         throw templet::exception::InvalidTagError("For expression second tag name contains invalid characters");
     }
+    _path = TagPath(std::move(name));
+    _aliasSymbol = types::intern(_alias);
 }
 
 void ForValue::setChildren(std::vector<std::shared_ptr<Node>> children) {
     for(auto& child : children) {
         child->setParent(this);
     }
-    _nodes.swap(children);
+    _nodes.assign(std::move(children));
+}
+
+void ForValue::setChildren(NodeRange children) {
+    for(auto child : children) {
+        child->setParent(this);
+    }
+    _nodes.assign(children);
+}
+
+const TagPath& ForValue::path() const {
+    return _path;
+}
+
+const std::string& ForValue::alias() const {
+    return _alias;
+}
+
+templet::types::Symbol ForValue::aliasSymbol() const {
+    return _aliasSymbol;
 }
 
-void ForValue::evaluate(std::ostream& os, const templet::types::DataMap& kv) const {
-    const auto& evaluatedList = parse_tag_list(_name, kv);
-    if(kv.count(_alias)) {
+NodeRange ForValue::children() const {
+    return _nodes.range();
+}
+
+void ForValue::evaluate(Sink& out, const Scope& scope) const {
+    const auto& evaluatedList = parse_tag_list(_path, scope);
+    if(scope.contains(_alias, _aliasSymbol)) {
         throw templet::exception::InvalidTagError("For expression alias name collides with an existing name");
     }
-    // In a for statement the map entries are copied
-    // and the 'as' values are added with the new name
-    templet::types::DataMap newValues = kv;
-    for(const auto& item : evaluatedList) {
-        newValues[_alias] = item;
-        for(auto& node : _nodes) {
-            node->evaluate(os, newValues);
+    // In a for statement the 'as' values are bound to the new name
+    // in a child scope, the parent values are not copied
+    Scope itemScope(scope, _alias);
+    const HookTimer timer(scope.options().instrumentation);
+    std::size_t items = 0;
+    for_each_item(evaluatedList, [&](const templet::types::Data* item) {
+        itemScope.bind(item);
+        for(auto node : _nodes) {
+            node->evaluate(out, itemScope);
         }
-    }
+        ++items;
+    });
+    TEMPLET_INSTRUMENT(scope.options(), loopFinished(scope.compiled(), _path, items, timer.elapsed()));
 }
 
 NodeType ForValue::type() const {
     return NodeType::ForValue;
 }
 
-std::shared_ptr<Node> templet::nodes::parse_value_tag(std::string in) {
+namespace {
+
+/**
+ * @brief Next cache block id, keeps the fragments of blocks apart
+ */
+std::atomic<std::uint64_t> next_cache_id {0};
+
+} // unnamed namespace
+
+CacheValue::CacheValue(std::string name)
+    : Node(), _path(), _nodes(), _id(next_cache_id.fetch_add(1, std::memory_order_relaxed)) {
+    if(!isValidNameExpression(name)) {
+        throw templet::exception::InvalidTagError("Cache expression tag name contains invalid characters");
+    }
+    _path = TagPath(std::move(name));
+}
+
+void CacheValue::setChildren(std::vector<std::shared_ptr<Node>> children) {
+    for(auto& child : children) {
+        child->setParent(this);
+    }
+    _nodes.assign(std::move(children));
+}
+
+void CacheValue::setChildren(NodeRange children) {
+    for(auto child : children) {
+        child->setParent(this);
+    }
+    _nodes.assign(children);
+}
+
+const TagPath& CacheValue::path() const {
+    return _path;
+}
+
+NodeRange CacheValue::children() const {
+    return _nodes.range();
+}
+
+void CacheValue::evaluate(Sink& out, const Scope& scope) const {
+    const auto cache = scope.options().fragmentCache;
+    const auto res = cache ? _path.resolve(scope) : nullptr;
+    if(!res) {
+        // Without a cache or a key the block renders every time
+        for(auto node : _nodes) {
+            node->evaluate(out, scope);
+        }
+        return;
+    }
+    else if(res->type() != templet::types::DataType::String) {
+        throw templet::exception::InvalidTagError("Invalid tag name: Cache key must reference a string");
+    }
+
+    auto key = std::to_string(_id);
+    key += '\0';
+    char buffer[templet::types::textBufferSize];
+    std::size_t size = 0;
+    const auto value = res->text(buffer, size);
+    key.append(value, size);
+    if(const auto fragment = cache->find(key)) {
+        out.write(fragment->data(), fragment->size());
+        return;
+    }
+
+    std::string output;
+    StringSink sink(output);
+    for(auto node : _nodes) {
+        node->evaluate(sink, scope);
+    }
+    out.write(output.data(), output.size());
+    cache->insert(std::move(key), std::move(output));
+}
+
+NodeType CacheValue::type() const {
+    return NodeType::CacheValue;
+}
+
+IncludeValue::IncludeValue(std::string name)
+    : Node(), _name(std::move(name)), _target() {
+    const auto invalid = std::find_if(_name.cbegin(), _name.cend(), [](char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '"' || c == '\'';
+    });
+    if(_name.empty() || invalid != _name.cend()) {
+        throw templet::exception::InvalidTagError("Include template name contains invalid characters");
+    }
+}
+
+const std::string& IncludeValue::name() const {
+    return _name;
+}
+
+void IncludeValue::bind(std::shared_ptr<const templet::CompiledTemplate> target) {
+    _target = std::move(target);
+}
+
+const std::shared_ptr<const templet::CompiledTemplate>& IncludeValue::target() const {
+    return _target;
+}
+
+void IncludeValue::evaluate(Sink& out, const Scope& scope) const {
+    if(!_target) {
+        throw templet::exception::InvalidTagError("Included template is not loaded: " + _name);
+    }
+#if !defined(TEMPLET_NO_INSTRUMENTATION)
+    if(scope.options().instrumentation != nullptr) {
+        // Tags of the partial report the partial
+        const Scope marked(scope, *_target);
+        _target->renderNodes(marked, out);
+        return;
+    }
+#endif
+    _target->renderNodes(scope, out);
+}
+
+NodeType IncludeValue::type() const {
+    return NodeType::IncludeValue;
+}
+
+StaticIfValue::StaticIfValue(TagPath path, const char* text, std::size_t size)
+    : Node(), _path(std::move(path)), _in(text), _size(size) {
+
+}
+
+const TagPath& StaticIfValue::path() const {
+    return _path;
+}
+
+const char* StaticIfValue::data() const {
+    return _in;
+}
+
+std::size_t StaticIfValue::size() const {
+    return _size;
+}
+
+void StaticIfValue::evaluate(Sink& out, const Scope& scope) const {
+    if(_path.resolve(scope)) {
+        out.writeStatic(_in, _size);
+    }
+}
+
+NodeType StaticIfValue::type() const {
+    return NodeType::StaticIfValue;
+}
+
+StaticForValue::StaticForValue(TagPath path, std::string alias, const char* text, std::size_t size)
+    : Node(), _path(std::move(path)), _alias(std::move(alias)), _aliasSymbol(types::intern(_alias)),
+      _in(text), _size(size) {
+
+}
+
+const TagPath& StaticForValue::path() const {
+    return _path;
+}
+
+const std::string& StaticForValue::alias() const {
+    return _alias;
+}
+
+templet::types::Symbol StaticForValue::aliasSymbol() const {
+    return _aliasSymbol;
+}
+
+const char* StaticForValue::data() const {
+    return _in;
+}
+
+std::size_t StaticForValue::size() const {
+    return _size;
+}
+
+void StaticForValue::evaluate(Sink& out, const Scope& scope) const {
+    const auto& evaluatedList = parse_tag_list(_path, scope);
+    if(scope.contains(_alias, _aliasSymbol)) {
+        throw templet::exception::InvalidTagError("For expression alias name collides with an existing name");
+    }
+    const HookTimer timer(scope.options().instrumentation);
+    std::size_t items = 0;
+    for_each_item(evaluatedList, [&](const templet::types::Data* /*item*/) {
+        out.writeStatic(_in, _size);
+        ++items;
+    });
+    TEMPLET_INSTRUMENT(scope.options(), loopFinished(scope.compiled(), _path, items, timer.elapsed()));
+}
+
+NodeType StaticForValue::type() const {
+    return NodeType::StaticForValue;
+}
+
+namespace {
+
+/**
+ * @brief Extract the name from a value tag
+ * @param in Tag to parse
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Name inside the tag
+ */
+std::string value_tag_name(std::string in) {
     if(!mylib::starts_with(in, "{$") || !mylib::ends_with(in, "}")) {
         throw templet::exception::InvalidTagError("Tag must be enclosed with {$ and }");
     }
@@ -433,27 +798,40 @@ std::shared_ptr<Node> templet::nodes::parse_value_tag(std::string in) {
     in.erase(in.find('}'));
     in = mylib::trim(in);
 
-    return std::make_shared<Value>(std::move(in));
+    return in;
 }
 
-std::shared_ptr<Node> templet::nodes::parse_ifvalue_tag(std::string in) {
-    if(!mylib::starts_with(in, "{%") || !mylib::ends_with(in, "%}")) {
-        throw templet::exception::InvalidTagError("Tag must be enclosed with {% and %}");
+/**
+ * @brief Remove the output filter from the name in a value tag
+ * @param name Name inside the tag, e.g. "name|html", set to the name without the filter
+ * @exception templet::exception::InvalidTagError if the filter is unknown
+ * @return Filter after the |, or Filter::None if there is none
+ */
+templet::Filter value_tag_filter(std::string& name) {
+    const auto bar = name.find('|');
+    if(bar == std::string::npos) {
+        return templet::Filter::None;
     }
 
-    in.erase(0, 2);
-    in.erase(in.find('%'));
-    in = mylib::trim(in);
-    if(!mylib::starts_with(in, "if ")) {
-        throw templet::exception::InvalidTagError("Tag must be prefixed with 'if '");
+    const auto filter = mylib::trimmed(name.substr(bar + 1));
+    name = mylib::trimmed(name.substr(0, bar));
+    if(filter == "html") {
+        return templet::Filter::Html;
     }
-
-    in = mylib::ltrim(in.erase(0, in.find(' ') + 1));
-
-    return std::make_shared<IfValue>(std::move(in));
+    else if(filter == "url") {
+        return templet::Filter::Url;
+    }
+    throw templet::exception::InvalidTagError("Unknown filter: " + filter);
 }
 
-std::shared_ptr<Node> templet::nodes::parse_elifvalue_tag(std::string in) {
+/**
+ * @brief Extract the name from an if or elif tag
+ * @param in Tag to parse
+ * @param prefix Expected keyword followed by a space, e.g. "if "
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Name inside the tag
+ */
+std::string condition_tag_name(std::string in, const std::string& prefix) {
     if(!mylib::starts_with(in, "{%") || !mylib::ends_with(in, "%}")) {
         throw templet::exception::InvalidTagError("Tag must be enclosed with {% and %}");
     }
@@ -461,17 +839,23 @@ std::shared_ptr<Node> templet::nodes::parse_elifvalue_tag(std::string in) {
     in.erase(0, 2);
     in.erase(in.find('%'));
     in = mylib::trim(in);
-    if(!mylib::starts_with(in, "elif ")) {
-        throw templet::exception::InvalidTagError("Tag must be prefixed with 'elif '");
+    if(!mylib::starts_with(in, prefix)) {
+        throw templet::exception::InvalidTagError("Tag must be prefixed with '" + prefix + "'");
     }
 
     in = mylib::ltrim(in.erase(0, in.find(' ') + 1));
 
-    return std::make_shared<ElifValue>(std::move(in));
+    return in;
 }
 
-std::shared_ptr<Node> templet::nodes::parse_forvalue_tag(std::string in)
-{
+/**
+ * @brief Extract the list name and the alias from a for tag
+ * @param in Tag to parse
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @exception templet::exception::ExpressionSyntaxError if invalid for expression
+ * @return Vector of the for expression tokens
+ */
+std::vector<std::string> for_tag_tokens(std::string in) {
     if(!mylib::starts_with(in, "{%") || !mylib::ends_with(in, "%}")) {
         throw templet::exception::InvalidTagError("Tag must be enclosed with {% and %}");
     }
@@ -488,5 +872,101 @@ std::shared_ptr<Node> templet::nodes::parse_forvalue_tag(std::string in)
         throw templet::exception::ExpressionSyntaxError("Unrecognized for expression syntax");
     }
 
+    return tokens;
+}
+
+} // unnamed namespace
+
+std::shared_ptr<Node> templet::nodes::parse_value_tag(std::string in) {
+    auto name = value_tag_name(std::move(in));
+    const auto filter = value_tag_filter(name);
+    return std::make_shared<Value>(std::move(name), filter);
+}
+
+Node* templet::nodes::parse_value_tag(std::string in, NodeArena& arena) {
+    auto name = value_tag_name(std::move(in));
+    const auto filter = value_tag_filter(name);
+    return arena.create<Value>(std::move(name), filter);
+}
+
+std::shared_ptr<Node> templet::nodes::parse_ifvalue_tag(std::string in) {
+    return std::make_shared<IfValue>(condition_tag_name(std::move(in), "if "));
+}
+
+Node* templet::nodes::parse_ifvalue_tag(std::string in, NodeArena& arena) {
+    return arena.create<IfValue>(condition_tag_name(std::move(in), "if "));
+}
+
+std::shared_ptr<Node> templet::nodes::parse_elifvalue_tag(std::string in) {
+    return std::make_shared<ElifValue>(condition_tag_name(std::move(in), "elif "));
+}
+
+Node* templet::nodes::parse_elifvalue_tag(std::string in, NodeArena& arena) {
+    return arena.create<ElifValue>(condition_tag_name(std::move(in), "elif "));
+}
+
+std::shared_ptr<Node> templet::nodes::parse_forvalue_tag(std::string in) {
+    const auto tokens = for_tag_tokens(std::move(in));
     return std::make_shared<ForValue>(tokens[1], tokens[3]);
 }
+
+Node* templet::nodes::parse_forvalue_tag(std::string in, NodeArena& arena) {
+    const auto tokens = for_tag_tokens(std::move(in));
+    return arena.create<ForValue>(tokens[1], tokens[3]);
+}
+
+std::shared_ptr<Node> templet::nodes::parse_cache_tag(std::string in) {
+    return std::make_shared<CacheValue>(condition_tag_name(std::move(in), "cache "));
+}
+
+Node* templet::nodes::parse_cache_tag(std::string in, NodeArena& arena) {
+    return arena.create<CacheValue>(condition_tag_name(std::move(in), "cache "));
+}
+
+std::shared_ptr<Node> templet::nodes::parse_include_tag(std::string in) {
+    return std::make_shared<IncludeValue>(condition_tag_name(std::move(in), "include "));
+}
+
+Node* templet::nodes::parse_include_tag(std::string in, NodeArena& arena) {
+    return arena.create<IncludeValue>(condition_tag_name(std::move(in), "include "));
+}
+
+namespace {
+
+/**
+ * @brief Add the include nodes of a tree to a list
+ * @param nodes Nodes to search, including their children
+ * @param includes List to add to
+ */
+void collect_includes(NodeRange nodes, std::vector<IncludeValue*>& includes) {
+    for(auto node : nodes) {
+        switch(node->type()) {
+        case NodeType::IfValue:
+        case NodeType::ElifValue:
+            collect_includes(static_cast<const IfValue*>(node)->children(), includes);
+            break;
+        case NodeType::ElseValue:
+            collect_includes(static_cast<const ElseValue*>(node)->children(), includes);
+            break;
+        case NodeType::ForValue:
+            collect_includes(static_cast<const ForValue*>(node)->children(), includes);
+            break;
+        case NodeType::CacheValue:
+            collect_includes(static_cast<const CacheValue*>(node)->children(), includes);
+            break;
+        case NodeType::IncludeValue:
+            includes.push_back(static_cast<IncludeValue*>(node));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+} // unnamed namespace
+
+std::vector<IncludeValue*> templet::nodes::find_includes(NodeRange nodes) {
+    std::vector<IncludeValue*> includes;
+    collect_includes(nodes, includes);
+    return includes;
+}
@@ -28,12 +28,21 @@ THE SOFTWARE.
 #define NODES_HPP
 
 #include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include "arena.hpp"
+#include "filters.hpp"
+#include "scope.hpp"
+#include "sink.hpp"
+#include "source.hpp"
 #include "types.hpp"
 
 namespace templet {
+
+class CompiledTemplate;
+
 namespace exception {
 
 /**
@@ -70,6 +79,70 @@ public:
 namespace nodes {
 
 using ::templet::types::DataMap;
+using ::templet::types::Scope;
+
+/**
+ * @brief The PathStep struct is a single step in a tag path
+ */
+struct PathStep {
+    /**
+     * @brief Describes how the step is resolved
+     */
+    enum class Kind {
+        Key,    ///< Look up a name in a map
+        Index   ///< Look up an element in a list
+    };
+
+    Kind kind {Kind::Key};
+    std::string key;
+    types::Symbol symbol {types::invalidSymbol};
+    std::size_t index {0};
+};
+
+/**
+ * @brief The TagPath class holds a tag expression compiled into steps
+ *
+ * The expression config.servers[1].name compiles into the steps
+ * config, servers, [1] and name
+ */
+class TagPath {
+private:
+    std::string _expression;
+    std::vector<PathStep> _steps;
+
+public:
+    TagPath() = default;
+
+    /**
+     * @brief Compile a tag expression
+     * @param expression Tag expression, e.g. config.servers[1].name
+     * @exception templet::exception::InvalidTagError if the expression has invalid syntax
+     */
+    explicit TagPath(std::string expression);
+
+    /**
+     * @brief Get the tag expression
+     * @return Tag expression as written in the template
+     */
+    const std::string& str() const;
+
+    /**
+     * @brief Get the compiled steps
+     * @return Vector of steps
+     */
+    const std::vector<PathStep>& steps() const;
+
+    /**
+     * @brief Resolve the path against a scope of values
+     *
+     * The returned pointer is owned by the values referenced by the scope
+     *
+     * @param scope Values to reference, a DataMap converts into a root scope
+     * @exception templet::exception::InvalidTagError if dot notation is used on a value that is not a map
+     * @return Pointer to the value or nullptr if the path is not found
+     */
+    const types::Data* resolve(const Scope& scope) const;
+};
 
 /**
  * @brief The NodeType enum describes what the node represents
@@ -81,7 +154,81 @@ enum class NodeType {
     IfValue,    ///< An if block
     ElifValue,  ///< An elif block
     ElseValue,  ///< An else block
-    ForValue    ///< A for loop block
+    ForValue,       ///< A for loop block
+    StaticIfValue,  ///< An if block with only text inside
+    StaticForValue, ///< A for loop block with only text inside
+    CacheValue,     ///< A block whose output is cached
+    IncludeValue    ///< Another template rendered in place
+};
+
+class Node;
+
+/**
+ * @brief The NodeRange class references a contiguous array of nodes
+ *
+ * The range does not own the nodes
+ */
+class NodeRange {
+private:
+    Node* const* _begin {nullptr};
+    std::size_t _size {0};
+
+public:
+    NodeRange() = default;
+
+    /**
+     * @brief Construct a range over an array of nodes
+     * @param begin First element of the array
+     * @param size Number of elements
+     */
+    NodeRange(Node* const* begin, std::size_t size) : _begin(begin), _size(size) {}
+
+    Node* const* begin() const { return _begin; }
+    Node* const* end() const { return _begin + _size; }
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    Node* operator[](std::size_t index) const { return _begin[index]; }
+};
+
+/**
+ * @brief The NodeList class holds the child nodes of a block node
+ *
+ * Children are either referenced from a NodeArena, or owned through
+ * shared pointers when they are set by the user
+ */
+class NodeList {
+private:
+    NodeRange _range;
+    std::vector<std::shared_ptr<Node>> _owned;
+    std::vector<Node*> _pointers;
+
+public:
+    NodeList() = default;
+
+    NodeList(const NodeList&) = delete;
+    NodeList& operator=(const NodeList&) = delete;
+
+    /**
+     * @brief Reference nodes owned by someone else, e.g. an arena
+     * @param range Nodes to reference
+     */
+    void assign(NodeRange range);
+
+    /**
+     * @brief Take shared ownership of nodes
+     * @param nodes Nodes to own
+     */
+    void assign(std::vector<std::shared_ptr<Node>> nodes);
+
+    /**
+     * @brief Get the nodes
+     * @return Range of nodes
+     */
+    NodeRange range() const { return _range; }
+
+    Node* const* begin() const { return _range.begin(); }
+    Node* const* end() const { return _range.end(); }
+    std::size_t size() const { return _range.size(); }
 };
 
 /**
@@ -105,10 +252,27 @@ public:
      */
     virtual void setChildren(std::vector<std::shared_ptr<Node>> /*newNodes*/);
 
+    /**
+     * @brief Set child nodes that are owned by someone else, e.g. a NodeArena
+     *
+     * The children must outlive this node
+     *
+     * @exception std::runtime_error If called on a node that doesn't support children
+     */
+    virtual void setChildren(NodeRange /*newNodes*/);
+
+    /**
+     * @brief Evaluates the Node and outputs the computed value in sink out
+     *
+     * A DataMap converts into a root scope, so nodes can be evaluated
+     * with either
+     */
+    virtual void evaluate(Sink& /*out*/, const Scope& /*scope*/) const = 0;
+
     /**
      * @brief Evaluates the Node and outputs the computed value in ostream os
      */
-    virtual void evaluate(std::ostream& /*os*/, const DataMap& /*kv*/) const = 0;
+    void evaluate(std::ostream& os, const Scope& scope) const;
 
     virtual NodeType type() const;
 
@@ -127,7 +291,9 @@ public:
  */
 class Text : public Node {
 private:
-    std::string _in;
+    SourcePtr _source;
+    const char* _in {nullptr};
+    std::size_t _size {0};
 
 public:
     Text() = default;
@@ -138,7 +304,38 @@ public:
      */
     Text(std::string text);
 
-    void evaluate(std::ostream& os, const DataMap& /*kv*/) const override;
+    /**
+     * @brief Construct a text node referencing a span of the template source
+     * @param source Template source that holds the text
+     * @param pos Offset of the text block in the source
+     * @param size Size of the text block
+     */
+    Text(SourcePtr source, std::size_t pos, std::size_t size);
+
+    /**
+     * @brief Construct a text node referencing text it doesn't own
+     *
+     * The text must outlive the node, e.g. the source of a compiled template
+     *
+     * @param text First character of the text block
+     * @param size Size of the text block
+     */
+    Text(const char* text, std::size_t size);
+
+    /**
+     * @brief Get the text block
+     * @return First character of the text block
+     */
+    const char* data() const;
+
+    /**
+     * @brief Get the size of the text block
+     * @return Size in bytes
+     */
+    std::size_t size() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& /*scope*/) const override;
 
     NodeType type() const override;
 };
@@ -150,7 +347,8 @@ public:
  */
 class Value : public Node {
 private:
-    std::string _name;
+    TagPath _path;
+    Filter _filter;
 
 public:
     /**
@@ -159,11 +357,25 @@ public:
      * See \link isValidTag \endlink for valid tag names
      *
      * @param name Variable name to replace
+     * @param filter Filter the value is written through
      * @exception Throws templet::exception::InvalidTagError if invalid tag name
      */
-    Value(std::string name);
+    Value(std::string name, Filter filter = Filter::None);
 
-    void evaluate(std::ostream& os, const DataMap& kv) const override;
+    /**
+     * @brief Get the path of the variable
+     * @return Tag path
+     */
+    const TagPath& path() const;
+
+    /**
+     * @brief Get the output filter
+     * @return Filter
+     */
+    Filter filter() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
 
     NodeType type() const override;
 };
@@ -175,8 +387,8 @@ public:
  */
 class IfValue : public Node {
 protected:
-    std::string _name;
-    std::vector<std::shared_ptr<Node>> _nodes;
+    TagPath _path;
+    NodeList _nodes;
 
 public:
     /**
@@ -190,8 +402,22 @@ public:
     IfValue(std::string name);
 
     void setChildren(std::vector<std::shared_ptr<Node>> children) override;
+    void setChildren(NodeRange children) override;
 
-    void evaluate(std::ostream& os, const DataMap& kv) const override;
+    /**
+     * @brief Get the path of the condition
+     * @return Tag path
+     */
+    const TagPath& path() const;
+
+    /**
+     * @brief Get the child nodes, including any elif and else nodes
+     * @return Range of child nodes
+     */
+    NodeRange children() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
 
     NodeType type() const override;
 };
@@ -203,7 +429,8 @@ class ElifValue : public IfValue {
 public:
     ElifValue(std::string name);
 
-    void evaluate(std::ostream& os, const DataMap& kv) const override;
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
 
     virtual NodeType type() const override;
 };
@@ -214,14 +441,22 @@ public:
  */
 class ElseValue : public Node {
 private:
-    std::vector<std::shared_ptr<Node>> _nodes;
+    NodeList _nodes;
 
 public:
     ElseValue() = default;
 
     void setChildren(std::vector<std::shared_ptr<Node>> children) override;
+    void setChildren(NodeRange children) override;
+
+    /**
+     * @brief Get the child nodes
+     * @return Range of child nodes
+     */
+    NodeRange children() const;
 
-    void evaluate(std::ostream& os, const DataMap& kv) const override;
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
 
     NodeType type() const override;
 };
@@ -233,16 +468,243 @@ public:
  */
 class ForValue : public Node {
 private:
-    std::string _name;
+    TagPath _path;
     std::string _alias;
-    std::vector<std::shared_ptr<Node>> _nodes;
+    types::Symbol _aliasSymbol;
+    NodeList _nodes;
 
 public:
     ForValue(std::string name, std::string alias);
 
     void setChildren(std::vector<std::shared_ptr<Node>> children) override;
+    void setChildren(NodeRange children) override;
+
+    /**
+     * @brief Get the path of the list
+     * @return Tag path
+     */
+    const TagPath& path() const;
+
+    /**
+     * @brief Get the name each item is bound to
+     * @return Alias name
+     */
+    const std::string& alias() const;
+
+    /**
+     * @brief Get the interned alias name
+     * @return Symbol of the alias
+     */
+    types::Symbol aliasSymbol() const;
+
+    /**
+     * @brief Get the child nodes
+     * @return Range of child nodes
+     */
+    NodeRange children() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
+
+    NodeType type() const override;
+};
+
+/**
+ * @brief The CacheValue class represents a cache block
+ *
+ * The output of the child nodes is stored in the
+ * RenderOptions::fragmentCache under the block and the value of its key,
+ * and written from the cache while the key stays the same
+ */
+class CacheValue : public Node {
+private:
+    TagPath _path;
+    NodeList _nodes;
+    std::uint64_t _id;
+
+public:
+    /**
+     * @brief Construct a cache block node with the name of its key
+     *
+     * See \link isValidTag \endlink for valid tag names
+     *
+     * @param name Name of the key
+     * @exception Throws templet::exception::InvalidTagError if invalid tag name
+     */
+    CacheValue(std::string name);
+
+    void setChildren(std::vector<std::shared_ptr<Node>> children) override;
+    void setChildren(NodeRange children) override;
+
+    /**
+     * @brief Get the path of the key
+     * @return Tag path
+     */
+    const TagPath& path() const;
 
-    void evaluate(std::ostream& os, const DataMap& kv) const override;
+    /**
+     * @brief Get the child nodes
+     * @return Range of child nodes
+     */
+    NodeRange children() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
+
+    NodeType type() const override;
+};
+
+/**
+ * @brief The IncludeValue class renders another compiled template in place
+ *
+ * The included template is bound after tokenizing, see
+ * \link TemplateRegistry \endlink, and shared by every template that
+ * includes it. It renders with the scope of the include tag
+ */
+class IncludeValue : public Node {
+private:
+    std::string _name;
+    std::shared_ptr<const CompiledTemplate> _target;
+
+public:
+    /**
+     * @brief Construct an include node
+     * @param name Name of the included template
+     * @exception Throws templet::exception::InvalidTagError if invalid template name
+     */
+    IncludeValue(std::string name);
+
+    /**
+     * @brief Get the name of the included template
+     * @return Template name
+     */
+    const std::string& name() const;
+
+    /**
+     * @brief Bind the included template
+     *
+     * Not thread safe, bind before the template is shared
+     *
+     * @param target Compiled template to render
+     */
+    void bind(std::shared_ptr<const CompiledTemplate> target);
+
+    /**
+     * @brief Get the included template
+     * @return Compiled template, or nullptr if not bound
+     */
+    const std::shared_ptr<const CompiledTemplate>& target() const;
+
+    using Node::evaluate;
+    /**
+     * @exception templet::exception::InvalidTagError if the include isn't bound
+     */
+    void evaluate(Sink& out, const Scope& scope) const override;
+
+    NodeType type() const override;
+};
+
+/**
+ * @brief The StaticIfValue class is an if block that only contains text
+ *
+ * Folded from an IfValue by \link optimize \endlink, the text is written
+ * directly without child nodes
+ */
+class StaticIfValue : public Node {
+private:
+    TagPath _path;
+    const char* _in {nullptr};
+    std::size_t _size {0};
+
+public:
+    /**
+     * @brief Construct a static if block
+     * @param path Path of the condition
+     * @param text Text to write if the condition is set, must outlive the node
+     * @param size Size of the text
+     */
+    StaticIfValue(TagPath path, const char* text, std::size_t size);
+
+    /**
+     * @brief Get the path of the condition
+     * @return Tag path
+     */
+    const TagPath& path() const;
+
+    /**
+     * @brief Get the text block
+     * @return First character of the text block
+     */
+    const char* data() const;
+
+    /**
+     * @brief Get the size of the text block
+     * @return Size in bytes
+     */
+    std::size_t size() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
+
+    NodeType type() const override;
+};
+
+/**
+ * @brief The StaticForValue class is a for loop that only contains text
+ *
+ * Folded from a ForValue by \link optimize \endlink, the text is written
+ * once per item without binding the items
+ */
+class StaticForValue : public Node {
+private:
+    TagPath _path;
+    std::string _alias;
+    types::Symbol _aliasSymbol;
+    const char* _in {nullptr};
+    std::size_t _size {0};
+
+public:
+    /**
+     * @brief Construct a static for loop
+     * @param path Path of the list
+     * @param alias Name the items would be bound to
+     * @param text Text to write per item, must outlive the node
+     * @param size Size of the text
+     */
+    StaticForValue(TagPath path, std::string alias, const char* text, std::size_t size);
+
+    /**
+     * @brief Get the path of the list
+     * @return Tag path
+     */
+    const TagPath& path() const;
+
+    /**
+     * @brief Get the name the items would be bound to
+     * @return Alias name
+     */
+    const std::string& alias() const;
+
+    /**
+     * @brief Get the interned alias name
+     * @return Symbol of the alias
+     */
+    types::Symbol aliasSymbol() const;
+
+    /**
+     * @brief Get the text block
+     * @return First character of the text block
+     */
+    const char* data() const;
+
+    /**
+     * @brief Get the size of the text block
+     * @return Size in bytes
+     */
+    std::size_t size() const;
+
+    using Node::evaluate;
+    void evaluate(Sink& out, const Scope& scope) const override;
 
     NodeType type() const override;
 };
@@ -250,7 +712,7 @@ public:
 /**
  * @brief Parse a value tag
  *
- * Ex: {$first_name}
+ * Ex: {$first_name} or {$first_name|html}
  *
  * @param in String to parse
  * @exception templet::exception::InvalidTagError if invalid tag
@@ -258,6 +720,15 @@ public:
  */
 std::shared_ptr<Node> parse_value_tag(std::string in);
 
+/**
+ * @brief \sa parse_value_tag
+ * @param in String to parse
+ * @param arena Arena that owns the returned node
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+Node* parse_value_tag(std::string in, NodeArena& arena);
+
 /**
  * @brief Parse an if value tag
  *
@@ -269,6 +740,15 @@ std::shared_ptr<Node> parse_value_tag(std::string in);
  */
 std::shared_ptr<Node> parse_ifvalue_tag(std::string in);
 
+/**
+ * @brief \sa parse_ifvalue_tag
+ * @param in String to parse
+ * @param arena Arena that owns the returned node
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+Node* parse_ifvalue_tag(std::string in, NodeArena& arena);
+
 
 /**
  * @brief Parse an elif value tag
@@ -281,6 +761,15 @@ std::shared_ptr<Node> parse_ifvalue_tag(std::string in);
  */
 std::shared_ptr<Node> parse_elifvalue_tag(std::string in);
 
+/**
+ * @brief \sa parse_elifvalue_tag
+ * @param in String to parse
+ * @param arena Arena that owns the returned node
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+Node* parse_elifvalue_tag(std::string in, NodeArena& arena);
+
 /**
  * @brief Parse a for value tag
  *
@@ -292,6 +781,62 @@ std::shared_ptr<Node> parse_elifvalue_tag(std::string in);
  */
 std::shared_ptr<Node> parse_forvalue_tag(std::string in);
 
+/**
+ * @brief \sa parse_forvalue_tag
+ * @param in String to parse
+ * @param arena Arena that owns the returned node
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+Node* parse_forvalue_tag(std::string in, NodeArena& arena);
+
+/**
+ * @brief Parse a cache tag
+ *
+ * Ex: {% cache nav_key %}...{% endcache %}
+ *
+ * @param in String to parse
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+std::shared_ptr<Node> parse_cache_tag(std::string in);
+
+/**
+ * @brief \sa parse_cache_tag
+ * @param in String to parse
+ * @param arena Arena that owns the returned node
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+Node* parse_cache_tag(std::string in, NodeArena& arena);
+
+/**
+ * @brief Parse an include tag
+ *
+ * Ex: {% include header.tpl %}
+ *
+ * @param in String to parse
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+std::shared_ptr<Node> parse_include_tag(std::string in);
+
+/**
+ * @brief \sa parse_include_tag
+ * @param in String to parse
+ * @param arena Arena that owns the returned node
+ * @exception templet::exception::InvalidTagError if invalid tag
+ * @return Parsed tag
+ */
+Node* parse_include_tag(std::string in, NodeArena& arena);
+
+/**
+ * @brief Find the include nodes of a tree
+ * @param nodes Nodes to search, including their children
+ * @return Include nodes in template order
+ */
+std::vector<IncludeValue*> find_includes(NodeRange nodes);
+
 } // namespace nodes
 } // namespace templet
 
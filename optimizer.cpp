@@ -0,0 +1,233 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "optimizer.hpp"
+
+using namespace templet::nodes;
+
+namespace {
+
+/**
+ * @brief Count the nodes of a tree
+ * @param nodes Nodes to count, including their children
+ * @return Number of nodes
+ */
+std::size_t count_nodes(NodeRange nodes) {
+    std::size_t count = nodes.size();
+    for(auto node : nodes) {
+        switch(node->type()) {
+        case NodeType::IfValue:
+        case NodeType::ElifValue:
+            count += count_nodes(static_cast<const IfValue*>(node)->children());
+            break;
+        case NodeType::ElseValue:
+            count += count_nodes(static_cast<const ElseValue*>(node)->children());
+            break;
+        case NodeType::ForValue:
+            count += count_nodes(static_cast<const ForValue*>(node)->children());
+            break;
+        case NodeType::CacheValue:
+            count += count_nodes(static_cast<const CacheValue*>(node)->children());
+            break;
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Copy a list of nodes into an arena
+ * @param nodes Nodes to copy
+ * @param arena Arena that owns the array
+ * @return Range of nodes
+ */
+NodeRange to_range(const std::vector<Node*>& nodes, NodeArena& arena) {
+    auto array = arena.allocateArray<Node*>(nodes.size());
+    std::copy(nodes.begin(), nodes.end(), array);
+    return NodeRange(array, nodes.size());
+}
+
+/**
+ * @brief Does the optimization for \link optimize \endlink
+ */
+class Optimizer {
+private:
+    NodeArena& _arena;
+    OptimizeStats& _stats;
+
+    /**
+     * @brief Replace a run of text nodes with a single text node
+     * @param run Non-empty text nodes
+     * @return Merged text node
+     */
+    Node* mergeTexts(const std::vector<Text*>& run) {
+        if(run.size() == 1) {
+            return run.front();
+        }
+
+        _stats.mergedTexts += run.size() - 1;
+        std::size_t size = 0;
+        bool contiguous = true;
+        for(std::size_t i = 0; i < run.size(); ++i) {
+            size += run[i]->size();
+            if(i > 0 && run[i - 1]->data() + run[i - 1]->size() != run[i]->data()) {
+                contiguous = false;
+            }
+        }
+        if(contiguous) {
+            return _arena.create<Text>(run.front()->data(), size);
+        }
+
+        auto text = _arena.allocateArray<char>(size);
+        auto pos = text;
+        for(auto node : run) {
+            std::memcpy(pos, node->data(), node->size());
+            pos += node->size();
+        }
+        return _arena.create<Text>(text, size);
+    }
+
+    /**
+     * @brief Fold a block whose children are all text
+     * @param node If or for node
+     * @param children Optimized children of the node
+     * @return Static node, or nullptr if the block can't be folded
+     */
+    Node* fold(Node* node, const std::vector<Node*>& children) {
+        if(children.size() > 1 || (children.size() == 1 && children[0]->type() != NodeType::Text)) {
+            return nullptr;
+        }
+
+        const char* text = "";
+        std::size_t size = 0;
+        if(!children.empty()) {
+            const auto child = static_cast<const Text*>(children[0]);
+            text = child->data();
+            size = child->size();
+        }
+
+        ++_stats.foldedBlocks;
+        if(node->type() == NodeType::IfValue) {
+            const auto block = static_cast<const IfValue*>(node);
+            return _arena.create<StaticIfValue>(block->path(), text, size);
+        }
+        const auto block = static_cast<const ForValue*>(node);
+        return _arena.create<StaticForValue>(block->path(), block->alias(), text, size);
+    }
+
+    /**
+     * @brief Optimize the children of a block node
+     * @param node Block node
+     * @param children Current children of the node
+     * @return Node to use in place of the block
+     */
+    Node* optimizeBlock(Node* node, NodeRange children) {
+        const auto optimized = optimizeList(children);
+        if(node->type() == NodeType::IfValue || node->type() == NodeType::ForValue) {
+            if(const auto folded = fold(node, optimized)) {
+                return folded;
+            }
+        }
+
+        node->setChildren(to_range(optimized, _arena));
+        return node;
+    }
+
+public:
+    Optimizer(NodeArena& arena, OptimizeStats& stats) : _arena(arena), _stats(stats) {}
+
+    /**
+     * @brief Optimize a list of sibling nodes
+     * @param nodes Nodes to optimize
+     * @return Optimized nodes
+     */
+    std::vector<Node*> optimizeList(NodeRange nodes) {
+        std::vector<Node*> result;
+        std::vector<Text*> run;
+        const auto flush = [&]() {
+            if(!run.empty()) {
+                result.push_back(mergeTexts(run));
+                run.clear();
+            }
+        };
+
+        for(auto node : nodes) {
+            switch(node->type()) {
+            case NodeType::Text: {
+                const auto text = static_cast<Text*>(node);
+                if(text->size() == 0) {
+                    ++_stats.droppedTexts;
+                }
+                else {
+                    run.push_back(text);
+                }
+                continue;
+            }
+            case NodeType::IfValue:
+            case NodeType::ElifValue:
+                flush();
+                result.push_back(optimizeBlock(node, static_cast<const IfValue*>(node)->children()));
+                break;
+            case NodeType::ElseValue:
+                flush();
+                result.push_back(optimizeBlock(node, static_cast<const ElseValue*>(node)->children()));
+                break;
+            case NodeType::ForValue:
+                flush();
+                result.push_back(optimizeBlock(node, static_cast<const ForValue*>(node)->children()));
+                break;
+            case NodeType::CacheValue:
+                flush();
+                result.push_back(optimizeBlock(node, static_cast<const CacheValue*>(node)->children()));
+                break;
+            default:
+                flush();
+                result.push_back(node);
+                break;
+            }
+        }
+        flush();
+
+        return result;
+    }
+};
+
+} // unnamed namespace
+
+NodeRange templet::nodes::optimize(NodeRange nodes, NodeArena& arena, OptimizeStats& stats) {
+    stats = OptimizeStats();
+    stats.nodesBefore = count_nodes(nodes);
+
+    Optimizer optimizer(arena, stats);
+    const auto result = to_range(optimizer.optimizeList(nodes), arena);
+
+    stats.nodesAfter = count_nodes(result);
+    return result;
+}
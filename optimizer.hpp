@@ -0,0 +1,69 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <cstddef>
+#include "arena.hpp"
+#include "nodes.hpp"
+
+namespace templet {
+namespace nodes {
+
+/**
+ * @brief The OptimizeStats struct reports what the optimizer did
+ */
+struct OptimizeStats {
+    std::size_t nodesBefore {0};    ///< Nodes in the tree before optimizing
+    std::size_t nodesAfter {0};     ///< Nodes in the tree after optimizing
+    std::size_t mergedTexts {0};    ///< Text nodes merged into a neighbour
+    std::size_t droppedTexts {0};   ///< Empty text nodes removed
+    std::size_t foldedBlocks {0};   ///< If and for blocks folded into static nodes
+};
+
+/**
+ * @brief Optimize a node tree tokenized into an arena
+ *
+ * Empty text nodes are removed and adjacent text nodes are merged into
+ * one span. Spans that are not next to each other in the source are
+ * copied into the arena. If and for blocks with only text inside are
+ * folded into StaticIfValue and StaticForValue nodes.
+ *
+ * The output is the same as with the original tree. Replaced nodes stay
+ * in the arena until it's destroyed.
+ *
+ * @param nodes Top level nodes
+ * @param arena Arena that owns the nodes
+ * @param stats Receives the node counts
+ * @return Range of the optimized top level nodes, owned by the arena
+ */
+NodeRange optimize(NodeRange nodes, NodeArena& arena, OptimizeStats& stats);
+
+} // namespace nodes
+} // namespace templet
+
+#endif // OPTIMIZER_HPP
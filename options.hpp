@@ -0,0 +1,92 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstddef>
+
+namespace templet {
+
+class FragmentCache;
+class Instrumentation;
+class WorkerPool;
+
+/**
+ * @brief The RenderOptions struct configures how templates are evaluated
+ */
+struct RenderOptions {
+    /**
+     * @brief Throw templet::exception::MissingTagError for missing value tags
+     *
+     * By default a missing value tag is removed from the output
+     */
+    bool strictMissingTags {false};
+
+    /**
+     * @brief Render compiled templates by evaluating the node tree
+     *
+     * By default compiled templates run their flattened program, which
+     * renders the same output with fewer virtual calls
+     */
+    bool useNodeTree {false};
+
+    /**
+     * @brief Pool for rendering large loops in parallel, not owned
+     *
+     * Used together with parallelLoopItems, the number of threads is
+     * the size of the pool
+     */
+    WorkerPool* pool {nullptr};
+
+    /**
+     * @brief Render loops over at least this many items in parallel
+     *
+     * The items are split into chunks that are rendered into separate
+     * buffers on the pool and written out in order. Only lists are split,
+     * streamed lists and the node tree always render one item at a time.
+     * Zero disables parallel loops.
+     */
+    std::size_t parallelLoopItems {0};
+
+    /**
+     * @brief Hooks for render events, not owned
+     *
+     * Null disables instrumentation, see \link TEMPLET_INSTRUMENT \endlink
+     */
+    Instrumentation* instrumentation {nullptr};
+
+    /**
+     * @brief Cache for the output of cache blocks, not owned
+     *
+     * Null renders cache blocks every time
+     */
+    FragmentCache* fragmentCache {nullptr};
+};
+
+} // namespace templet
+
+#endif // OPTIONS_HPP
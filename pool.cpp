@@ -0,0 +1,203 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include "pool.hpp"
+
+using namespace templet;
+
+namespace {
+
+// Set while the current thread works on a run, nested runs go inline
+thread_local bool insideRun = false;
+
+/**
+ * @brief Marks the current thread as working on a run
+ */
+class RunGuard {
+private:
+    bool _previous;
+
+public:
+    RunGuard() : _previous(insideRun) { insideRun = true; }
+    ~RunGuard() { insideRun = _previous; }
+};
+
+} // unnamed namespace
+
+/**
+ * @brief Tasks of a single run
+ */
+struct WorkerPool::Job {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    const std::function<void(std::size_t)>* task;
+    std::size_t size;
+    std::unique_ptr<Queue[]> queues;
+    std::atomic<bool> failed {false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    Job(const std::function<void(std::size_t)>& fn, std::size_t count, std::size_t participants)
+        : task(&fn), size(participants), queues(new Queue[participants]) {
+        for(std::size_t i = 0; i < count; ++i) {
+            queues[i % participants].tasks.push_back(i);
+        }
+    }
+
+    /**
+     * @brief Take a task from the front of a participant's own queue
+     */
+    bool pop(std::size_t index, std::size_t& result) {
+        auto& queue = queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty()) {
+            return false;
+        }
+        result = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    /**
+     * @brief Take a task from the back of another participant's queue
+     */
+    bool steal(std::size_t index, std::size_t& result) {
+        for(std::size_t i = 1; i < size; ++i) {
+            auto& queue = queues[(index + i) % size];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(!queue.tasks.empty()) {
+                result = queue.tasks.back();
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+WorkerPool::WorkerPool(std::size_t threads)
+    : _size(threads != 0 ? threads : std::max<std::size_t>(1, std::thread::hardware_concurrency())) {
+    for(std::size_t i = 1; i < _size; ++i) {
+        _threads.emplace_back(&WorkerPool::work, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for(auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+std::size_t WorkerPool::size() const {
+    return _size;
+}
+
+void WorkerPool::participate(Job& job, std::size_t index) {
+    RunGuard guard;
+    std::size_t task = 0;
+    while(job.pop(index, task) || job.steal(index, task)) {
+        if(job.failed) {
+            continue;
+        }
+        try {
+            (*job.task)(task);
+        }
+        catch(...) {
+            std::lock_guard<std::mutex> lock(job.errorMutex);
+            if(!job.error) {
+                job.error = std::current_exception();
+            }
+            job.failed = true;
+        }
+    }
+}
+
+void WorkerPool::work(std::size_t index) {
+    std::size_t seen = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(true) {
+        _wake.wait(lock, [&]() { return _stop || _generation != seen; });
+        if(_stop) {
+            return;
+        }
+        seen = _generation;
+        if(_job == nullptr) {
+            continue;
+        }
+
+        auto& job = *_job;
+        ++_active;
+        lock.unlock();
+        participate(job, index);
+        lock.lock();
+        --_active;
+        _idle.notify_all();
+    }
+}
+
+void WorkerPool::run(std::size_t count, const std::function<void(std::size_t)>& task) {
+    if(insideRun || _size == 1 || count < 2) {
+        for(std::size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> runLock(_runMutex);
+    Job job(task, count, _size);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &job;
+        ++_generation;
+    }
+    _wake.notify_all();
+
+    participate(job, 0);
+
+    // Threads that didn't join yet must not join anymore, the ones
+    // that did are finishing their last task
+    std::unique_lock<std::mutex> lock(_mutex);
+    _job = nullptr;
+    _idle.wait(lock, [this]() { return _active == 0; });
+    lock.unlock();
+
+    if(job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
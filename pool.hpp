@@ -0,0 +1,105 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace templet {
+
+/**
+ * @brief The WorkerPool class runs numbered tasks on a set of threads
+ *
+ * The threads are started once and wait for work between runs. Each
+ * run hands out its tasks round robin to one queue per thread. A thread
+ * that empties its own queue steals from the back of the others, so the
+ * threads stay busy even if some tasks take longer than others.
+ *
+ * The thread calling run() works on the tasks too. Calling run() from
+ * inside a task runs the nested tasks on the current thread.
+ */
+class WorkerPool {
+private:
+    struct Job;
+
+    std::size_t _size;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    Job* _job {nullptr};
+    std::size_t _generation {0};
+    std::size_t _active {0};
+    bool _stop {false};
+    std::mutex _runMutex;
+
+    void work(std::size_t index);
+    static void participate(Job& job, std::size_t index);
+
+public:
+    /**
+     * @brief Start a pool
+     * @param threads Number of threads working on a run, including the
+     * caller. Zero uses one per hardware thread.
+     */
+    explicit WorkerPool(std::size_t threads = 0);
+
+    /**
+     * @brief Stop the threads, waiting for them to finish
+     */
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Get the number of threads working on a run
+     * @return Number of threads, including the caller
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Run tasks and wait for them to finish
+     *
+     * Runs from several threads at once take turns. If a task throws,
+     * the tasks not yet started are skipped and the first exception is
+     * rethrown once the running tasks have finished.
+     *
+     * @param count Number of tasks
+     * @param task Called once with each task number from 0 to count - 1
+     */
+    void run(std::size_t count, const std::function<void(std::size_t)>& task);
+};
+
+} // namespace templet
+
+#endif // POOL_HPP
@@ -0,0 +1,467 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include "instrument.hpp"
+#include "pool.hpp"
+#include "program.hpp"
+
+using namespace templet;
+using namespace templet::nodes;
+
+namespace {
+
+/**
+ * @brief Checks whether a node is an elif or else block
+ * @param node Node to check
+ * @return True if elif or else, otherwise false
+ */
+bool isAlternative(const Node* node) {
+    return node->type() == NodeType::ElifValue || node->type() == NodeType::ElseValue;
+}
+
+/**
+ * @brief Checks whether an elif or else block may follow a parent
+ * @param parent Parent node, may be null
+ * @return True if the parent is an if or elif block, otherwise false
+ */
+bool isValidAlternativeParent(const Node* parent) {
+    return parent != nullptr &&
+            (parent->type() == NodeType::IfValue || parent->type() == NodeType::ElifValue);
+}
+
+/**
+ * @brief Resolve the list of a loop instruction
+ * @param instruction LoopBegin or RepeatText instruction
+ * @param scope Values to reference
+ * @exception templet::exception::MissingTagError if the list is not found
+ * @exception templet::exception::InvalidTagError if the path is not a list or the alias is taken
+ * @return List or stream
+ */
+const templet::types::Data& loop_list(const Instruction& instruction, const Scope& scope) {
+    const auto res = instruction.path->resolve(scope);
+    if(!res) {
+        throw templet::exception::MissingTagError("Tag name not found: " + instruction.path->str());
+    }
+    else if(res->type() != templet::types::DataType::List &&
+            res->type() != templet::types::DataType::Stream) {
+        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a list");
+    }
+    else if(scope.contains(*instruction.alias, instruction.aliasSymbol)) {
+        throw templet::exception::InvalidTagError("For expression alias name collides with an existing name");
+    }
+
+    return *res;
+}
+
+} // unnamed namespace
+
+Program::Program(NodeRange nodes) {
+    compileNodes(nodes, nullptr, 0);
+}
+
+std::size_t Program::emit(Instruction instruction) {
+    if(instruction.op == Opcode::EmitText || instruction.op == Opcode::RepeatText) {
+        _staticSize += instruction.size;
+    }
+    _code.push_back(instruction);
+    return _code.size() - 1;
+}
+
+void Program::compileNodes(NodeRange nodes, const Node* parent, std::size_t depth) {
+    for(auto node : nodes) {
+        compileNode(node, parent, depth);
+    }
+}
+
+void Program::compileNode(const Node* node, const Node* parent, std::size_t depth) {
+    Instruction instruction;
+    switch(node->type()) {
+    case NodeType::Text:
+        if(const auto text = dynamic_cast<const Text*>(node)) {
+            instruction.op = Opcode::EmitText;
+            instruction.text = text->data();
+            instruction.size = text->size();
+            emit(instruction);
+            return;
+        }
+        break;
+    case NodeType::Value:
+        if(const auto value = dynamic_cast<const Value*>(node)) {
+            instruction.op = Opcode::EmitValue;
+            instruction.path = &value->path();
+            instruction.filter = value->filter();
+            emit(instruction);
+            return;
+        }
+        break;
+    case NodeType::IfValue:
+        if(const auto condition = dynamic_cast<const IfValue*>(node)) {
+            compileCondition(condition, depth);
+            return;
+        }
+        break;
+    case NodeType::ElifValue:
+        if(const auto condition = dynamic_cast<const ElifValue*>(node)) {
+            if(!isValidAlternativeParent(parent)) {
+                instruction.op = Opcode::Fail;
+                instruction.text = "ELIF statements cannot be declared without a preceding IF statement";
+                emit(instruction);
+                return;
+            }
+            compileCondition(condition, depth);
+            return;
+        }
+        break;
+    case NodeType::ElseValue:
+        if(const auto alternative = dynamic_cast<const ElseValue*>(node)) {
+            if(!isValidAlternativeParent(parent)) {
+                instruction.op = Opcode::Fail;
+                instruction.text = "ELSE statements cannot be declared without a preceding IF or ELIF statement";
+                emit(instruction);
+                return;
+            }
+            compileNodes(alternative->children(), alternative, depth);
+            return;
+        }
+        break;
+    case NodeType::ForValue:
+        if(const auto loop = dynamic_cast<const ForValue*>(node)) {
+            instruction.op = Opcode::LoopBegin;
+            instruction.path = &loop->path();
+            instruction.alias = &loop->alias();
+            instruction.aliasSymbol = loop->aliasSymbol();
+            const auto begin = emit(instruction);
+            if(depth + 1 > _maxLoopDepth) {
+                _maxLoopDepth = depth + 1;
+            }
+            compileNodes(loop->children(), loop, depth + 1);
+
+            Instruction end;
+            end.op = Opcode::LoopEnd;
+            end.target = begin + 1;
+            emit(end);
+            _code[begin].target = _code.size();
+            return;
+        }
+        break;
+    case NodeType::StaticIfValue:
+        if(const auto condition = dynamic_cast<const StaticIfValue*>(node)) {
+            instruction.op = Opcode::JumpIfMissing;
+            instruction.path = &condition->path();
+            const auto branch = emit(instruction);
+
+            Instruction text;
+            text.op = Opcode::EmitText;
+            text.text = condition->data();
+            text.size = condition->size();
+            emit(text);
+            _code[branch].target = _code.size();
+            return;
+        }
+        break;
+    case NodeType::StaticForValue:
+        if(const auto loop = dynamic_cast<const StaticForValue*>(node)) {
+            instruction.op = Opcode::RepeatText;
+            instruction.path = &loop->path();
+            instruction.alias = &loop->alias();
+            instruction.aliasSymbol = loop->aliasSymbol();
+            instruction.text = loop->data();
+            instruction.size = loop->size();
+            emit(instruction);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // Unknown node types are evaluated with the node tree
+    instruction.op = Opcode::EvalNode;
+    instruction.node = node;
+    emit(instruction);
+}
+
+void Program::compileCondition(const IfValue* node, std::size_t depth) {
+    Instruction check;
+    check.op = Opcode::JumpIfMissing;
+    check.path = &node->path();
+    const auto branch = emit(check);
+
+    // The children up to the first elif or else are rendered when the
+    // condition is set, all elif and else children when it is not
+    const auto children = node->children();
+    bool hasAlternatives = false;
+    for(auto child : children) {
+        if(isAlternative(child)) {
+            hasAlternatives = true;
+            break;
+        }
+        compileNode(child, node, depth);
+    }
+
+    if(!hasAlternatives) {
+        _code[branch].target = _code.size();
+        return;
+    }
+
+    Instruction skip;
+    skip.op = Opcode::Jump;
+    const auto done = emit(skip);
+    _code[branch].target = _code.size();
+    for(auto child : children) {
+        if(isAlternative(child)) {
+            compileNode(child, node, depth);
+        }
+    }
+    _code[done].target = _code.size();
+}
+
+ProgramState::ProgramState(const Program& program, const Scope& scope)
+    : _root(&scope), _scope(&scope), _pc(0), _loops() {
+    // Child scopes link to their parent, so the frames must never move
+    _loops.reserve(program.maxLoopDepth());
+}
+
+void ProgramState::serial() {
+    _parallel = false;
+}
+
+bool ProgramState::finished(const Program& program) const {
+    return _pc >= program.instructions().size();
+}
+
+template <class Pause>
+bool Program::execute(ProgramState& state, Sink& out, Pause pause, std::size_t end) const {
+    auto& loops = state._loops;
+    const Scope* const root = state._root;
+    const Scope* scope = state._scope;
+
+    const Instruction* const code = _code.data();
+    std::size_t pc = state._pc;
+    while(pc < end) {
+        if(pause()) {
+            state._pc = pc;
+            state._scope = scope;
+            return false;
+        }
+
+        const auto& instruction = code[pc];
+        switch(instruction.op) {
+        case Opcode::EmitText:
+            out.writeStatic(instruction.text, instruction.size);
+            ++pc;
+            break;
+        case Opcode::EmitValue: {
+            const auto res = instruction.path->resolve(*scope);
+            if(!res) {
+                TEMPLET_INSTRUMENT(scope->options(), missingTag(scope->compiled(), *instruction.path));
+                if(scope->options().strictMissingTags) {
+                    throw templet::exception::MissingTagError("Tag name not found: " + instruction.path->str());
+                }
+            }
+            else if(res->type() != templet::types::DataType::String) {
+                throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a string");
+            }
+            else {
+                char buffer[templet::types::textBufferSize];
+                std::size_t size = 0;
+                const auto value = res->text(buffer, size);
+                write_filtered(out, value, size, instruction.filter);
+            }
+            ++pc;
+            break;
+        }
+        case Opcode::JumpIfMissing:
+            pc = instruction.path->resolve(*scope) ? pc + 1 : instruction.target;
+            break;
+        case Opcode::Jump:
+            pc = instruction.target;
+            break;
+        case Opcode::LoopBegin: {
+            const auto& list = loop_list(instruction, *scope);
+            const auto hook = scope->options().instrumentation;
+            ProgramState::LoopFrame frame {nullptr, 0, 0, Scope(*scope, *instruction.alias), nullptr, nullptr,
+                                           hook_clock(hook)};
+            const templet::types::Data* first = nullptr;
+            if(list.type() == templet::types::DataType::Stream) {
+                frame.next = list.stream();
+                frame.current = frame.next();
+                if(!frame.current) {
+                    TEMPLET_INSTRUMENT(scope->options(), loopFinished(scope->compiled(), *instruction.path, 0,
+                                                                      hook_clock(hook) - frame.started));
+                    pc = instruction.target;
+                    break;
+                }
+                first = frame.current.get();
+            }
+            else {
+                frame.list = &list;
+                frame.size = list.listSize();
+                if(frame.size == 0) {
+                    TEMPLET_INSTRUMENT(scope->options(), loopFinished(scope->compiled(), *instruction.path, 0,
+                                                                      hook_clock(hook) - frame.started));
+                    pc = instruction.target;
+                    break;
+                }
+                const auto& options = scope->options();
+                if(state._parallel && options.pool != nullptr && options.parallelLoopItems != 0 &&
+                        frame.size >= options.parallelLoopItems) {
+                    // The body ends before the LoopEnd instruction
+                    renderParallel(pc + 1, instruction.target - 1, *instruction.alias, list, *scope, out);
+                    TEMPLET_INSTRUMENT(options, loopFinished(scope->compiled(), *instruction.path, frame.size,
+                                                             hook_clock(hook) - frame.started));
+                    pc = instruction.target;
+                    break;
+                }
+                first = list.listItem(0);
+            }
+            loops.push_back(std::move(frame));
+            loops.back().scope.bind(first);
+            scope = &loops.back().scope;
+            ++pc;
+            break;
+        }
+        case Opcode::LoopEnd: {
+            auto& frame = loops.back();
+            if(frame.list == nullptr) {
+                // Streams count their items in the index
+                ++frame.index;
+                frame.current.reset();
+                frame.current = frame.next();
+                if(frame.current) {
+                    frame.scope.bind(frame.current.get());
+                    pc = instruction.target;
+                    break;
+                }
+            }
+            else if(++frame.index < frame.size) {
+                frame.scope.bind(frame.list->listItem(frame.index));
+                pc = instruction.target;
+                break;
+            }
+            // The body starts right after the LoopBegin instruction
+            TEMPLET_INSTRUMENT(root->options(),
+                               loopFinished(root->compiled(), *code[instruction.target - 1].path, frame.index,
+                                            hook_clock(root->options().instrumentation) - frame.started));
+            loops.pop_back();
+            scope = loops.empty() ? root : &loops.back().scope;
+            ++pc;
+            break;
+        }
+        case Opcode::RepeatText: {
+            const auto& list = loop_list(instruction, *scope);
+            const HookTimer timer(scope->options().instrumentation);
+            std::size_t items = 0;
+            if(list.type() == templet::types::DataType::Stream) {
+                const auto next = list.stream();
+                while(next()) {
+                    out.writeStatic(instruction.text, instruction.size);
+                    ++items;
+                }
+            }
+            else {
+                items = list.listSize();
+                for(std::size_t i = 0; instruction.size > 0 && i < items; ++i) {
+                    out.writeStatic(instruction.text, instruction.size);
+                }
+            }
+            TEMPLET_INSTRUMENT(scope->options(),
+                               loopFinished(scope->compiled(), *instruction.path, items, timer.elapsed()));
+            ++pc;
+            break;
+        }
+        case Opcode::EvalNode:
+            instruction.node->evaluate(out, *scope);
+            ++pc;
+            break;
+        case Opcode::Fail:
+            throw templet::exception::InvalidTagError(instruction.text);
+        }
+    }
+
+    state._pc = pc;
+    state._scope = scope;
+    return true;
+}
+
+void Program::renderParallel(std::size_t begin, std::size_t end, const std::string& alias,
+                             const types::Data& list, const Scope& scope, Sink& out) const {
+    auto& pool = *scope.options().pool;
+    // Chunks are rendered in rounds to bound the buffered output
+    const auto size = list.listSize();
+    const std::size_t chunkItems = std::min<std::size_t>(1024, std::max<std::size_t>(1, size / (pool.size() * 16)));
+    const std::size_t roundChunks = pool.size() * 4;
+    std::vector<std::string> buffers(roundChunks);
+
+    for(std::size_t first = 0; first < size; first += chunkItems * roundChunks) {
+        const auto chunks = std::min(roundChunks, (size - first + chunkItems - 1) / chunkItems);
+        pool.run(chunks, [&](std::size_t chunk) {
+            auto& buffer = buffers[chunk];
+            buffer.clear();
+            StringSink sink(buffer);
+
+            // Each chunk binds the items in its own scope and state
+            Scope itemScope(scope, alias);
+            ProgramState state(*this, itemScope);
+            state._parallel = false;
+            const auto from = first + chunk * chunkItems;
+            const auto to = std::min(size, from + chunkItems);
+            for(auto i = from; i < to; ++i) {
+                itemScope.bind(list.listItem(i));
+                state._pc = begin;
+                execute(state, sink, []() { return false; }, end);
+            }
+        });
+
+        for(std::size_t chunk = 0; chunk < chunks; ++chunk) {
+            out.write(buffers[chunk].data(), buffers[chunk].size());
+        }
+    }
+}
+
+void Program::run(Sink& out, const Scope& scope) const {
+    ProgramState state(*this, scope);
+    execute(state, out, []() { return false; }, _code.size());
+}
+
+bool Program::resume(ProgramState& state, Sink& out, const std::function<bool()>& pause) const {
+    return execute(state, out, std::cref(pause), _code.size());
+}
+
+const std::vector<Instruction>& Program::instructions() const {
+    return _code;
+}
+
+std::size_t Program::maxLoopDepth() const {
+    return _maxLoopDepth;
+}
+
+std::size_t Program::staticSize() const {
+    return _staticSize;
+}
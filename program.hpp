@@ -0,0 +1,224 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "filters.hpp"
+#include "nodes.hpp"
+#include "scope.hpp"
+#include "sink.hpp"
+
+namespace templet {
+
+/**
+ * @brief The Opcode enum describes what an instruction does
+ */
+enum class Opcode {
+    EmitText,       ///< Write text to the sink
+    EmitValue,      ///< Write the value of a path to the sink
+    JumpIfMissing,  ///< Jump to the target if a path is not found
+    Jump,           ///< Jump to the target
+    LoopBegin,      ///< Bind the first item of a list, jump to the target if the list is empty
+    LoopEnd,        ///< Bind the next item and jump to the target, or leave the loop
+    RepeatText,     ///< Write text once per item of a list
+    EvalNode,       ///< Evaluate a node that has no instructions, e.g. a user defined node
+    Fail            ///< Throw templet::exception::InvalidTagError
+};
+
+/**
+ * @brief The Instruction struct is a single step of a program
+ *
+ * Only the fields used by the opcode are set
+ */
+struct Instruction {
+    Opcode op {Opcode::Jump};
+    std::size_t target {0};                 ///< Jump target
+    const char* text {nullptr};             ///< Text to write, or the error message
+    std::size_t size {0};                   ///< Size of the text
+    const nodes::TagPath* path {nullptr};   ///< Path to resolve
+    const std::string* alias {nullptr};     ///< Name bound by a loop
+    types::Symbol aliasSymbol {types::invalidSymbol}; ///< Interned alias
+    const nodes::Node* node {nullptr};      ///< Node to evaluate
+    Filter filter {Filter::None};           ///< Filter for written values
+};
+
+class Program;
+
+/**
+ * @brief The ProgramState class holds the position of a paused program
+ *
+ * The state references the scope it was created with, which must
+ * outlive it. It can't be copied because the loop scopes link to each
+ * other.
+ */
+class ProgramState {
+private:
+    friend class Program;
+
+    /**
+     * @brief State of a for loop while the program runs
+     */
+    struct LoopFrame {
+        // Null for streamed lists
+        const types::Data* list;
+        std::size_t size;
+        std::size_t index;
+        Scope scope;
+        // Streamed lists keep only the current item alive
+        types::DataGenerator next;
+        DataPtr current;
+        // Clock reading for instrumentation, zero without it
+        std::uint64_t started;
+    };
+
+    const Scope* _root;
+    const Scope* _scope;
+    std::size_t _pc;
+    std::vector<LoopFrame> _loops;
+    // Loops inside a parallel loop are not split again
+    bool _parallel {true};
+
+public:
+    /**
+     * @brief Construct a state at the start of a program
+     * @param program Program to run
+     * @param scope Values to reference
+     */
+    ProgramState(const Program& program, const Scope& scope);
+
+    ProgramState(const ProgramState&) = delete;
+    ProgramState& operator=(const ProgramState&) = delete;
+
+    /**
+     * @brief Check if the program has run to the end
+     * @param program Program the state was created for
+     * @return True if finished, otherwise false
+     */
+    bool finished(const Program& program) const;
+
+    /**
+     * @brief Render loops one item at a time
+     *
+     * A parallel loop renders all of its items before the program can
+     * pause, so a state that is resumed in small steps turns it off.
+     */
+    void serial();
+};
+
+/**
+ * @brief The Program class is a node tree flattened into instructions
+ *
+ * Rendering a program is a single loop over a contiguous array instead
+ * of a virtual call per node. Branch targets and the placement of elif
+ * and else blocks are resolved when the program is compiled. A misplaced
+ * elif or else compiles into a Fail instruction, so the error is thrown
+ * when it is reached, same as with the node tree.
+ *
+ * The program references the text, paths and nodes of the tree it was
+ * compiled from, the tree must outlive it.
+ */
+class Program {
+private:
+    std::vector<Instruction> _code;
+    std::size_t _maxLoopDepth {0};
+    std::size_t _staticSize {0};
+
+    void compileNodes(nodes::NodeRange nodes, const nodes::Node* parent, std::size_t depth);
+    void compileNode(const nodes::Node* node, const nodes::Node* parent, std::size_t depth);
+    void compileCondition(const nodes::IfValue* node, std::size_t depth);
+    std::size_t emit(Instruction instruction);
+
+    template <class Pause>
+    bool execute(ProgramState& state, Sink& out, Pause pause, std::size_t end) const;
+
+    void renderParallel(std::size_t begin, std::size_t end, const std::string& alias,
+                        const types::Data& list, const Scope& scope, Sink& out) const;
+
+public:
+    Program() = default;
+
+    /**
+     * @brief Compile a node tree into a program
+     * @param nodes Top level nodes
+     */
+    explicit Program(nodes::NodeRange nodes);
+
+    /**
+     * @brief Run the program
+     * @param out Sink to write to
+     * @param scope Values to reference
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    void run(Sink& out, const Scope& scope) const;
+
+    /**
+     * @brief Run the program from a saved state until it ends or pauses
+     *
+     * The pause callback is checked before each instruction. An
+     * instruction is never split, so the sink may receive more output
+     * after it asked to pause.
+     *
+     * @param state Position to continue from, updated when pausing
+     * @param out Sink to write to
+     * @param pause Returns true to pause
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     * @return True if the program ran to the end, false if it paused
+     */
+    bool resume(ProgramState& state, Sink& out, const std::function<bool()>& pause) const;
+
+    /**
+     * @brief Get the instructions
+     * @return Vector of instructions
+     */
+    const std::vector<Instruction>& instructions() const;
+
+    /**
+     * @brief Get the deepest nesting of loops
+     * @return Number of nested loops
+     */
+    std::size_t maxLoopDepth() const;
+
+    /**
+     * @brief Get the number of text bytes in the program
+     *
+     * Each text is counted once, whether it's inside a condition or a loop
+     *
+     * @return Number of bytes
+     */
+    std::size_t staticSize() const;
+};
+
+} // namespace templet
+
+#endif // PROGRAM_HPP
@@ -0,0 +1,365 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef REGISTRY_HPP
+#define REGISTRY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "compiled.hpp"
+#include "source.hpp"
+#include "templet.hpp"
+
+namespace templet {
+namespace helpers {
+
+/**
+ * @brief Checks if a file reader can report modification times
+ *
+ * Readers with a static lastModified(path) function are checked by time,
+ * other readers are checked by a hash of the file contents
+ */
+template <class FileReaderT>
+class has_last_modified {
+private:
+    template <class U>
+    static auto test(int) -> decltype(U::lastModified(std::string()), std::true_type());
+
+    template <class>
+    static std::false_type test(...);
+
+public:
+    static constexpr bool value = decltype(test<FileReaderT>(0))::value;
+};
+
+/**
+ * @brief Hash a string of template text
+ * @param data Text to hash
+ * @param size Size of the text
+ * @return 64-bit FNV-1a hash
+ */
+static inline std::uint64_t content_hash(const char* data, std::size_t size) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for(std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+} // namespace helpers
+
+/**
+ * @brief The TemplateRegistry class loads and caches compiled templates by name
+ *
+ * Templates are read from files in a directory with FileReaderT and compiled
+ * once. Each lookup checks whether the file has changed, by modification time
+ * if the reader supports it and otherwise by content hash, and recompiles it
+ * only when it has. The least recently used templates are evicted when the
+ * registry holds more than its capacity.
+ *
+ * {% include name %} tags are resolved through the registry when a template
+ * is compiled. Every template that includes a partial references the same
+ * compiled partial, and is recompiled when the partial changes.
+ * A partial that was evicted is cached again from the dependents that
+ * still reference it, unless its file changed.
+ *
+ * All member functions are thread safe
+ */
+template <class FileReaderT = helpers::FileReader>
+class TemplateRegistry {
+private:
+    struct Version;
+
+    /**
+     * @brief Names of the included templates and the versions that were bound
+     */
+    using Includes = std::vector<std::pair<std::string, std::shared_ptr<const Version>>>;
+
+    /**
+     * @brief A compiled template and the file state it was compiled from
+     *
+     * Dependents keep the versions of their partials, so an evicted partial
+     * is put back from them instead of being recompiled
+     */
+    struct Version {
+        CompiledTemplatePtr compiled;
+        std::int64_t modified {0};
+        std::uint64_t hash {0};
+        Includes includes;
+    };
+
+    /**
+     * @brief A cached template
+     */
+    struct Entry {
+        std::shared_ptr<const Version> version;
+        std::list<std::string>::iterator lru;
+    };
+
+    /**
+     * @brief Marks a template as being loaded while it's in scope
+     */
+    class LoadingGuard {
+    private:
+        std::vector<std::string>& _loading;
+        std::map<std::string, std::shared_ptr<const Version>>& _checked;
+
+    public:
+        LoadingGuard(std::vector<std::string>& loading, std::map<std::string, std::shared_ptr<const Version>>& checked,
+                     const std::string& name) : _loading(loading), _checked(checked) {
+            if(std::find(_loading.begin(), _loading.end(), name) != _loading.end()) {
+                throw exception::InvalidTagError("Template includes itself: " + name);
+            }
+            _loading.push_back(name);
+        }
+
+        ~LoadingGuard() {
+            _loading.pop_back();
+            if(_loading.empty()) {
+                _checked.clear();
+            }
+        }
+    };
+
+    std::string _directory;
+    std::size_t _capacity;
+    std::map<std::string, Entry> _entries;
+    // Most recently used names are at the front
+    std::list<std::string> _lru;
+    // Templates whose includes are being loaded, innermost last
+    std::vector<std::string> _loading;
+    // Templates already checked by the outermost load
+    std::map<std::string, std::shared_ptr<const Version>> _checked;
+    std::size_t _compilations {0};
+    mutable std::mutex _mutex;
+
+    std::string path(const std::string& name) const {
+        if(_directory.empty()) {
+            return name;
+        }
+        return _directory + "/" + name;
+    }
+
+    /**
+     * @brief Compile a template and bind its includes
+     */
+    std::shared_ptr<Version> compile(SourcePtr source) {
+        auto version = std::make_shared<Version>();
+        version->compiled = make_compiled(std::move(source));
+        for(auto include : nodes::find_includes(version->compiled->nodes())) {
+            auto target = load(include->name());
+            include->bind(target->compiled);
+            version->includes.emplace_back(include->name(), std::move(target));
+        }
+        ++_compilations;
+        return version;
+    }
+
+    /**
+     * @brief Check if any included template was recompiled
+     *
+     * Loads every included template, so their files are checked as well.
+     * Evicted partials are cached again with the version that was bound.
+     */
+    bool includesChanged(const Version& version) {
+        bool changed = false;
+        for(const auto& include : version.includes) {
+            if(load(include.first, include.second) != include.second) {
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    /**
+     * @brief Check if a version is still current, by modification time
+     */
+    std::shared_ptr<const Version> refresh(std::shared_ptr<const Version> version, const std::string& file,
+                                           std::true_type) {
+        const auto modified = FileReaderT::lastModified(file);
+        if(version && version->modified == modified && !includesChanged(*version)) {
+            return version;
+        }
+        auto fresh = compile(make_source(FileReaderT::fromFile(file)));
+        fresh->modified = modified;
+        return fresh;
+    }
+
+    /**
+     * @brief Check if a version is still current, by content hash
+     */
+    std::shared_ptr<const Version> refresh(std::shared_ptr<const Version> version, const std::string& file,
+                                           std::false_type) {
+        auto source = make_source(FileReaderT::fromFile(file));
+        const auto hash = helpers::content_hash(source->data(), source->size());
+        if(version && version->hash == hash && !includesChanged(*version)) {
+            return version;
+        }
+        auto fresh = compile(std::move(source));
+        fresh->hash = hash;
+        return fresh;
+    }
+
+    /**
+     * @brief Get a compiled template, loading the ones it includes
+     *
+     * Each template is checked at most once per outermost load. Entries
+     * are only evicted once the outermost template is loaded.
+     *
+     * @param name Name of the template file
+     * @param bound Version a dependent bound, checked instead of compiling
+     * the template again if it was evicted
+     */
+    std::shared_ptr<const Version> load(const std::string& name, std::shared_ptr<const Version> bound = nullptr) {
+        LoadingGuard guard(_loading, _checked, name);
+        const auto checked = _checked.find(name);
+        if(checked != _checked.end()) {
+            return checked->second;
+        }
+
+        const auto kind = std::integral_constant<bool, helpers::has_last_modified<FileReaderT>::value>();
+        auto it = _entries.find(name);
+        if(it == _entries.end()) {
+            Entry entry;
+            entry.version = refresh(std::move(bound), path(name), kind);
+            _lru.push_front(name);
+            entry.lru = _lru.begin();
+            it = _entries.insert(std::make_pair(name, std::move(entry))).first;
+        }
+        else {
+            auto& entry = it->second;
+            entry.version = refresh(entry.version, path(name), kind);
+            _lru.splice(_lru.begin(), _lru, entry.lru);
+        }
+
+        _checked.emplace(name, it->second.version);
+        return it->second.version;
+    }
+
+    void evict() {
+        while(_entries.size() > _capacity && !_lru.empty()) {
+            _entries.erase(_lru.back());
+            _lru.pop_back();
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a registry
+     * @param directory Directory the template names are relative to, may be empty
+     * @param capacity Maximum number of cached templates
+     */
+    explicit TemplateRegistry(std::string directory = std::string(), std::size_t capacity = 256)
+        : _directory(std::move(directory)), _capacity(capacity) {
+
+    }
+
+    TemplateRegistry(const TemplateRegistry&) = delete;
+    TemplateRegistry& operator=(const TemplateRegistry&) = delete;
+
+    /**
+     * @brief Get a compiled template by name
+     *
+     * Reads and compiles the template if it isn't cached, if the file changed
+     * or if a template it includes changed
+     *
+     * @param name Name of the template file
+     * @exception std::runtime_error if the file can't be opened
+     * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+     * or includes itself
+     * @return Compiled template
+     */
+    CompiledTemplatePtr get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto compiled = load(name)->compiled;
+        evict();
+        return compiled;
+    }
+
+    /**
+     * @brief Check if a template is cached
+     * @param name Name of the template file
+     * @return True if cached, otherwise false
+     */
+    bool contains(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.count(name) != 0;
+    }
+
+    /**
+     * @brief Remove a template from the cache
+     * @param name Name of the template file
+     */
+    void erase(const std::string& name) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _entries.find(name);
+        if(it != _entries.end()) {
+            _lru.erase(it->second.lru);
+            _entries.erase(it);
+        }
+    }
+
+    /**
+     * @brief Remove all templates from the cache
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _lru.clear();
+    }
+
+    /**
+     * @brief Get the number of cached templates
+     * @return Number of templates
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    /**
+     * @brief Get the number of times a template was compiled
+     * @return Number of compilations, including recompilations of changed files
+     */
+    std::size_t compilations() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _compilations;
+    }
+};
+
+} // namespace templet
+
+#endif // REGISTRY_HPP
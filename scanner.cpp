@@ -0,0 +1,254 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+#include "scanner.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX2__)
+#include <immintrin.h>
+#define TEMPLET_SCAN_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TEMPLET_SCAN_NEON
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+#if defined(TEMPLET_SCAN_SSE2)
+/**
+ * @brief Get the index of the lowest set bit
+ * @param mask Non-zero mask
+ * @return Bit index
+ */
+inline unsigned first_bit(std::uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+/**
+ * @brief Checks whether a character starts a tag after {
+ * @param c Character after {
+ * @return True for $, % and \, otherwise false
+ */
+inline bool is_tag_char(char c) {
+    return c == '$' || c == '%' || c == '\\';
+}
+
+/**
+ * @brief Checks whether a byte must be escaped in HTML
+ * @param c Byte to check
+ * @return True if special, otherwise false
+ */
+inline bool is_html_special(char c) {
+    return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+}
+
+/**
+ * @brief Checks whether a byte can be written to a URL as is
+ * @param c Byte to check
+ * @return True if unreserved, otherwise false
+ */
+inline bool is_url_unreserved(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+/**
+ * @brief Find the next byte matching a predicate, one byte at a time
+ * @param text Text to scan
+ * @param pos Position to start from
+ * @param size Size of the text
+ * @param matches Predicate
+ * @return Position of the byte, or size if not found
+ */
+template <class Predicate>
+inline std::size_t find_scalar(const char* text, std::size_t pos, std::size_t size, Predicate matches) {
+    for(; pos < size; ++pos) {
+        if(matches(text[pos])) {
+            return pos;
+        }
+    }
+    return size;
+}
+
+#if defined(TEMPLET_SCAN_SSE2)
+/**
+ * @brief Mark the bytes in a signed range
+ * @param block Bytes to check
+ * @param lo Lowest byte in range
+ * @param hi Highest byte in range
+ * @return 0xff for bytes in range, 0 for others
+ */
+inline __m128i in_range(__m128i block, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmplt_epi8(block, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+#elif defined(TEMPLET_SCAN_NEON)
+/**
+ * @brief Mark the bytes in a range
+ * @param block Bytes to check
+ * @param lo Lowest byte in range
+ * @param hi Highest byte in range
+ * @return 0xff for bytes in range, 0 for others
+ */
+inline uint8x16_t in_range(uint8x16_t block, char lo, char hi) {
+    return vandq_u8(vcgeq_u8(block, vdupq_n_u8(static_cast<std::uint8_t>(lo))),
+                    vcleq_u8(block, vdupq_n_u8(static_cast<std::uint8_t>(hi))));
+}
+#endif
+
+} // unnamed namespace
+
+std::size_t templet::helpers::find_byte(const char* text, std::size_t pos, std::size_t size, char c) {
+#if defined(__AVX2__)
+    const __m256i needle32 = _mm256_set1_epi8(c);
+    for(; pos + 32 <= size; pos += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos));
+        const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32)));
+        if(mask != 0) {
+            return pos + first_bit(mask);
+        }
+    }
+#endif
+#if defined(TEMPLET_SCAN_SSE2)
+    const __m128i needle = _mm_set1_epi8(c);
+    for(; pos + 16 <= size; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+        if(mask != 0) {
+            return pos + first_bit(mask);
+        }
+    }
+#elif defined(TEMPLET_SCAN_NEON)
+    const uint8x16_t needle = vdupq_n_u8(static_cast<std::uint8_t>(c));
+    for(; pos + 16 <= size; pos += 16) {
+        const uint8x16_t block = vld1q_u8(reinterpret_cast<const std::uint8_t*>(text + pos));
+        if(vmaxvq_u8(vceqq_u8(block, needle)) != 0) {
+            // The scalar scan below finds the byte inside this block
+            break;
+        }
+    }
+#endif
+    if(pos >= size) {
+        return size;
+    }
+    const auto found = static_cast<const char*>(std::memchr(text + pos, c, size - pos));
+    return (found != nullptr) ? static_cast<std::size_t>(found - text) : size;
+}
+
+templet::helpers::TagSpan templet::helpers::find_tag(const char* text, std::size_t pos, std::size_t size) {
+    while(pos < size) {
+        const auto open = find_byte(text, pos, size, '{');
+        if(open == size) {
+            break;
+        }
+        const auto close = find_byte(text, open + 1, size, '}');
+        if(close == size) {
+            return TagSpan {open, std::string::npos};
+        }
+        // The closing } comes after the {, so the next character exists
+        if(is_tag_char(text[open + 1])) {
+            return TagSpan {open, close};
+        }
+        pos = close + 1;
+    }
+    return TagSpan {size, std::string::npos};
+}
+
+std::size_t templet::helpers::find_html_special(const char* text, std::size_t pos, std::size_t size) {
+#if defined(TEMPLET_SCAN_SSE2)
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i apos = _mm_set1_epi8('\'');
+    for(; pos + 16 <= size; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        const __m128i special = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(block, amp), _mm_cmpeq_epi8(block, lt)),
+                    _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, gt), _mm_cmpeq_epi8(block, quot)),
+                                 _mm_cmpeq_epi8(block, apos)));
+        const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(special));
+        if(mask != 0) {
+            return pos + first_bit(mask);
+        }
+    }
+#elif defined(TEMPLET_SCAN_NEON)
+    for(; pos + 16 <= size; pos += 16) {
+        const uint8x16_t block = vld1q_u8(reinterpret_cast<const std::uint8_t*>(text + pos));
+        const uint8x16_t special = vorrq_u8(
+                    vorrq_u8(vceqq_u8(block, vdupq_n_u8('&')), vceqq_u8(block, vdupq_n_u8('<'))),
+                    vorrq_u8(vorrq_u8(vceqq_u8(block, vdupq_n_u8('>')), vceqq_u8(block, vdupq_n_u8('"'))),
+                             vceqq_u8(block, vdupq_n_u8('\''))));
+        if(vmaxvq_u8(special) != 0) {
+            break;
+        }
+    }
+#endif
+    return find_scalar(text, pos, size, is_html_special);
+}
+
+std::size_t templet::helpers::find_url_special(const char* text, std::size_t pos, std::size_t size) {
+#if defined(TEMPLET_SCAN_SSE2)
+    // Bytes from 0x80 up are negative and fall outside every range
+    const __m128i lower = _mm_set1_epi8(0x20);
+    for(; pos + 16 <= size; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        const __m128i safe = _mm_or_si128(
+                    _mm_or_si128(in_range(_mm_or_si128(block, lower), 'a', 'z'), in_range(block, '0', '9')),
+                    _mm_or_si128(in_range(block, '-', '.'),
+                                 _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('_')),
+                                              _mm_cmpeq_epi8(block, _mm_set1_epi8('~')))));
+        const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(safe)) ^ 0xffffu;
+        if(mask != 0) {
+            return pos + first_bit(mask);
+        }
+    }
+#elif defined(TEMPLET_SCAN_NEON)
+    for(; pos + 16 <= size; pos += 16) {
+        const uint8x16_t block = vld1q_u8(reinterpret_cast<const std::uint8_t*>(text + pos));
+        const uint8x16_t safe = vorrq_u8(
+                    vorrq_u8(in_range(vorrq_u8(block, vdupq_n_u8(0x20)), 'a', 'z'), in_range(block, '0', '9')),
+                    vorrq_u8(in_range(block, '-', '.'),
+                             vorrq_u8(vceqq_u8(block, vdupq_n_u8('_')), vceqq_u8(block, vdupq_n_u8('~')))));
+        if(vminvq_u8(safe) == 0) {
+            break;
+        }
+    }
+#endif
+    return find_scalar(text, pos, size, [](char c) { return !is_url_unreserved(c); });
+}
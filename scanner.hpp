@@ -0,0 +1,98 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef SCANNER_HPP
+#define SCANNER_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace templet {
+namespace helpers {
+
+/**
+ * @brief The TagSpan struct is the position of a tag in template text
+ */
+struct TagSpan {
+    std::size_t open;   ///< Position of the opening {, or the text size if there are no more tags
+    std::size_t close;  ///< Position of the closing }, or std::string::npos if the tag is not closed
+};
+
+/**
+ * @brief Find the next occurrence of a byte
+ *
+ * Scans 16 or 32 bytes at a time with SSE2, AVX2 or NEON when the
+ * compiler targets them, otherwise falls back to memchr
+ *
+ * @param text Text to scan
+ * @param pos Position to start from
+ * @param size Size of the text
+ * @param c Byte to find
+ * @return Position of the byte, or size if not found
+ */
+std::size_t find_byte(const char* text, std::size_t pos, std::size_t size, char c);
+
+/**
+ * @brief Find the next {$, {% or {\ tag in template text
+ *
+ * Any other { is plain text up to and including the next }, the scan
+ * continues after it without returning to the caller
+ *
+ * @param text Text to scan
+ * @param pos Position to start from
+ * @param size Size of the text
+ * @return Position of the tag
+ */
+TagSpan find_tag(const char* text, std::size_t pos, std::size_t size);
+
+/**
+ * @brief Find the next byte that must be escaped in HTML
+ *
+ * These are &, <, >, " and '
+ *
+ * @param text Text to scan
+ * @param pos Position to start from
+ * @param size Size of the text
+ * @return Position of the byte, or size if not found
+ */
+std::size_t find_html_special(const char* text, std::size_t pos, std::size_t size);
+
+/**
+ * @brief Find the next byte that must be percent-encoded in a URL
+ *
+ * Everything except letters, digits, -, ., _ and ~ is encoded
+ *
+ * @param text Text to scan
+ * @param pos Position to start from
+ * @param size Size of the text
+ * @return Position of the byte, or size if not found
+ */
+std::size_t find_url_special(const char* text, std::size_t pos, std::size_t size);
+
+} // namespace helpers
+} // namespace templet
+
+#endif // SCANNER_HPP
@@ -0,0 +1,121 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "scope.hpp"
+
+using namespace templet::types;
+
+namespace {
+
+const templet::RenderOptions defaultOptions {};
+
+}
+
+Scope::Scope(const DataMap& values)
+    : _values(&values), _options(&defaultOptions) {
+
+}
+
+Scope::Scope(const DataMap& values, const RenderOptions& options)
+    : _values(&values), _options(&options) {
+
+}
+
+Scope::Scope(const FlatDataMap& values)
+    : _flat(&values), _options(&defaultOptions) {
+
+}
+
+Scope::Scope(const FlatDataMap& values, const RenderOptions& options)
+    : _flat(&values), _options(&options) {
+
+}
+
+Scope::Scope(const Scope& parent, const std::string& name)
+    : _parent(&parent), _name(&name), _options(parent._options), _compiled(parent._compiled) {
+
+}
+
+Scope::Scope(const Scope& parent, const templet::CompiledTemplate& compiled)
+    : _parent(&parent), _options(parent._options), _compiled(&compiled) {
+
+}
+
+const templet::RenderOptions& Scope::options() const {
+    return *_options;
+}
+
+const templet::CompiledTemplate* Scope::compiled() const {
+    return _compiled;
+}
+
+void Scope::bind(const Data* value) {
+    _value = value;
+}
+
+const Data* Scope::find(const std::string& name) const {
+    return find(name, invalidSymbol);
+}
+
+const Data* Scope::find(const std::string& name, Symbol symbol) const {
+    for(auto scope = this; scope != nullptr; scope = scope->_parent) {
+        if(scope->_name != nullptr) {
+            if(*scope->_name == name) {
+                return scope->_value;
+            }
+        }
+        else if(scope->_values != nullptr) {
+            const auto it = scope->_values->find(name);
+            return (it != scope->_values->end()) ? it->second.get() : nullptr;
+        }
+        else if(scope->_flat != nullptr) {
+            return (symbol != invalidSymbol) ? scope->_flat->find(symbol) : scope->_flat->find(name);
+        }
+    }
+    return nullptr;
+}
+
+bool Scope::contains(const std::string& name) const {
+    return contains(name, invalidSymbol);
+}
+
+bool Scope::contains(const std::string& name, Symbol symbol) const {
+    for(auto scope = this; scope != nullptr; scope = scope->_parent) {
+        if(scope->_name != nullptr) {
+            if(*scope->_name == name) {
+                return true;
+            }
+        }
+        else if(scope->_values != nullptr) {
+            return scope->_values->count(name) != 0;
+        }
+        else if(scope->_flat != nullptr) {
+            const auto value = (symbol != invalidSymbol) ? scope->_flat->find(symbol) : scope->_flat->find(name);
+            return value != nullptr;
+        }
+    }
+    return false;
+}
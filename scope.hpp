@@ -0,0 +1,174 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef SCOPE_HPP
+#define SCOPE_HPP
+
+#include <string>
+#include "options.hpp"
+#include "types.hpp"
+
+namespace templet {
+
+class CompiledTemplate;
+namespace types {
+
+/**
+ * @brief The Scope class resolves names during evaluation
+ *
+ * The root scope references the map of values passed by the user. Each
+ * for loop adds a child scope that binds only the loop alias and falls
+ * back to its parent for every other name, so no values are copied.
+ * A compiled template that reports to instrumentation adds a child scope
+ * that binds nothing and only marks the template being rendered.
+ *
+ * A scope does not own anything it references.
+ */
+class Scope {
+private:
+    const DataMap* _values {nullptr};
+    const FlatDataMap* _flat {nullptr};
+    const Scope* _parent {nullptr};
+    const std::string* _name {nullptr};
+    const Data* _value {nullptr};
+    const RenderOptions* _options {nullptr};
+    const CompiledTemplate* _compiled {nullptr};
+
+public:
+    /**
+     * @brief Construct a root scope over a map of values
+     *
+     * Not explicit so that a DataMap can be passed wherever a Scope is expected
+     *
+     * @param values Map of values
+     */
+    Scope(const DataMap& values);
+
+    /**
+     * @brief Construct a root scope over a map of values
+     * @param values Map of values
+     * @param options Options for the evaluation, must outlive the scope
+     */
+    Scope(const DataMap& values, const RenderOptions& options);
+
+    /**
+     * @brief Construct a root scope over a flat map of values
+     * @param values Flat map of values
+     */
+    Scope(const FlatDataMap& values);
+
+    /**
+     * @brief Construct a root scope over a flat map of values
+     * @param values Flat map of values
+     * @param options Options for the evaluation, must outlive the scope
+     */
+    Scope(const FlatDataMap& values, const RenderOptions& options);
+
+    /**
+     * @brief Construct a child scope that binds one name
+     * @param parent Scope to fall back to for other names
+     * @param name Name to bind, e.g. the alias of a for loop
+     */
+    Scope(const Scope& parent, const std::string& name);
+
+    /**
+     * @brief Construct a child scope that marks the template being rendered
+     * @param parent Scope to fall back to for all names
+     * @param compiled Template whose nodes are evaluated in the scope
+     */
+    Scope(const Scope& parent, const CompiledTemplate& compiled);
+
+    /**
+     * @brief Get the options of the evaluation
+     *
+     * Child scopes share the options of their root scope
+     *
+     * @return Render options
+     */
+    const RenderOptions& options() const;
+
+    /**
+     * @brief Get the template being rendered for instrumentation
+     *
+     * Child scopes share the template of their parent
+     *
+     * @return Compiled template, or nullptr if not marked
+     */
+    const CompiledTemplate* compiled() const;
+
+    /**
+     * @brief Bind a new value to the name of a child scope
+     * @param value Value to bind, not owned by the scope
+     */
+    void bind(const Data* value);
+
+    /**
+     * @brief Find a value by name
+     *
+     * Names bound by child scopes shadow the names of their parents
+     *
+     * @param name Name to find
+     * @return Pointer to the value or nullptr if not found
+     */
+    const Data* find(const std::string& name) const;
+
+    /**
+     * @brief Find a value by name and its interned symbol
+     *
+     * A flat map of values is probed with the symbol
+     *
+     * @param name Name to find
+     * @param symbol Interned name, or invalidSymbol if not known
+     * @return Pointer to the value or nullptr if not found
+     */
+    const Data* find(const std::string& name, Symbol symbol) const;
+
+    /**
+     * @brief Check if a name is defined in this scope or its parents
+     * @param name Name to check
+     * @return True if defined, otherwise false
+     */
+    bool contains(const std::string& name) const;
+
+    /**
+     * @brief Check if a name is defined by its interned symbol
+     *
+     * A flat map of values is probed with the symbol
+     *
+     * @param name Name to check
+     * @param symbol Interned name, or invalidSymbol if not known
+     * @return True if defined, otherwise false
+     */
+    bool contains(const std::string& name, Symbol symbol) const;
+};
+
+} // namespace types
+
+using types::Scope;
+
+} // namespace templet
+
+#endif // SCOPE_HPP
@@ -0,0 +1,490 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "serialize.hpp"
+
+using namespace templet;
+using namespace templet::nodes;
+
+namespace {
+
+// A blob is a header, a table of node records in pre-order and a pool
+// with all text and names. Every field is a 32 bit unsigned integer in
+// the byte order of the machine that wrote it, a blob from a machine with
+// another byte order has a mismatching magic number.
+
+const std::uint32_t blobMagic = 0x424c5054; // "TPLB" read as little endian
+const std::size_t maxDepth = 256;
+
+enum HeaderField {
+    Magic,
+    Version,
+    RecordCount,
+    TopCount,
+    PoolSize,
+    NodesBefore,
+    NodesAfter,
+    MergedTexts,
+    DroppedTexts,
+    FoldedBlocks,
+    HeaderFields
+};
+
+enum RecordField {
+    Type,
+    ChildCount,
+    TextOffset,
+    TextSize,
+    NameOffset,
+    NameSize,
+    AliasOffset,
+    AliasSize,
+    FilterKind,
+    RecordFields
+};
+
+const std::size_t fieldSize = sizeof(std::uint32_t);
+const std::size_t headerSize = HeaderFields * fieldSize;
+const std::size_t recordSize = RecordFields * fieldSize;
+
+/**
+ * @brief The BlobError class is thrown for blobs that can't be loaded
+ */
+class BlobError : public std::runtime_error {
+public:
+    BlobError(const char* reason) : std::runtime_error(reason) {}
+};
+
+/**
+ * @brief Convert a size into a blob field
+ * @param size Size to convert
+ * @exception std::runtime_error if the size doesn't fit
+ * @return Field value
+ */
+std::uint32_t to_field(std::size_t size) {
+    if(size > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("Template is too large to serialize");
+    }
+    return static_cast<std::uint32_t>(size);
+}
+
+/**
+ * @brief The BlobWriter class flattens a node tree into records and a pool
+ */
+class BlobWriter {
+private:
+    std::vector<std::uint32_t> _records;
+    std::string _pool;
+    std::size_t _count {0};
+
+    /**
+     * @brief Add bytes to the pool
+     * @param record First field of the record
+     * @param offset Field for the offset
+     * @param data Bytes to add
+     * @param size Number of bytes
+     */
+    void addString(std::size_t record, RecordField offset, const char* data, std::size_t size) {
+        _records[record + offset] = to_field(_pool.size());
+        _records[record + offset + 1] = to_field(size);
+        _pool.append(data, size);
+    }
+
+    void addString(std::size_t record, RecordField offset, const std::string& text) {
+        addString(record, offset, text.data(), text.size());
+    }
+
+public:
+    /**
+     * @brief Add nodes and their children in pre-order
+     * @param nodes Nodes to add
+     * @exception std::runtime_error if a node can't be serialized
+     */
+    void add(NodeRange nodes) {
+        for(auto node : nodes) {
+            add(node);
+        }
+    }
+
+    /**
+     * @brief Add a node and its children
+     * @param node Node to add
+     * @exception std::runtime_error if the node can't be serialized
+     */
+    void add(const Node* node) {
+        const auto record = _records.size();
+        _records.resize(record + RecordFields, 0);
+        _records[record + Type] = static_cast<std::uint32_t>(node->type());
+        ++_count;
+
+        NodeRange children;
+        bool block = false;
+        switch(node->type()) {
+        case NodeType::Text:
+            if(const auto text = dynamic_cast<const Text*>(node)) {
+                addString(record, TextOffset, text->data(), text->size());
+                return;
+            }
+            break;
+        case NodeType::Value:
+            if(const auto value = dynamic_cast<const Value*>(node)) {
+                addString(record, NameOffset, value->path().str());
+                _records[record + FilterKind] = static_cast<std::uint32_t>(value->filter());
+                return;
+            }
+            break;
+        case NodeType::IfValue:
+        case NodeType::ElifValue:
+            if(const auto condition = dynamic_cast<const IfValue*>(node)) {
+                addString(record, NameOffset, condition->path().str());
+                children = condition->children();
+                block = true;
+            }
+            break;
+        case NodeType::ElseValue:
+            if(const auto alternative = dynamic_cast<const ElseValue*>(node)) {
+                children = alternative->children();
+                block = true;
+            }
+            break;
+        case NodeType::ForValue:
+            if(const auto loop = dynamic_cast<const ForValue*>(node)) {
+                addString(record, NameOffset, loop->path().str());
+                addString(record, AliasOffset, loop->alias());
+                children = loop->children();
+                block = true;
+            }
+            break;
+        case NodeType::CacheValue:
+            if(const auto cached = dynamic_cast<const CacheValue*>(node)) {
+                addString(record, NameOffset, cached->path().str());
+                children = cached->children();
+                block = true;
+            }
+            break;
+        case NodeType::StaticIfValue:
+            if(const auto folded = dynamic_cast<const StaticIfValue*>(node)) {
+                addString(record, NameOffset, folded->path().str());
+                addString(record, TextOffset, folded->data(), folded->size());
+                return;
+            }
+            break;
+        case NodeType::StaticForValue:
+            if(const auto folded = dynamic_cast<const StaticForValue*>(node)) {
+                addString(record, NameOffset, folded->path().str());
+                addString(record, AliasOffset, folded->alias());
+                addString(record, TextOffset, folded->data(), folded->size());
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        if(!block) {
+            throw std::runtime_error("Node type can't be serialized");
+        }
+
+        _records[record + ChildCount] = to_field(children.size());
+        add(children);
+    }
+
+    /**
+     * @brief Get the blob
+     * @param top Number of top level nodes
+     * @param stats Optimizer statistics
+     * @return Binary blob
+     */
+    std::string blob(std::size_t top, const OptimizeStats& stats) const {
+        std::uint32_t header[HeaderFields] = {};
+        header[Magic] = blobMagic;
+        header[Version] = serializedVersion;
+        header[RecordCount] = to_field(_count);
+        header[TopCount] = to_field(top);
+        header[PoolSize] = to_field(_pool.size());
+        header[NodesBefore] = to_field(stats.nodesBefore);
+        header[NodesAfter] = to_field(stats.nodesAfter);
+        header[MergedTexts] = to_field(stats.mergedTexts);
+        header[DroppedTexts] = to_field(stats.droppedTexts);
+        header[FoldedBlocks] = to_field(stats.foldedBlocks);
+
+        std::string out;
+        out.reserve(headerSize + _records.size() * fieldSize + _pool.size());
+        out.append(reinterpret_cast<const char*>(header), headerSize);
+        out.append(reinterpret_cast<const char*>(_records.data()), _records.size() * fieldSize);
+        out.append(_pool);
+        return out;
+    }
+};
+
+/**
+ * @brief The BlobReader class rebuilds a node tree from a blob
+ *
+ * Every offset and count is checked against the blob before it is used
+ */
+class BlobReader {
+private:
+    const char* _records;
+    std::size_t _count;
+    const char* _pool;
+    std::size_t _poolSize;
+    std::size_t _next {0};
+    NodeArena& _arena;
+
+    /**
+     * @brief Read a field of the current record
+     * @param field Field to read
+     * @return Field value
+     */
+    std::uint32_t field(RecordField field) const {
+        std::uint32_t value;
+        std::memcpy(&value, _records + _next * recordSize + field * fieldSize, fieldSize);
+        return value;
+    }
+
+    /**
+     * @brief Get a span of the pool referenced by the current record
+     * @param offset Field for the offset, followed by the size
+     * @exception BlobError if the span is outside the pool
+     * @return Start of the span, the size is in the field after the offset
+     */
+    const char* span(RecordField offset) const {
+        const std::size_t start = field(offset);
+        const std::size_t size = field(static_cast<RecordField>(offset + 1));
+        if(start > _poolSize || size > _poolSize - start) {
+            throw BlobError("Serialized template references text outside the pool");
+        }
+        return _pool + start;
+    }
+
+    std::string string(RecordField offset) const {
+        return std::string(span(offset), field(static_cast<RecordField>(offset + 1)));
+    }
+
+public:
+    BlobReader(const char* records, std::size_t count, const char* pool, std::size_t poolSize, NodeArena& arena)
+        : _records(records), _count(count), _pool(pool), _poolSize(poolSize), _arena(arena) {
+
+    }
+
+    /**
+     * @brief Read a list of nodes
+     * @param count Number of nodes
+     * @param depth Nesting depth of the nodes
+     * @exception BlobError if the records are invalid
+     * @exception templet::exception::InvalidTagError if a name is invalid
+     * @return Range of nodes owned by the arena
+     */
+    NodeRange readList(std::size_t count, std::size_t depth) {
+        if(depth > maxDepth) {
+            throw BlobError("Serialized template is nested too deeply");
+        }
+        if(count > _count - _next) {
+            throw BlobError("Serialized template has too few records");
+        }
+        auto nodes = _arena.allocateArray<Node*>(count);
+        for(std::size_t i = 0; i < count; ++i) {
+            nodes[i] = read(depth);
+        }
+        return NodeRange(nodes, count);
+    }
+
+    /**
+     * @brief Read the node of the current record and its children
+     * @param depth Nesting depth of the node
+     * @exception BlobError if the record is invalid
+     * @exception templet::exception::InvalidTagError if a name is invalid
+     * @return Node owned by the arena
+     */
+    Node* read(std::size_t depth) {
+        if(_next >= _count) {
+            throw BlobError("Serialized template has too few records");
+        }
+        const auto type = static_cast<NodeType>(field(Type));
+        const auto children = field(ChildCount);
+        const auto filter = field(FilterKind);
+        if(filter > static_cast<std::uint32_t>(Filter::Url)) {
+            throw BlobError("Serialized template has an unknown filter");
+        }
+
+        Node* node = nullptr;
+        bool block = false;
+        switch(type) {
+        case NodeType::Text:
+            node = _arena.create<Text>(span(TextOffset), field(TextSize));
+            break;
+        case NodeType::Value:
+            node = _arena.create<Value>(string(NameOffset), static_cast<Filter>(filter));
+            break;
+        case NodeType::IfValue:
+            node = _arena.create<IfValue>(string(NameOffset));
+            block = true;
+            break;
+        case NodeType::ElifValue:
+            node = _arena.create<ElifValue>(string(NameOffset));
+            block = true;
+            break;
+        case NodeType::ElseValue:
+            node = _arena.create<ElseValue>();
+            block = true;
+            break;
+        case NodeType::ForValue:
+            node = _arena.create<ForValue>(string(NameOffset), string(AliasOffset));
+            block = true;
+            break;
+        case NodeType::CacheValue:
+            node = _arena.create<CacheValue>(string(NameOffset));
+            block = true;
+            break;
+        case NodeType::StaticIfValue:
+            node = _arena.create<StaticIfValue>(TagPath(string(NameOffset)), span(TextOffset), field(TextSize));
+            break;
+        case NodeType::StaticForValue:
+            node = _arena.create<StaticForValue>(TagPath(string(NameOffset)), string(AliasOffset),
+                                                 span(TextOffset), field(TextSize));
+            break;
+        default:
+            throw BlobError("Serialized template has an unknown node type");
+        }
+        ++_next;
+
+        if(block) {
+            node->setChildren(readList(children, depth + 1));
+        }
+        else if(children != 0) {
+            throw BlobError("Serialized template has children on a node without children");
+        }
+        return node;
+    }
+
+    /**
+     * @brief Check if every record was read
+     * @return True if done, otherwise false
+     */
+    bool done() const {
+        return _next == _count;
+    }
+};
+
+/**
+ * @brief Read a header field
+ * @param data Start of the blob
+ * @param field Field to read
+ * @return Field value
+ */
+std::uint32_t header_field(const char* data, HeaderField field) {
+    std::uint32_t value;
+    std::memcpy(&value, data + field * fieldSize, fieldSize);
+    return value;
+}
+
+/**
+ * @brief Node builder for serialized templates
+ * @param blob Blob created by serialize_compiled
+ * @param arena Arena that owns the nodes
+ * @param stats Optimizer statistics stored in the blob
+ * @exception BlobError if the blob is invalid
+ * @exception templet::exception::InvalidTagError if a name in the blob is invalid
+ * @return Top level nodes
+ */
+NodeRange build_from_blob(const SourcePtr& blob, NodeArena& arena, OptimizeStats& stats) {
+    const char* const data = blob->data();
+    const std::size_t size = blob->size();
+    if(size < headerSize || header_field(data, Magic) != blobMagic) {
+        throw BlobError("Not a serialized template");
+    }
+    if(header_field(data, Version) != serializedVersion) {
+        throw BlobError("Serialized template has another version");
+    }
+
+    const std::size_t count = header_field(data, RecordCount);
+    const std::size_t poolSize = header_field(data, PoolSize);
+    // Compare in 64 bits, the sizes are 32 bit fields
+    if(static_cast<std::uint64_t>(headerSize) + static_cast<std::uint64_t>(count) * recordSize + poolSize != size) {
+        throw BlobError("Serialized template has the wrong size");
+    }
+
+    stats.nodesBefore = header_field(data, NodesBefore);
+    stats.nodesAfter = header_field(data, NodesAfter);
+    stats.mergedTexts = header_field(data, MergedTexts);
+    stats.droppedTexts = header_field(data, DroppedTexts);
+    stats.foldedBlocks = header_field(data, FoldedBlocks);
+
+    const char* const records = data + headerSize;
+    BlobReader reader(records, count, records + count * recordSize, poolSize, arena);
+    const auto nodes = reader.readList(header_field(data, TopCount), 0);
+    if(!reader.done()) {
+        throw BlobError("Serialized template has unused records");
+    }
+    return nodes;
+}
+
+} // unnamed namespace
+
+std::string templet::serialize_compiled(const CompiledTemplate& compiled) {
+    BlobWriter writer;
+    writer.add(compiled.nodes());
+    return writer.blob(compiled.nodes().size(), compiled.stats());
+}
+
+CompiledTemplatePtr templet::load_compiled(SourcePtr blob) {
+    if(!blob) {
+        return nullptr;
+    }
+    try {
+        return std::make_shared<const CompiledTemplate>(std::move(blob), build_from_blob);
+    }
+    catch(const BlobError&) {
+        return nullptr;
+    }
+    catch(const templet::exception::InvalidTagError&) {
+        return nullptr;
+    }
+}
+
+CompiledTemplatePtr templet::load_compiled(SourcePtr blob, SourcePtr fallback) {
+    if(auto compiled = load_compiled(std::move(blob))) {
+        return compiled;
+    }
+    return make_compiled(std::move(fallback));
+}
+
+void templet::save_compiled(const std::string& path, const CompiledTemplate& compiled) {
+    const auto blob = serialize_compiled(compiled);
+    std::ofstream outfile {path, std::ios::out|std::ios::trunc|std::ios::binary};
+    if(!outfile) {
+        throw std::runtime_error("File can't be opened: " + path);
+    }
+
+    outfile.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+    if(!outfile) {
+        throw std::runtime_error("File can't be written: " + path);
+    }
+}
@@ -0,0 +1,119 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef SERIALIZE_HPP
+#define SERIALIZE_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "compiled.hpp"
+#include "mapped_file.hpp"
+#include "source.hpp"
+#include "templet.hpp"
+
+namespace templet {
+
+/**
+ * @brief Version of the serialized template format
+ *
+ * Bumped whenever the layout or the meaning of a node changes, blobs
+ * with another version are rejected
+ */
+const std::uint32_t serializedVersion = 1;
+
+/**
+ * @brief Serialize a compiled template into a binary blob
+ *
+ * The blob holds the optimized node tree as a flat table of records
+ * followed by one pool with all text and tag names. It is only valid on
+ * machines with the same byte order.
+ *
+ * @param compiled Compiled template
+ * @exception std::runtime_error if the template is too large or has nodes that can't be serialized
+ * @return Binary blob
+ */
+std::string serialize_compiled(const CompiledTemplate& compiled);
+
+/**
+ * @brief Load a compiled template from a binary blob
+ *
+ * Text nodes reference the text pool inside the blob without copying,
+ * so a memory mapped blob is loaded without reading it all. The blob is
+ * kept alive by the compiled template.
+ *
+ * @param blob Blob created by serialize_compiled
+ * @return Compiled template, or nullptr if the blob is invalid or has another version
+ */
+CompiledTemplatePtr load_compiled(SourcePtr blob);
+
+/**
+ * @brief Load a compiled template from a binary blob or tokenize the template
+ * @param blob Blob created by serialize_compiled, may be nullptr
+ * @param fallback Template source to tokenize if the blob can't be loaded
+ * @exception templet::exception::InvalidTagError if the fallback contains an invalid tag
+ * @return Compiled template
+ */
+CompiledTemplatePtr load_compiled(SourcePtr blob, SourcePtr fallback);
+
+/**
+ * @brief Write a serialized compiled template to a file
+ * @param path Path to file
+ * @param compiled Compiled template
+ * @exception std::runtime_error Thrown if file can't be written
+ */
+void save_compiled(const std::string& path, const CompiledTemplate& compiled);
+
+/**
+ * @brief Load a compiled template from a blob file or tokenize the template file
+ *
+ * The blob is memory mapped by default. A missing, invalid or outdated
+ * blob falls back to reading and tokenizing the template file.
+ *
+ * @param blobPath Path to the file written by save_compiled
+ * @param templatePath Path to the template file
+ * @exception std::runtime_error Thrown if the blob can't be loaded and the template file can't be opened
+ * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+ * @return Compiled template
+ */
+template <class BlobReaderT = helpers::MappedFileReader, class FileReaderT = helpers::FileReader>
+CompiledTemplatePtr load_compiled_file(const std::string& blobPath, const std::string& templatePath) {
+    SourcePtr blob;
+    try {
+        blob = make_source(BlobReaderT::fromFile(blobPath));
+    }
+    catch(const std::runtime_error&) {
+        // No blob yet, compile from the template
+    }
+    if(auto compiled = load_compiled(blob)) {
+        return compiled;
+    }
+    return make_compiled(make_source(FileReaderT::fromFile(templatePath)));
+}
+
+} // namespace templet
+
+#endif // SERIALIZE_HPP
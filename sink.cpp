@@ -0,0 +1,149 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "sink.hpp"
+
+using namespace templet;
+
+void Sink::writeStatic(const char* data, std::size_t size) {
+    write(data, size);
+}
+
+StringSink::StringSink(std::string& out)
+    : Sink(), _out(out) {
+
+}
+
+void StringSink::write(const char* data, std::size_t size) {
+    _out.append(data, size);
+}
+
+OstreamSink::OstreamSink(std::ostream& os)
+    : Sink(), _os(os) {
+
+}
+
+void OstreamSink::write(const char* data, std::size_t size) {
+    _os.write(data, size);
+}
+
+CountingSink::CountingSink(Sink& out)
+    : Sink(), _out(out) {
+
+}
+
+void CountingSink::write(const char* data, std::size_t size) {
+    _size += size;
+    _out.write(data, size);
+}
+
+void CountingSink::writeStatic(const char* data, std::size_t size) {
+    _size += size;
+    _out.writeStatic(data, size);
+}
+
+std::size_t CountingSink::size() const {
+    return _size;
+}
+
+BufferSink::BufferSink(char* buffer, std::size_t capacity)
+    : Sink(), _buffer(buffer), _capacity(capacity) {
+
+}
+
+void BufferSink::write(const char* data, std::size_t size) {
+    _required += size;
+    const auto count = std::min(size, _capacity - _size);
+    if(count > 0) {
+        std::memcpy(_buffer + _size, data, count);
+        _size += count;
+    }
+}
+
+std::size_t BufferSink::size() const {
+    return _size;
+}
+
+std::size_t BufferSink::required() const {
+    return _required;
+}
+
+bool BufferSink::overflowed() const {
+    return _required > _size;
+}
+
+void IovecSink::write(const char* data, std::size_t size) {
+    if(size == 0) {
+        return;
+    }
+    // Buffered output is stored as an offset because
+    // the buffer may move when it grows
+    if(!_entries.empty() && _entries.back().data == nullptr &&
+            _entries.back().offset + _entries.back().size == _buffer.size()) {
+        _entries.back().size += size;
+    }
+    else {
+        _entries.push_back({nullptr, _buffer.size(), size});
+    }
+    _buffer.append(data, size);
+    _size += size;
+}
+
+void IovecSink::writeStatic(const char* data, std::size_t size) {
+    if(size == 0) {
+        return;
+    }
+    if(!_entries.empty() && _entries.back().data != nullptr &&
+            _entries.back().data + _entries.back().size == data) {
+        _entries.back().size += size;
+    }
+    else {
+        _entries.push_back({data, 0, size});
+    }
+    _size += size;
+}
+
+std::vector<IoSlice> IovecSink::slices() const {
+    std::vector<IoSlice> slices;
+    slices.reserve(_entries.size());
+    for(const auto& entry : _entries) {
+        const char* data = entry.data ? entry.data : _buffer.data() + entry.offset;
+        slices.push_back({data, entry.size});
+    }
+    return slices;
+}
+
+std::size_t IovecSink::size() const {
+    return _size;
+}
+
+void IovecSink::clear() {
+    _entries.clear();
+    _buffer.clear();
+    _size = 0;
+}
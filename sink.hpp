@@ -0,0 +1,228 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef SINK_HPP
+#define SINK_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace templet {
+
+/**
+ * @brief The Sink class receives the output of template evaluation
+ */
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    /**
+     * @brief Write bytes to the sink
+     *
+     * The bytes are only valid during the call
+     *
+     * @param data Bytes to write
+     * @param size Number of bytes
+     */
+    virtual void write(const char* data, std::size_t size) = 0;
+
+    /**
+     * @brief Write bytes of the template text to the sink
+     *
+     * The bytes stay valid for as long as the template is alive, so sinks
+     * may reference them instead of copying. Defaults to write().
+     *
+     * @param data Bytes to write
+     * @param size Number of bytes
+     */
+    virtual void writeStatic(const char* data, std::size_t size);
+};
+
+/**
+ * @brief The StringSink class appends the output to a string
+ */
+class StringSink : public Sink {
+private:
+    std::string& _out;
+
+public:
+    /**
+     * @brief Construct a sink that appends to a string
+     * @param out String to append to, must outlive the sink
+     */
+    StringSink(std::string& out);
+
+    void write(const char* data, std::size_t size) override;
+};
+
+/**
+ * @brief The OstreamSink class writes the output to an ostream
+ */
+class OstreamSink : public Sink {
+private:
+    std::ostream& _os;
+
+public:
+    /**
+     * @brief Construct a sink that writes to an ostream
+     * @param os Stream to write to, must outlive the sink
+     */
+    OstreamSink(std::ostream& os);
+
+    void write(const char* data, std::size_t size) override;
+};
+
+/**
+ * @brief The CountingSink class counts the bytes written to another sink
+ */
+class CountingSink : public Sink {
+private:
+    Sink& _out;
+    std::size_t _size {0};
+
+public:
+    /**
+     * @brief Construct a sink that forwards to another sink
+     * @param out Sink to write to, must outlive this sink
+     */
+    CountingSink(Sink& out);
+
+    void write(const char* data, std::size_t size) override;
+    void writeStatic(const char* data, std::size_t size) override;
+
+    /**
+     * @brief Get the number of bytes written
+     * @return Number of bytes
+     */
+    std::size_t size() const;
+};
+
+/**
+ * @brief The BufferSink class writes the output to a fixed size buffer
+ *
+ * Output that doesn't fit in the buffer is dropped, but still counted,
+ * so the caller can retry with a buffer of required() bytes
+ */
+class BufferSink : public Sink {
+private:
+    char* _buffer;
+    std::size_t _capacity;
+    std::size_t _size {0};
+    std::size_t _required {0};
+
+public:
+    /**
+     * @brief Construct a sink that writes to a caller buffer
+     * @param buffer Buffer to write to, must outlive the sink
+     * @param capacity Size of the buffer in bytes
+     */
+    BufferSink(char* buffer, std::size_t capacity);
+
+    void write(const char* data, std::size_t size) override;
+
+    /**
+     * @brief Get the number of bytes written to the buffer
+     * @return Number of bytes
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Get the number of bytes the complete output needs
+     * @return Number of bytes
+     */
+    std::size_t required() const;
+
+    /**
+     * @brief Check if the output did not fit in the buffer
+     * @return True if output was dropped, otherwise false
+     */
+    bool overflowed() const;
+};
+
+/**
+ * @brief The IoSlice struct references a span of output bytes
+ *
+ * Same members as the POSIX struct iovec, which can be filled from it
+ */
+struct IoSlice {
+    const char* data;
+    std::size_t size;
+};
+
+/**
+ * @brief The IovecSink class collects the output as a list of slices
+ *
+ * Template text is referenced without copying. Other output is copied
+ * into a buffer owned by the sink. The slices can be passed to a single
+ * writev call.
+ */
+class IovecSink : public Sink {
+private:
+    /**
+     * @brief A collected span, either template text or a range of the buffer
+     */
+    struct Entry {
+        const char* data;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::vector<Entry> _entries;
+    std::string _buffer;
+    std::size_t _size {0};
+
+public:
+    IovecSink() = default;
+
+    void write(const char* data, std::size_t size) override;
+    void writeStatic(const char* data, std::size_t size) override;
+
+    /**
+     * @brief Get the collected output
+     *
+     * The slices reference the template and this sink, which must outlive them
+     *
+     * @return Vector of slices in output order
+     */
+    std::vector<IoSlice> slices() const;
+
+    /**
+     * @brief Get the total size of the collected output
+     * @return Number of bytes
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Remove all collected output
+     */
+    void clear();
+};
+
+} // namespace templet
+
+#endif // SINK_HPP
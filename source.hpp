@@ -0,0 +1,102 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace templet {
+
+/**
+ * @brief The Source class holds the immutable text of a template
+ *
+ * A compiled template owns its source and the text nodes reference
+ * spans of it instead of holding copies of the text
+ */
+class Source {
+public:
+    virtual ~Source() = default;
+
+    /**
+     * @brief Get the first character of the text
+     * @return Pointer to the text, valid for as long as the source lives
+     */
+    virtual const char* data() const = 0;
+
+    /**
+     * @brief Get the size of the text
+     * @return Size in bytes
+     */
+    virtual std::size_t size() const = 0;
+};
+
+using SourcePtr = std::shared_ptr<const Source>;
+
+/**
+ * @brief The StringSource class keeps the template text in a string
+ */
+class StringSource : public Source {
+private:
+    std::string _text;
+
+public:
+    /**
+     * @brief Construct a source with template text
+     * @param text Template text
+     */
+    StringSource(std::string text);
+
+    const char* data() const override;
+    std::size_t size() const override;
+};
+
+/**
+ * @brief Wrap template text in a SourcePtr
+ * @param text Text to wrap
+ * @return Text wrapped in SourcePtr
+ */
+static inline SourcePtr make_source(std::string text) {
+    return std::make_shared<StringSource>(std::move(text));
+}
+
+/**
+ * @brief Pass through a source that is already wrapped
+ *
+ * Lets code that is generic over file readers accept both strings and sources
+ *
+ * @param source Source to return
+ * @return The same source
+ */
+static inline SourcePtr make_source(SourcePtr source) {
+    return source;
+}
+
+} // namespace templet
+
+#endif // SOURCE_HPP
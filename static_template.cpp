@@ -0,0 +1,63 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "instrument.hpp"
+#include "static_template.hpp"
+
+void templet::compiletime::write_value(Sink& out, const nodes::TagPath& path, Filter filter, const Scope& scope) {
+    const auto res = path.resolve(scope);
+    if(!res) {
+        TEMPLET_INSTRUMENT(scope.options(), missingTag(scope.compiled(), path));
+        if(scope.options().strictMissingTags) {
+            throw templet::exception::MissingTagError("Tag name not found: " + path.str());
+        }
+        return;
+    }
+    else if(res->type() != types::DataType::String) {
+        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a string");
+    }
+
+    char buffer[types::textBufferSize];
+    std::size_t size = 0;
+    const auto value = res->text(buffer, size);
+    write_filtered(out, value, size, filter);
+}
+
+const templet::types::Data& templet::compiletime::loop_list(const nodes::TagPath& path, const std::string& alias,
+                                                            types::Symbol aliasSymbol, const Scope& scope) {
+    const auto res = path.resolve(scope);
+    if(!res) {
+        throw templet::exception::MissingTagError("Tag name not found: " + path.str());
+    }
+    else if(res->type() != types::DataType::List && res->type() != types::DataType::Stream) {
+        throw templet::exception::InvalidTagError("Invalid tag name: Name must reference a list");
+    }
+    else if(scope.contains(alias, aliasSymbol)) {
+        throw templet::exception::InvalidTagError("For expression alias name collides with an existing name");
+    }
+
+    return *res;
+}
@@ -0,0 +1,600 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef STATIC_TEMPLATE_HPP
+#define STATIC_TEMPLATE_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include "filters.hpp"
+#include "instrument.hpp"
+#include "nodes.hpp"
+#include "scope.hpp"
+#include "sink.hpp"
+#include "types.hpp"
+
+namespace templet {
+namespace compiletime {
+
+/**
+ * @brief The TagKind enum describes a tag found at compile time
+ */
+enum class TagKind {
+    None,       ///< No more tags, also the parent of top level tags
+    Escaped,    ///< {\ ... }
+    Value,      ///< {$ ... }
+    If,         ///< {% if ... %}
+    Elif,       ///< {% elif ... %}
+    Else,       ///< {% else %}
+    For,        ///< {% for ... as ... %}
+    End,        ///< {% endif %}, {% endfor %} or {% endcache %}
+    Unsupported, ///< {% cache ... %} or {% include ... %}, which need the runtime
+    Unknown     ///< Any other {% ... %}
+};
+
+/**
+ * @brief The Mode enum selects which nodes of a list are rendered
+ */
+enum class Mode {
+    All,            ///< Every node
+    Consequent,     ///< Nodes up to the first elif or else, the true branch of an if
+    Alternatives    ///< Only the elif and else nodes, the false branch of an if
+};
+
+/**
+ * @brief Find a character in a range of text
+ *
+ * Splits the range in halves, so the recursion depth grows with the
+ * logarithm of the size and long literals stay within the constexpr limits
+ *
+ * @param s Text
+ * @param i First position
+ * @param end Position after the range
+ * @param c Character to find
+ * @param none Value returned if not found
+ * @return Position of the character or none
+ */
+constexpr std::size_t find_in(const char* s, std::size_t i, std::size_t end, char c, std::size_t none);
+
+constexpr std::size_t first_of(std::size_t found, const char* s, std::size_t mid, std::size_t end, char c,
+                               std::size_t none) {
+    return found != none ? found : find_in(s, mid, end, c, none);
+}
+
+constexpr std::size_t find_in(const char* s, std::size_t i, std::size_t end, char c, std::size_t none) {
+    return end <= i ? none
+         : end - i == 1 ? (s[i] == c ? i : none)
+         : first_of(find_in(s, i, i + (end - i) / 2, c, none), s, i + (end - i) / 2, end, c, none);
+}
+
+/**
+ * @brief Find a character in a range of text
+ * @return Position of the character or end if not found
+ */
+constexpr std::size_t find_char(const char* s, std::size_t i, std::size_t end, char c) {
+    return find_in(s, i, end, c, end);
+}
+
+constexpr bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+constexpr std::size_t skip_space(const char* s, std::size_t i, std::size_t end) {
+    return (i < end && is_space(s[i])) ? skip_space(s, i + 1, end) : i;
+}
+
+constexpr std::size_t trim_end(const char* s, std::size_t begin, std::size_t end) {
+    return (end > begin && is_space(s[end - 1])) ? trim_end(s, begin, end - 1) : end;
+}
+
+constexpr bool starts_with(const char* s, std::size_t i, std::size_t end, const char* word) {
+    return *word == '\0' || (i < end && s[i] == *word && starts_with(s, i + 1, end, word + 1));
+}
+
+constexpr std::size_t word_length(const char* word) {
+    return *word == '\0' ? 0 : 1 + word_length(word + 1);
+}
+
+constexpr bool equals(const char* s, std::size_t i, std::size_t end, const char* word) {
+    return end - i == word_length(word) && starts_with(s, i, end, word);
+}
+
+/**
+ * @brief Checks the characters of a name, same as the runtime parser
+ */
+constexpr bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+/**
+ * @brief Checks the characters of a name expression, same as the runtime parser
+ */
+constexpr bool is_expression_char(char c) {
+    return is_name_char(c) || c == '[' || c == ']' || c == '.';
+}
+
+constexpr bool all_name_chars(const char* s, std::size_t i, std::size_t end) {
+    return i >= end || (is_name_char(s[i]) && all_name_chars(s, i + 1, end));
+}
+
+constexpr bool all_expression_chars(const char* s, std::size_t i, std::size_t end) {
+    return i >= end || (is_expression_char(s[i]) && all_expression_chars(s, i + 1, end));
+}
+
+constexpr std::size_t find_tag_at(const char* s, std::size_t open, std::size_t size);
+
+/**
+ * @brief Find the next tag, see \link helpers::find_tag \endlink
+ *
+ * A tag without a closing } is text like at runtime
+ *
+ * @return Position of the { or size if there are no more tags
+ */
+constexpr std::size_t find_tag(const char* s, std::size_t i, std::size_t size) {
+    return find_tag_at(s, find_char(s, i, size, '{'), size);
+}
+
+constexpr std::size_t find_tag_at(const char* s, std::size_t open, std::size_t size) {
+    return open == size ? size
+         : find_char(s, open + 1, size, '}') == size ? size
+         : (s[open + 1] == '$' || s[open + 1] == '%' || s[open + 1] == '\\') ? open
+         : find_tag(s, find_char(s, open + 1, size, '}') + 1, size);
+}
+
+/**
+ * @brief Get the kind of a {% tag from its keyword
+ * @param s Text
+ * @param keyword Position of the keyword
+ * @param end Position after the tag
+ * @return Kind of tag
+ */
+constexpr TagKind block_kind(const char* s, std::size_t keyword, std::size_t end) {
+    return (starts_with(s, keyword, end, "endif") || starts_with(s, keyword, end, "endfor") ||
+            starts_with(s, keyword, end, "endcache")) ? TagKind::End
+         : (starts_with(s, keyword, end, "cache") || starts_with(s, keyword, end, "include")) ? TagKind::Unsupported
+         : starts_with(s, keyword, end, "if") ? TagKind::If
+         : starts_with(s, keyword, end, "elif") ? TagKind::Elif
+         : starts_with(s, keyword, end, "else") ? TagKind::Else
+         : starts_with(s, keyword, end, "for") ? TagKind::For
+         : TagKind::Unknown;
+}
+
+constexpr TagKind tag_kind(const char* s, std::size_t open, std::size_t close) {
+    return s[open + 1] == '\\' ? TagKind::Escaped
+         : s[open + 1] == '$' ? TagKind::Value
+         : block_kind(s, skip_space(s, open + 2, close + 1), close + 1);
+}
+
+/**
+ * @brief Get the filter of a value tag
+ * @return Filter as an integer, or -1 if unknown
+ */
+constexpr int filter_index(const char* s, std::size_t begin, std::size_t end, bool present) {
+    return !present ? static_cast<int>(Filter::None)
+         : equals(s, begin, end, "html") ? static_cast<int>(Filter::Html)
+         : equals(s, begin, end, "url") ? static_cast<int>(Filter::Url)
+         : -1;
+}
+
+/**
+ * @brief Write a value, same as \link nodes::Value::evaluate \endlink
+ * @param out Sink to write to
+ * @param path Path of the value
+ * @param filter Filter to write through
+ * @param scope Values to reference
+ * @exception templet::exception::InvalidTagError if the path doesn't reference a string
+ * @exception templet::exception::MissingTagError if the path is missing in strict mode
+ */
+void write_value(Sink& out, const nodes::TagPath& path, Filter filter, const Scope& scope);
+
+/**
+ * @brief Resolve the list of a for loop, same as \link nodes::ForValue::evaluate \endlink
+ * @param path Path of the list
+ * @param alias Name bound to each item
+ * @param aliasSymbol Interned alias
+ * @param scope Values to reference
+ * @exception templet::exception::MissingTagError if the list is not found
+ * @exception templet::exception::InvalidTagError if the path is not a list or the alias is taken
+ * @return List or stream
+ */
+const types::Data& loop_list(const nodes::TagPath& path, const std::string& alias, types::Symbol aliasSymbol,
+                             const Scope& scope);
+
+/**
+ * @brief Call a function for each item of a list or a stream
+ *
+ * Items of a stream are released before the next one is made
+ *
+ * @param list List or stream
+ * @param fn Function to call with a pointer to each item
+ */
+template <class Function>
+void for_each_item(const types::Data& list, Function fn) {
+    if(list.type() == types::DataType::Stream) {
+        const auto next = list.stream();
+        auto item = next();
+        while(item) {
+            fn(item.get());
+            item.reset();
+            item = next();
+        }
+        return;
+    }
+
+    const auto size = list.listSize();
+    for(std::size_t i = 0; i < size; ++i) {
+        fn(list.listItem(i));
+    }
+}
+
+/**
+ * @brief A name in the literal, built once on first use
+ */
+template <class L, std::size_t Begin, std::size_t End>
+struct Name {
+    /**
+     * @brief Get the name as a tag path
+     * @exception templet::exception::InvalidTagError if the expression has invalid syntax
+     * @return Tag path
+     */
+    static const nodes::TagPath& path() {
+        static const nodes::TagPath value(std::string(L::str() + Begin, End - Begin));
+        return value;
+    }
+
+    static const std::string& str() {
+        static const std::string value(L::str() + Begin, End - Begin);
+        return value;
+    }
+
+    static types::Symbol symbol() {
+        static const types::Symbol value = types::intern(str());
+        return value;
+    }
+};
+
+template <class L, TagKind Parent, std::size_t Pos>
+struct Nodes;
+
+/**
+ * @brief A tag in the literal, specialized for each kind of tag
+ *
+ * The primary template is an unknown or unsupported {% tag
+ */
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close, TagKind Kind>
+struct Tag {
+    static_assert(Kind != TagKind::Unknown, "Unknown tag type: No parser available for this tag");
+    static_assert(Kind != TagKind::Unsupported, "Cache and include tags are not supported in static templates");
+
+    static const std::size_t end = Close + 1;
+
+    template <Mode M>
+    static void render(Sink&, const Scope&) {}
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::None> {
+    static const std::size_t end = Open;
+
+    template <Mode M>
+    static void render(Sink&, const Scope&) {}
+};
+
+// An end tag closes the parent block, at the top level it ends the
+// template like the runtime tokenizer does
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::End> {
+    static const std::size_t end = Close + 1;
+
+    template <Mode M>
+    static void render(Sink&, const Scope&) {}
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::Escaped> {
+    using Rest = Nodes<L, Parent, Close + 1>;
+    static const std::size_t end = Rest::end;
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M != Mode::Alternatives) {
+            // Ignored tag, the first \ after the opening character is removed
+            out.writeStatic(L::str() + Open, 1);
+            out.writeStatic(L::str() + Open + 2, Close - Open - 1);
+        }
+        Rest::template render<M>(out, scope);
+    }
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::Value> {
+    static const std::size_t begin = skip_space(L::str(), Open + 2, Close);
+    static const std::size_t last = trim_end(L::str(), begin, Close);
+    static const std::size_t bar = find_char(L::str(), begin, last, '|');
+    static const std::size_t nameEnd = trim_end(L::str(), begin, bar);
+    static const int filter = filter_index(L::str(), skip_space(L::str(), bar + 1, last), last, bar != last);
+
+    static_assert(all_expression_chars(L::str(), begin, nameEnd), "Variable tag name contains invalid characters");
+    static_assert(filter >= 0, "Unknown filter");
+
+    using Rest = Nodes<L, Parent, Close + 1>;
+    static const std::size_t end = Rest::end;
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M != Mode::Alternatives) {
+            write_value(out, Name<L, begin, nameEnd>::path(), static_cast<Filter>(filter), scope);
+        }
+        Rest::template render<M>(out, scope);
+    }
+};
+
+/**
+ * @brief The parts of a {% %} tag shared by the block tags
+ */
+template <class L, std::size_t Open, std::size_t Close>
+struct BlockTag {
+    static_assert(Close >= Open + 3 && L::str()[Close - 1] == '%', "Tag must be enclosed with {% and %}");
+
+    static const std::size_t keyword = skip_space(L::str(), Open + 2, Close + 1);
+    static const std::size_t last = trim_end(L::str(), keyword, find_char(L::str(), Open + 2, Close + 1, '%'));
+};
+
+/**
+ * @brief An if or elif block
+ */
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close, TagKind Kind>
+struct ConditionTag : BlockTag<L, Open, Close> {
+    using Block = BlockTag<L, Open, Close>;
+    static const std::size_t begin = skip_space(L::str(), Block::keyword + (Kind == TagKind::If ? 3 : 5), Block::last);
+
+    static_assert(starts_with(L::str(), Block::keyword, Block::last, Kind == TagKind::If ? "if " : "elif "),
+                  "Tag must be prefixed with 'if ' or 'elif '");
+    static_assert(all_expression_chars(L::str(), begin, Block::last),
+                  "If expression tag name contains invalid characters");
+
+    using Children = Nodes<L, Kind, Close + 1>;
+    using Rest = Nodes<L, Parent, Children::end>;
+    static const std::size_t end = Rest::end;
+
+    static void renderBlock(Sink& out, const Scope& scope) {
+        if(Name<L, begin, Block::last>::path().resolve(scope)) {
+            Children::template render<Mode::Consequent>(out, scope);
+        }
+        else {
+            Children::template render<Mode::Alternatives>(out, scope);
+        }
+    }
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::If> : ConditionTag<L, Parent, Open, Close, TagKind::If> {
+    using Condition = ConditionTag<L, Parent, Open, Close, TagKind::If>;
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M != Mode::Alternatives) {
+            Condition::renderBlock(out, scope);
+        }
+        Condition::Rest::template render<M>(out, scope);
+    }
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::Elif> : ConditionTag<L, Parent, Open, Close, TagKind::Elif> {
+    using Condition = ConditionTag<L, Parent, Open, Close, TagKind::Elif>;
+
+    static_assert(Parent == TagKind::If || Parent == TagKind::Elif,
+                  "ELIF statements cannot be declared without a preceding IF statement");
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M == Mode::Consequent) {
+            return;
+        }
+        Condition::renderBlock(out, scope);
+        Condition::Rest::template render<M>(out, scope);
+    }
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::Else> : BlockTag<L, Open, Close> {
+    static_assert(Parent == TagKind::If || Parent == TagKind::Elif,
+                  "ELSE statements cannot be declared without a preceding IF statement");
+
+    using Children = Nodes<L, TagKind::Else, Close + 1>;
+    using Rest = Nodes<L, Parent, Children::end>;
+    static const std::size_t end = Rest::end;
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M == Mode::Consequent) {
+            return;
+        }
+        Children::template render<Mode::All>(out, scope);
+        Rest::template render<M>(out, scope);
+    }
+};
+
+template <class L, TagKind Parent, std::size_t Open, std::size_t Close>
+struct Tag<L, Parent, Open, Close, TagKind::For> : BlockTag<L, Open, Close> {
+    using Block = BlockTag<L, Open, Close>;
+    // {% for name as alias %} with single spaces between the words
+    static const std::size_t begin = Block::keyword + 4;
+    static const std::size_t nameEnd = find_char(L::str(), begin, Block::last, ' ');
+    static const std::size_t alias = nameEnd + 4;
+
+    static_assert(starts_with(L::str(), Block::keyword, Block::last, "for ") &&
+                  starts_with(L::str(), nameEnd, Block::last, " as ") &&
+                  find_char(L::str(), alias, Block::last, ' ') == Block::last,
+                  "Unrecognized for expression syntax");
+    static_assert(all_expression_chars(L::str(), begin, nameEnd),
+                  "For expression first tag name contains invalid characters");
+    static_assert(all_name_chars(L::str(), alias, Block::last),
+                  "For expression second tag name contains invalid characters");
+
+    using Children = Nodes<L, TagKind::For, Close + 1>;
+    using Rest = Nodes<L, Parent, Children::end>;
+    static const std::size_t end = Rest::end;
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M != Mode::Alternatives) {
+            const auto& name = Name<L, alias, Block::last>::str();
+            const auto& list = loop_list(Name<L, begin, nameEnd>::path(), name,
+                                        Name<L, alias, Block::last>::symbol(), scope);
+            Scope itemScope(scope, name);
+            const HookTimer timer(scope.options().instrumentation);
+            std::size_t items = 0;
+            for_each_item(list, [&](const types::Data* item) {
+                itemScope.bind(item);
+                Children::template render<Mode::All>(out, itemScope);
+                ++items;
+            });
+            TEMPLET_INSTRUMENT(scope.options(),
+                               loopFinished(scope.compiled(), Name<L, begin, nameEnd>::path(), items, timer.elapsed()));
+        }
+        Rest::template render<M>(out, scope);
+    }
+};
+
+/**
+ * @brief The nodes of the literal from a position up to an end tag or the end
+ */
+template <class L, TagKind Parent, std::size_t Pos>
+struct Nodes {
+    static const std::size_t size = L::size();
+    static const std::size_t open = find_tag(L::str(), Pos, size);
+    static const std::size_t close = open == size ? size : find_char(L::str(), open + 1, size, '}');
+    static const TagKind kind = open == size ? TagKind::None : tag_kind(L::str(), open, close);
+
+    using Next = Tag<L, Parent, open, close, kind>;
+    static const std::size_t end = Next::end;
+
+    template <Mode M>
+    static void render(Sink& out, const Scope& scope) {
+        if(M != Mode::Alternatives && open > Pos) {
+            out.writeStatic(L::str() + Pos, open - Pos);
+        }
+        Next::template render<M>(out, scope);
+    }
+};
+
+} // namespace compiletime
+
+/**
+ * @brief The StaticTemplate class renders a template parsed at compile time
+ *
+ * The template text is a string literal wrapped in a type with static
+ * str() and size() functions, see \link TEMPLET_STATIC_TEMPLATE \endlink.
+ * The tags are parsed by the compiler into nested types, so rendering
+ * does no tokenizing and no node dispatch, and invalid tags are compile
+ * errors. The grammar and the output match \link tokenize \endlink, except
+ * that cache blocks and includes are compile errors, and only the syntax
+ * inside [] of a name is checked when it is first rendered.
+ *
+ * Example usage:
+ *
+ * TEMPLET_STATIC_TEMPLATE(Greeting, "Hello, {$name}!");\n
+ * std::cout << Greeting::render(data);
+ */
+template <class L>
+class StaticTemplate {
+private:
+    using Root = compiletime::Nodes<L, compiletime::TagKind::None, 0>;
+
+public:
+    /**
+     * @brief Render the template into a sink
+     * @param scope Values to reference and the render options
+     * @param out Sink to write to
+     * @exception templet::exception::InvalidTagError if the values don't match the template
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    static void render(const Scope& scope, Sink& out) {
+        Root::template render<compiletime::Mode::All>(out, scope);
+    }
+
+    /**
+     * @brief Render the template and append it to a string
+     * @param scope Values to reference and the render options
+     * @param out String to append to
+     */
+    static void render(const Scope& scope, std::string& out) {
+        StringSink sink(out);
+        render(scope, sink);
+    }
+
+    /**
+     * @brief Render the template to an ostream
+     * @param scope Values to reference and the render options
+     * @param os Stream to write to
+     */
+    static void render(const Scope& scope, std::ostream& os) {
+        OstreamSink sink(os);
+        render(scope, sink);
+    }
+
+    /**
+     * @brief Render the template into a string
+     * @param scope Values to reference and the render options
+     * @return Rendered template
+     */
+    static std::string render(const Scope& scope) {
+        std::string result;
+        render(scope, result);
+        return result;
+    }
+
+    /**
+     * @brief Get the template text
+     * @return Template text
+     */
+    static const char* text() {
+        return L::str();
+    }
+};
+
+} // namespace templet
+
+/**
+ * @brief Declare a template that is parsed at compile time
+ *
+ * Declares the type Name as a \link templet::StaticTemplate \endlink of
+ * the literal, at namespace or at function scope
+ *
+ * @param Name Name of the declared type
+ * @param literal Template text, must be a string literal
+ */
+#define TEMPLET_STATIC_TEMPLATE(Name, literal) \
+    struct Name##Literal { \
+        static constexpr const char* str() { return literal; } \
+        static constexpr std::size_t size() { return sizeof(literal) - 1; } \
+    }; \
+    using Name = ::templet::StaticTemplate<Name##Literal>
+
+#endif // STATIC_TEMPLATE_HPP
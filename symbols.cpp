@@ -0,0 +1,82 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include "symbols.hpp"
+
+using namespace templet::types;
+
+namespace {
+
+/**
+ * @brief The SymbolTable struct maps names to symbols and back
+ */
+struct SymbolTable {
+    std::mutex mutex;
+    std::unordered_map<std::string, Symbol> symbols;
+    // A deque keeps references to the names valid while it grows
+    std::deque<std::string> names;
+};
+
+SymbolTable& table() {
+    static SymbolTable instance;
+    return instance;
+}
+
+} // unnamed namespace
+
+Symbol templet::types::intern(const std::string& name) {
+    auto& symbols = table();
+    std::lock_guard<std::mutex> lock(symbols.mutex);
+    const auto it = symbols.symbols.find(name);
+    if(it != symbols.symbols.end()) {
+        return it->second;
+    }
+
+    symbols.names.push_back(name);
+    const auto symbol = static_cast<Symbol>(symbols.names.size());
+    symbols.symbols.emplace(name, symbol);
+    return symbol;
+}
+
+Symbol templet::types::find_symbol(const std::string& name) {
+    auto& symbols = table();
+    std::lock_guard<std::mutex> lock(symbols.mutex);
+    const auto it = symbols.symbols.find(name);
+    return (it != symbols.symbols.end()) ? it->second : invalidSymbol;
+}
+
+const std::string& templet::types::symbol_name(Symbol symbol) {
+    auto& symbols = table();
+    std::lock_guard<std::mutex> lock(symbols.mutex);
+    if(symbol == invalidSymbol || symbol > symbols.names.size()) {
+        throw std::out_of_range("Unknown symbol");
+    }
+    return symbols.names[symbol - 1];
+}
@@ -0,0 +1,76 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 https://github.com/labyrinthofdreams
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace templet {
+namespace types {
+
+/**
+ * @brief An interned name, equal names have equal symbols
+ *
+ * Symbols are never released and stay valid until the program exits
+ */
+using Symbol = std::uint32_t;
+
+/**
+ * @brief Symbol that no name interns to
+ */
+const Symbol invalidSymbol = 0;
+
+/**
+ * @brief Intern a name in the global symbol table
+ *
+ * Thread safe, the table is guarded by a mutex
+ *
+ * @param name Name to intern
+ * @return Symbol of the name
+ */
+Symbol intern(const std::string& name);
+
+/**
+ * @brief Find the symbol of a name without interning it
+ * @param name Name to find
+ * @return Symbol of the name, or invalidSymbol if it was never interned
+ */
+Symbol find_symbol(const std::string& name);
+
+/**
+ * @brief Get the name of a symbol
+ * @param symbol Interned symbol
+ * @exception std::out_of_range if the symbol was not returned by intern()
+ * @return Name of the symbol
+ */
+const std::string& symbol_name(Symbol symbol);
+
+} // namespace types
+} // namespace templet
+
+#endif // SYMBOLS_HPP
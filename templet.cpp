@@ -28,6 +28,7 @@ THE SOFTWARE.
 #include <memory>
 #include <utility>
 #include "nodes.hpp"
+#include "scanner.hpp"
 #include "strutils.hpp"
 #include "templet.hpp"
 #include "trim.hpp"
@@ -41,91 +42,134 @@ namespace {
  * @brief Return a node for a given tag
  * @param tagName Name of the tag
  * @param fromTag Complete tag to parse
+ * @param arena Arena that owns the node
  * @return Parsed tag as a node
  */
-std::shared_ptr<Node> factory_tag_parser(const std::string& tagName, const std::string& fromTag) {
+Node* factory_tag_parser(const std::string& tagName, const std::string& fromTag, NodeArena& arena) {
     if(mylib::starts_with(tagName, "if")) {
-        return templet::nodes::parse_ifvalue_tag(fromTag);
+        return templet::nodes::parse_ifvalue_tag(fromTag, arena);
     }
     else if(mylib::starts_with(tagName, "elif")) {
-        return templet::nodes::parse_elifvalue_tag(fromTag);
+        return templet::nodes::parse_elifvalue_tag(fromTag, arena);
     }
     else if(mylib::starts_with(tagName, "else")) {
-        return std::make_shared<templet::nodes::ElseValue>();
+        return arena.create<templet::nodes::ElseValue>();
     }
     else if(mylib::starts_with(tagName, "for")) {
-        return templet::nodes::parse_forvalue_tag(fromTag);
+        return templet::nodes::parse_forvalue_tag(fromTag, arena);
+    }
+    else if(mylib::starts_with(tagName, "cache")) {
+        return templet::nodes::parse_cache_tag(fromTag, arena);
     }
     else {
         throw templet::exception::InvalidTagError("Unknown tag type: No parser available for this tag");
     }
 }
 
+/**
+ * @brief Nodes returned by the shared pointer version of tokenize
+ *
+ * Every returned node shares ownership of the whole tree
+ */
+struct TokenizedTree {
+    SourcePtr source;
+    NodeArena arena;
+};
+
 }
 
 namespace templet {
 
-std::vector<std::shared_ptr<nodes::Node> > tokenize(std::string &in) try {
-    std::vector<std::shared_ptr<nodes::Node> > nodes;
-    while(!in.empty()) {
-        // Parse TEXT until first TAG
-        const auto pos = in.find('{');
-        if(pos == std::string::npos) {
-           if(!in.empty()) {
-               // Plain text
-               nodes.push_back(std::make_shared<Text>(in));
-               in.clear();
-           }
-           break;
+nodes::NodeRange tokenize(const SourcePtr& source, nodes::NodeArena& arena) try {
+    const char* const text = source->data();
+    const std::size_t size = source->size();
+
+    // Nodes waiting for their parent block to close are kept on one
+    // stack, each open if/for block has a frame that remembers where
+    // its children start. The bottom frame collects the top level nodes
+    struct Frame {
+        Node* node;
+        std::size_t first;
+    };
+    std::vector<Frame> frames(1, Frame {nullptr, 0});
+    std::vector<Node*> pending;
+
+    const auto moveToArena = [&](std::size_t first) {
+        const auto count = pending.size() - first;
+        auto children = arena.allocateArray<Node*>(count);
+        std::copy(pending.begin() + first, pending.end(), children);
+        pending.resize(first);
+        return NodeRange(children, count);
+    };
+    const auto addText = [&](std::size_t pos, std::size_t len) {
+        pending.push_back(arena.create<Text>(text + pos, len));
+    };
+    const auto closeFrame = [&]() {
+        const auto frame = frames.back();
+        frames.pop_back();
+        frame.node->setChildren(moveToArena(frame.first));
+        pending.push_back(frame.node);
+    };
+
+    std::size_t pos = 0;
+    while(pos < size) {
+        // Parse TEXT until first TAG, braces that don't open a tag are
+        // skipped by the scanner and stay part of the text
+        const auto span = helpers::find_tag(text, pos, size);
+        if(span.open == size) {
+            // Plain text
+            addText(pos, size - pos);
+            break;
         }
-        nodes.push_back(std::make_shared<Text>(in.substr(0, pos)));
-        in.erase(0, pos);
-
-        // Find where the tag ends
-        const auto end_pos = in.find('}');
-        if(end_pos == std::string::npos) {
-           // Plain text
-           nodes.push_back(std::make_shared<Text>(in));
-           in.clear();
-           break;
+        const std::size_t tag_pos = span.open;
+        addText(pos, tag_pos - pos);
+
+        if(span.close == std::string::npos) {
+            // Plain text
+            addText(tag_pos, size - tag_pos);
+            break;
         }
 
-        const auto tag = in.substr(0, end_pos + 1);
+        const char* const open = text + tag_pos;
+        const std::size_t tag_size = span.close - tag_pos + 1;
+        pos = tag_pos + tag_size;
         // Parse tag
-        if(tag[1] == '\\') {
+        if(open[1] == '\\') {
             // Ignored tag, remove the first \ after opening tag character
-            auto new_tag = tag.substr(2);
-            new_tag.insert(0, "{");
-            nodes.push_back(std::make_shared<Text>(new_tag));
-            in.erase(0, tag.size());
+            addText(tag_pos, 1);
+            addText(tag_pos + 2, tag_size - 2);
         }
-        else if(tag[1] == '$') {
-            auto node = templet::nodes::parse_value_tag(tag);
-            in.erase(0, tag.size());
-            nodes.push_back(std::move(node));
+        else if(open[1] == '$') {
+            pending.push_back(templet::nodes::parse_value_tag(std::string(open, tag_size), arena));
         }
-        else if(tag[1] == '%') {
+        else {
+            const std::string tag(open, tag_size);
             const auto inner = mylib::ltrimmed(tag.substr(2));
             // adding endif and endfor as nodes it would be possible
             // to check whether an if/for node was closed properly
             // and throw an exception if not
-            if(mylib::starts_with(inner, "endif") || mylib::starts_with(inner, "endfor")) {
-                in.erase(0, tag.size());
-                break;
+            if(mylib::starts_with(inner, "include ")) {
+                pending.push_back(templet::nodes::parse_include_tag(tag, arena));
+            }
+            else if(mylib::starts_with(inner, "endif") || mylib::starts_with(inner, "endfor") ||
+                    mylib::starts_with(inner, "endcache")) {
+                if(frames.size() == 1) {
+                    break;
+                }
+                closeFrame();
             }
             else {
-                auto node = factory_tag_parser(inner, tag);
-                in.erase(0, tag.size());
-                node->setChildren(::tokenize(in));
-                nodes.push_back(std::move(node));
+                frames.push_back(Frame {factory_tag_parser(inner, tag, arena), pending.size()});
             }
         }
-        else {
-            nodes.push_back(std::make_shared<Text>(tag));
-            in.erase(0, tag.size());
-        }
     }
-    return nodes;
+
+    // Blocks left open at the end of the template are closed implicitly
+    while(frames.size() > 1) {
+        closeFrame();
+    }
+
+    return moveToArena(0);
 }
 catch(const templet::exception::InvalidTagError& ex) {
     throw;
@@ -134,10 +178,70 @@ catch(...) {
     throw;
 }
 
+std::vector<std::shared_ptr<nodes::Node> > tokenize(const SourcePtr& source) {
+    auto tree = std::make_shared<TokenizedTree>();
+    tree->source = source;
+    const auto range = tokenize(tree->source, tree->arena);
+
+    std::vector<std::shared_ptr<nodes::Node> > nodes;
+    for(auto node : range) {
+        nodes.push_back(std::shared_ptr<Node>(tree, node));
+    }
+    return nodes;
+}
+
+std::vector<std::shared_ptr<nodes::Node> > tokenize(std::string &in) {
+    auto source = make_source(std::move(in));
+    in.clear();
+    return tokenize(source);
+}
+
 void parse(std::string text, const templet::DataMap &values, std::ostream& os) try {
+    OstreamSink out(os);
+    parse(std::move(text), values, out, RenderOptions());
+}
+catch(const templet::exception::InvalidTagError& ex) {
+    throw;
+}
+catch(const templet::exception::MissingTagError& ex) {
+    throw;
+}
+catch(...) {
+    throw;
+}
+
+void parse(std::string text, const templet::DataMap &values, std::ostream& os, const RenderOptions& options) try {
+    OstreamSink out(os);
+    parse(std::move(text), values, out, options);
+}
+catch(const templet::exception::InvalidTagError& ex) {
+    throw;
+}
+catch(const templet::exception::MissingTagError& ex) {
+    throw;
+}
+catch(...) {
+    throw;
+}
+
+void parse(std::string text, const templet::DataMap &values, Sink& out) try {
+    parse(std::move(text), values, out, RenderOptions());
+}
+catch(const templet::exception::InvalidTagError& ex) {
+    throw;
+}
+catch(const templet::exception::MissingTagError& ex) {
+    throw;
+}
+catch(...) {
+    throw;
+}
+
+void parse(std::string text, const templet::DataMap &values, Sink& out, const RenderOptions& options) try {
     auto nodes = tokenize(text);
+    const Scope scope(values, options);
     for(const auto& node : nodes) {
-        node->evaluate(os, values);
+        node->evaluate(out, scope);
     }
 }
 catch(const templet::exception::InvalidTagError& ex) {
@@ -151,53 +255,96 @@ catch(...) {
 }
 
 Templet::Templet(std::string text)
-    : _text(std::move(text)),
+    : _source(make_source(std::move(text))),
       _parsed(),
-      _nodes()
+      _compiled()
 {}
 
-Templet::Templet(const Templet &other) : _text(other._text),
-    _parsed(other._parsed.str()),
-    _nodes(other._nodes)
+Templet::Templet(const Templet &other) : _source(other._source),
+    _parsed(other._parsed),
+    _compiled(other._compiled),
+    _reused(other._reused),
+    _options(other._options)
 {}
 
-Templet::Templet(Templet &&other) : _text(std::move(other._text)),
-    _parsed(other._parsed.str()),
-    _nodes(std::move(other._nodes))
+Templet::Templet(Templet &&other) : _source(std::move(other._source)),
+    _parsed(std::move(other._parsed)),
+    _compiled(std::move(other._compiled)),
+    _reused(other._reused),
+    _options(other._options)
 {}
 
 Templet& Templet::operator=(const Templet &other) {
-    _parsed.str(other._parsed.str());
-    _nodes = other._nodes;
+    _source = other._source;
+    _parsed = other._parsed;
+    _compiled = other._compiled;
+    _reused = other._reused;
+    _options = other._options;
 
     return *this;
 }
 
 Templet& Templet::operator=(Templet &&other) {
-    _parsed.str(other._parsed.str());
-    _nodes = std::move(other._nodes);
+    _source = std::move(other._source);
+    _parsed = std::move(other._parsed);
+    _compiled = std::move(other._compiled);
+    _reused = other._reused;
+    _options = other._options;
 
     return *this;
 }
 
 void Templet::reset() {
-    _parsed.str("");
-    _nodes.clear();
+    _parsed.clear();
+    _compiled.reset();
+    _reused = false;
 }
 
 void Templet::setTemplate(std::string str) {
-    _text.swap(str);
+    _source = make_source(std::move(str));
+    reset();
+}
+
+void Templet::setTemplate(SourcePtr source) {
+    _source = std::move(source);
     reset();
 }
 
+void Templet::setOptions(RenderOptions options) {
+    _options = options;
+}
+
+const RenderOptions& Templet::options() const {
+    return _options;
+}
+
+void Templet::compile() {
+    if(_compiled) {
+        return;
+    }
+
+    _compiled = make_compiled(_source);
+}
+
+CompiledTemplatePtr Templet::compiled() {
+    compile();
+    return _compiled;
+}
+
+bool Templet::isCompiled() const {
+    return _compiled != nullptr;
+}
+
+bool Templet::reusedCompiled() const {
+    return _reused;
+}
+
 std::string Templet::parse(const DataMap &values) {
     try {
-        reset();
-        auto copied = _text;
-        _nodes = ::tokenize(copied);
-        for(const auto& node : _nodes) {
-            node->evaluate(_parsed, values);
-        }
+        _reused = isCompiled();
+        compile();
+        _parsed.clear();
+        _compiled->render(values, _parsed, _options);
     }
     catch(const templet::exception::InvalidTagError& ex) {
         throw;
@@ -212,8 +359,25 @@ std::string Templet::parse(const DataMap &values) {
     return result();
 }
 
+void Templet::parse(const DataMap &values, Sink& out) {
+    try {
+        _reused = isCompiled();
+        compile();
+        _compiled->render(values, out, _options);
+    }
+    catch(const templet::exception::InvalidTagError& ex) {
+        throw;
+    }
+    catch(const templet::exception::MissingTagError& ex) {
+        throw;
+    }
+    catch(...) {
+        throw;
+    }
+}
+
 std::string Templet::result() const {
-    return _parsed.str();
+    return _parsed;
 }
 
 } // namespace templet
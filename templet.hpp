@@ -27,12 +27,18 @@ THE SOFTWARE.
 #ifndef TEMPLET_HPP
 #define TEMPLET_HPP
 
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <string>
 #include <sstream>
 #include <vector>
+#include <sys/stat.h>
+#include "compiled.hpp"
 #include "nodes.hpp"
+#include "options.hpp"
+#include "sink.hpp"
+#include "source.hpp"
 #include "types.hpp"
 
 namespace templet {
@@ -59,6 +65,30 @@ struct FileReader {
 
         return ss.str();
     }
+
+    /**
+     * @brief Get the modification time of a file
+     *
+     * Uses nanosecond resolution where the platform has it
+     *
+     * @param path Path to file
+     * @exception std::runtime_error Thrown if file can't be found
+     * @return Modification time in an unspecified unit
+     */
+    static std::int64_t lastModified(const std::string& path) {
+        struct stat info;
+        if(::stat(path.c_str(), &info) != 0) {
+            throw std::runtime_error("File not found: " + path);
+        }
+
+        std::int64_t stamp = static_cast<std::int64_t>(info.st_mtime) * 1000000000;
+#if defined(__linux__)
+        stamp += info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+        stamp += info.st_mtimespec.tv_nsec;
+#endif
+        return stamp;
+    }
 };
 
 /**
@@ -97,12 +127,16 @@ struct FileWriter {
  * templet::Templet tpl("Hello, {$first_name} {$last_name}!");\n
  * std::cout << tpl.parse(data); // Outputs: "Hello, John Doe!"
  *
+ * A Templet object stores the last result and must not be used by several
+ * threads at once. Use compiled() to get the thread safe compiled template.
  */
 class Templet {
 private:
-    std::string _text;
-    std::stringstream _parsed;
-    std::vector<std::shared_ptr<nodes::Node>> _nodes;
+    SourcePtr _source;
+    std::string _parsed;
+    CompiledTemplatePtr _compiled;
+    bool _reused {false};
+    RenderOptions _options;
 
     /**
      * @brief Reset internal state
@@ -139,6 +173,9 @@ public:
 
     /**
      * @brief Set template from file
+     *
+     * FileReaderT::fromFile may return the contents as a string or a SourcePtr
+     *
      * @param path Path to file
      * @exception std::runtime_error if file can't be opened
      */
@@ -154,14 +191,82 @@ public:
      */
     void setTemplate(std::string str);
 
+    /**
+     * @brief Set template from a source, e.g. a memory mapped file
+     * @param source Template source
+     */
+    void setTemplate(SourcePtr source);
+
+    /**
+     * @brief Set the options used by parse()
+     * @param options Render options
+     */
+    void setOptions(RenderOptions options);
+
+    /**
+     * @brief Get the options used by parse()
+     * @return Render options
+     */
+    const RenderOptions& options() const;
+
+    /**
+     * @brief Tokenize the template text into a node tree
+     *
+     * The node tree is cached until the template text changes, so calling
+     * this more than once is cheap. parse() calls it on demand.
+     *
+     * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+     */
+    void compile();
+
+    /**
+     * @brief Get the compiled template, compiling it if needed
+     *
+     * The compiled template is immutable and shared by copies of this
+     * object, it can be rendered from any number of threads at once
+     *
+     * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+     * @return Compiled template
+     */
+    CompiledTemplatePtr compiled();
+
+    /**
+     * @brief Check if the node tree for the current template is cached
+     * @return True if compiled, otherwise false
+     */
+    bool isCompiled() const;
+
+    /**
+     * @brief Check if the last call to parse() reused a cached node tree
+     * @return True if the node tree was reused, otherwise false
+     */
+    bool reusedCompiled() const;
+
     /**
      * @brief Parse the template and return parsed result as a string
+     *
+     * The template is tokenized on the first call only, following calls
+     * evaluate the cached node tree with the new values.
+     *
      * @param values Map of key-value pairs for parsing the template
      * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
      * @return Parsed template as a string
      */
     std::string parse(const templet::DataMap& values);
 
+    /**
+     * @brief Parse the template and write the parsed result to a sink
+     *
+     * The result is not stored, result() is left unchanged
+     *
+     * @param values Map of key-value pairs for parsing the template
+     * @param out Sink to write to
+     * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+     * @exception templet::exception::MissingTagError if a tag is missing in strict mode
+     */
+    void parse(const templet::DataMap& values, Sink& out);
+
     /**
      * @brief result
      * @return Parsed template as a string
@@ -169,8 +274,38 @@ public:
     std::string result() const;
 };
 
+/**
+ * @brief Tokenize a template source into nodes owned by an arena
+ *
+ * The source is scanned once from start to end. Text nodes reference
+ * spans of the source, so the source must outlive the arena.
+ *
+ * @param source Template source to tokenize
+ * @param arena Arena that owns the nodes
+ * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+ * @exception std::exception for any stdlib exceptions
+ * @return Range of the top level nodes, owned by the arena
+ */
+nodes::NodeRange tokenize(const SourcePtr& source, nodes::NodeArena& arena);
+
+/**
+ * @brief Tokenize a template source into a vector of nodes
+ *
+ * The nodes are allocated in one arena, each returned pointer shares
+ * the ownership of the arena and the source.
+ *
+ * @param source Template source to tokenize
+ * @exception templet::exception::InvalidTagError if the template contains an invalid tag
+ * @exception std::exception for any stdlib exceptions
+ * @return Vector of tokenized nodes
+ */
+std::vector<std::shared_ptr<nodes::Node>> tokenize(const SourcePtr& source);
+
 /**
  * @brief Tokenize a string into a vector of nodes
+ *
+ * The string is moved into the source of the nodes and left empty
+ *
  * @param in String to tokenize
  * @exception templet::exception::InvalidTagError if the template contains an invalid tag
  * @exception std::exception for any stdlib exceptions
@@ -189,6 +324,38 @@ std::vector<std::shared_ptr<nodes::Node>> tokenize(std::string &in);
  */
 void parse(std::string text, const templet::DataMap &values, std::ostream& os);
 
+/**
+ * @brief Parse a string with some values
+ * @param text String to parse
+ * @param values Substitution values
+ * @param os Output
+ * @param options Render options
+ * @exception templet::exception::InvalidTagError
+ * @exception templet::exception::MissingTagError
+ */
+void parse(std::string text, const templet::DataMap &values, std::ostream& os, const RenderOptions& options);
+
+/**
+ * @brief Parse a string with some values
+ * @param text String to parse
+ * @param values Substitution values
+ * @param out Output
+ * @exception templet::exception::InvalidTagError
+ * @exception templet::exception::MissingTagError
+ */
+void parse(std::string text, const templet::DataMap &values, Sink& out);
+
+/**
+ * @brief Parse a string with some values
+ * @param text String to parse
+ * @param values Substitution values
+ * @param out Output
+ * @param options Render options
+ * @exception templet::exception::InvalidTagError
+ * @exception templet::exception::MissingTagError
+ */
+void parse(std::string text, const templet::DataMap &values, Sink& out, const RenderOptions& options);
+
 } // namespace templet
 
 #endif // TEMPLET_HPP
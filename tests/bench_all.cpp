@@ -0,0 +1,298 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "benchmark/benchmark.h"
+#include "compiled.hpp"
+#include "pool.hpp"
+#include "static_template.hpp"
+#include "templet.hpp"
+
+using namespace templet;
+
+//
+// Workloads
+//
+// Benchmarks that take an engine argument compare the renderers:
+// 0 runs the compiled program, 1 walks the node tree of the compiled
+// template and 2 is the original path that tokenizes on every render
+//
+
+namespace {
+
+enum Engine {
+    ProgramEngine,
+    NodeTreeEngine,
+    ParseEngine
+};
+
+const char* engine_name(int engine) {
+    switch(engine) {
+    case ProgramEngine:
+        return "program";
+    case NodeTreeEngine:
+        return "node tree";
+    default:
+        return "parse";
+    }
+}
+
+/**
+ * @brief Render a template with one of the engines
+ */
+std::size_t render(int engine, const std::string& text, const CompiledTemplatePtr& compiled,
+                   const DataMap& map, std::string& out) {
+    out.clear();
+    if(engine == ParseEngine) {
+        StringSink sink(out);
+        parse(text, map, sink);
+    }
+    else {
+        RenderOptions options;
+        options.useNodeTree = engine == NodeTreeEngine;
+        compiled->render(map, out, options);
+    }
+    return out.size();
+}
+
+void set_rates(benchmark::State& state, std::size_t bytes) {
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * bytes));
+    state.counters["renders"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                   benchmark::Counter::kIsRate);
+}
+
+/**
+ * @brief A page of mostly static markup with a few values, about 1 MB
+ */
+std::string static_page() {
+    std::string text;
+    for(int i = 0; i < 10000; ++i) {
+        text += "<div class=\"row\"><p>Lorem ipsum dolor sit amet, consectetur adipiscing elit.</p>{x}";
+        if(i % 100 == 0) {
+            text += "{$ title }{% if flag %}<b>on</b>{% endif %}";
+        }
+        text += "</div>\n";
+    }
+    return text;
+}
+
+DataMap static_page_values() {
+    DataMap map;
+    map["title"] = make_data("Title");
+    map["flag"] = make_data("1");
+    return map;
+}
+
+/**
+ * @brief Values for a list of rows with a list of cells each
+ */
+DataMap table_values(std::size_t items, std::size_t cells) {
+    DataVector rows;
+    rows.reserve(items / cells);
+    for(std::size_t i = 0; i < items / cells; ++i) {
+        DataVector row;
+        for(std::size_t j = 0; j < cells; ++j) {
+            row.push_back(make_data(std::to_string(j)));
+        }
+        DataMap entry;
+        entry["cells"] = make_data(std::move(row));
+        entry["id"] = make_data(std::to_string(i));
+        rows.push_back(make_data(std::move(entry)));
+    }
+    DataMap map;
+    map["rows"] = make_data(std::move(rows));
+    return map;
+}
+
+const std::string tableTemplate =
+        "<table>{% for rows as row %}<tr id=\"{$ row.id }\">"
+        "{% for row.cells as cell %}<td>{$ cell }</td>{% endfor %}</tr>{% endfor %}</table>";
+
+} // unnamed namespace
+
+static void BM_TokenizeStaticPage(benchmark::State& state) {
+    const auto text = static_page();
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(make_compiled(text));
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_TokenizeStaticPage)->Unit(benchmark::kMillisecond);
+
+static void BM_RenderStaticPage(benchmark::State& state) {
+    const auto engine = static_cast<int>(state.range(0));
+    const auto text = static_page();
+    const auto compiled = make_compiled(text);
+    const auto map = static_page_values();
+    std::string out;
+    std::size_t bytes = 0;
+    for(auto _ : state) {
+        bytes = render(engine, text, compiled, map, out);
+    }
+    set_rates(state, bytes);
+    state.SetLabel(engine_name(engine));
+}
+BENCHMARK(BM_RenderStaticPage)->DenseRange(ProgramEngine, ParseEngine)->Unit(benchmark::kMicrosecond);
+
+static void BM_DeepPaths(benchmark::State& state) {
+    const auto engine = static_cast<int>(state.range(0));
+    std::string text;
+    for(int i = 0; i < 100; ++i) {
+        text += "<span>{$ config.servers[" + std::to_string(i % 4) + "].name }</span>";
+    }
+
+    DataVector servers;
+    for(int i = 0; i < 4; ++i) {
+        DataMap server;
+        server["name"] = make_data("server-" + std::to_string(i));
+        servers.push_back(make_data(std::move(server)));
+    }
+    DataMap config;
+    config["servers"] = make_data(std::move(servers));
+    DataMap map;
+    map["config"] = make_data(std::move(config));
+
+    const auto compiled = make_compiled(text);
+    std::string out;
+    std::size_t bytes = 0;
+    for(auto _ : state) {
+        bytes = render(engine, text, compiled, map, out);
+    }
+    set_rates(state, bytes);
+    state.SetLabel(engine_name(engine));
+}
+BENCHMARK(BM_DeepPaths)->DenseRange(ProgramEngine, ParseEngine);
+
+static void BM_NestedLoops(benchmark::State& state) {
+    const auto engine = static_cast<int>(state.range(0));
+    const auto items = static_cast<std::size_t>(state.range(1));
+    const auto map = table_values(items, 10);
+    const auto compiled = make_compiled(tableTemplate);
+    std::string out;
+    std::size_t bytes = 0;
+    for(auto _ : state) {
+        bytes = render(engine, tableTemplate, compiled, map, out);
+    }
+    set_rates(state, bytes);
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * items));
+    state.SetLabel(engine_name(engine));
+}
+BENCHMARK(BM_NestedLoops)
+    ->ArgsProduct({{ProgramEngine, NodeTreeEngine, ParseEngine}, {10000, 100000, 1000000}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_ParallelLoops(benchmark::State& state) {
+    const auto threads = static_cast<std::size_t>(state.range(0));
+    const auto map = table_values(1000000, 10);
+    const auto compiled = make_compiled(tableTemplate);
+
+    WorkerPool pool(threads);
+    RenderOptions options;
+    options.pool = &pool;
+    options.parallelLoopItems = 1000;
+    std::string out;
+    for(auto _ : state) {
+        out.clear();
+        compiled->render(map, out, options);
+    }
+    set_rates(state, out.size());
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * 1000000));
+}
+BENCHMARK(BM_ParallelLoops)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_SparseMissingTags(benchmark::State& state) {
+    const auto engine = static_cast<int>(state.range(0));
+    std::string text;
+    for(int i = 0; i < 200; ++i) {
+        text += "<li>{$ field" + std::to_string(i) + " }</li>";
+    }
+    DataMap map;
+    for(int i = 0; i < 200; i += 10) {
+        map["field" + std::to_string(i)] = make_data("value");
+    }
+
+    const auto compiled = make_compiled(text);
+    std::string out;
+    std::size_t bytes = 0;
+    for(auto _ : state) {
+        bytes = render(engine, text, compiled, map, out);
+    }
+    set_rates(state, bytes);
+    state.SetLabel(engine_name(engine));
+}
+BENCHMARK(BM_SparseMissingTags)->DenseRange(ProgramEngine, ParseEngine);
+
+TEMPLET_STATIC_TEMPLATE(StaticLogLine, "{$ time } [{$ level }] {$ logger }: {$ message }\n");
+
+static void BM_LogLine(benchmark::State& state) {
+    const auto engine = static_cast<int>(state.range(0));
+    const std::string text = StaticLogLine::text();
+    const auto compiled = make_compiled(text);
+    DataMap map;
+    map["time"] = make_data("2024-01-01T00:00:00Z");
+    map["level"] = make_data("INFO");
+    map["logger"] = make_data("server");
+    map["message"] = make_data("request served");
+
+    std::string out;
+    for(auto _ : state) {
+        if(engine > ParseEngine) {
+            out.clear();
+            StaticLogLine::render(map, out);
+        }
+        else {
+            render(engine, text, compiled, map, out);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    set_rates(state, out.size());
+    state.SetLabel(engine > ParseEngine ? "static template" : engine_name(engine));
+}
+BENCHMARK(BM_LogLine)->DenseRange(ProgramEngine, ParseEngine + 1);
+
+static void BM_SharedTemplate(benchmark::State& state) {
+    static const auto compiled = make_compiled(tableTemplate);
+    static const auto map = table_values(1000, 10);
+    std::string out;
+    for(auto _ : state) {
+        out.clear();
+        compiled->render(map, out);
+    }
+    set_rates(state, out.size());
+}
+BENCHMARK(BM_SharedTemplate)->ThreadRange(1, 8)->UseRealTime();
+
+// Builds a list of ids and renders it, argument 0 wraps every id in
+// its own DataPtr and 1 stores them in one scalar list
+static void BM_IdList(benchmark::State& state) {
+    const auto compact = state.range(0) != 0;
+    const auto compiled = make_compiled("{% for ids as id %}{$id},{% endfor %}");
+    std::string out;
+    for(auto _ : state) {
+        DataMap map;
+        if(compact) {
+            std::vector<int> ids(10000);
+            for(std::size_t i = 0; i < ids.size(); ++i) {
+                ids[i] = static_cast<int>(i * 7919);
+            }
+            map["ids"] = make_data(ids);
+        }
+        else {
+            DataVector ids;
+            ids.reserve(10000);
+            for(int i = 0; i < 10000; ++i) {
+                ids.push_back(std::make_shared<types::DataValue>(std::to_string(i * 7919)));
+            }
+            map["ids"] = make_data(std::move(ids));
+        }
+        out.clear();
+        compiled->render(map, out);
+    }
+    set_rates(state, out.size());
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * 10000));
+    state.SetLabel(compact ? "scalar list" : "shared values");
+}
+BENCHMARK(BM_IdList)->DenseRange(0, 1)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
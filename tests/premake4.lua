@@ -11,7 +11,19 @@ solution "Templet"
         }
         includedirs {"../", "../gtest/include"}
         libdirs {"../gtest/build"}
-        links {"libgtest"}
+        links {"libgtest", "pthread"}
+        
+    project "bench_all"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        files {
+            "bench_all.cpp",
+            "../*.cpp"
+        }
+        includedirs {"../", "../benchmark/include"}
+        libdirs {"../benchmark/build/src"}
+        links {"benchmark", "pthread"}
         
     configuration "Release"
         targetdir "build/release"
@@ -4,8 +4,27 @@ CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += test_all.cpp ..\templet.cpp \
+    ..\arena.cpp \
+    ..\async_render.cpp \
+    ..\batch.cpp \
+    ..\compiled.cpp \
+    ..\cursor.cpp \
+    ..\filters.cpp \
+    ..\fragment_cache.cpp \
+    ..\instrument.cpp \
+    ..\mapped_file.cpp \
+    ..\program.cpp \
+    ..\scope.cpp \
+    ..\serialize.cpp \
+    ..\sink.cpp \
+    ..\source.cpp \
+    ..\static_template.cpp \
+    ..\symbols.cpp \
     ..\types.cpp \
-    ..\nodes.cpp
+    ..\nodes.cpp \
+    ..\optimizer.cpp \
+    ..\pool.cpp \
+    ..\scanner.cpp
 
 INCLUDEPATH += ..\gtest\include ..\
 
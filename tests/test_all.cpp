@@ -1,9 +1,30 @@
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include "gtest/gtest.h"
+#include "async_render.hpp"
+#include "batch.hpp"
+#include "cursor.hpp"
+#include "fragment_cache.hpp"
+#include "mapped_file.hpp"
 #include "ptrutil.hpp"
+#include "registry.hpp"
+#include "scanner.hpp"
+#include "scope.hpp"
+#include "serialize.hpp"
+#include "static_template.hpp"
 #include "templet.hpp"
 
 class TempletParserTest : public ::testing::Test {
@@ -24,6 +45,1627 @@ TEST(FreeParseFunctionTest, SimpleSubstitution) {
     EXPECT_EQ(os.str(), "hello John");
 }
 
+TEST(TokenizeFunctionTest, StringIsConsumed) {
+    std::string text = "hello {$name}{% if name %}!{% endif %}";
+    const auto nodes = templet::tokenize(text);
+
+    EXPECT_TRUE(text.empty());
+    ASSERT_EQ(nodes.size(), 4);
+    EXPECT_EQ(nodes[0]->type(), templet::nodes::NodeType::Text);
+    EXPECT_EQ(nodes[1]->type(), templet::nodes::NodeType::Value);
+    EXPECT_EQ(nodes[3]->type(), templet::nodes::NodeType::IfValue);
+}
+
+TEST(TokenizeFunctionTest, NodesOutliveSource) {
+    std::vector<std::shared_ptr<templet::nodes::Node>> nodes;
+    {
+        auto source = templet::make_source("a{% for xs as x %}[{$x}]{% endfor %}b");
+        nodes = templet::tokenize(source);
+    }
+
+    templet::DataMap map;
+    map["xs"] = make_data({"1", "2"});
+
+    std::ostringstream os;
+    for(const auto& node : nodes) {
+        node->evaluate(os, map);
+    }
+    EXPECT_EQ(os.str(), "a[1][2]b");
+}
+
+//
+// Test compiled templates
+//
+
+TEST(CompiledTemplateTest, Render) {
+    const auto compiled = templet::make_compiled("hello {$name}");
+    templet::DataMap map;
+
+    map["name"] = templet::make_data("John");
+    EXPECT_EQ(compiled->render(map), "hello John");
+
+    map["name"] = templet::make_data("Jane");
+    EXPECT_EQ(compiled->render(map), "hello Jane");
+}
+
+TEST(CompiledTemplateTest, SharedWithTemplet) {
+    templet::Templet tpl("hello {$name}");
+    const auto compiled = tpl.compiled();
+
+    templet::Templet copy(tpl);
+    EXPECT_EQ(copy.compiled(), compiled);
+
+    tpl.setTemplate("bye {$name}");
+    EXPECT_NE(tpl.compiled(), compiled);
+}
+
+TEST(CompiledTemplateTest, ConcurrentRender) {
+    const auto compiled = templet::make_compiled(
+                "{% for users as user %}{% if user.admin %}*{% endif %}{$ user.name },{% endfor %}");
+
+    std::vector<std::string> results(8);
+    std::vector<std::thread> threads;
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&compiled, &results, i]() {
+            DataMap user;
+            user["name"] = make_data(std::to_string(i));
+            if(i % 2 == 0) {
+                user["admin"] = make_data("true");
+            }
+            DataVector users;
+            users.push_back(make_data(std::move(user)));
+            DataMap map;
+            map["users"] = make_data(std::move(users));
+
+            for(int n = 0; n < 1000; ++n) {
+                results[i] = compiled->render(map);
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i], (i % 2 == 0 ? "*" : "") + std::to_string(i) + ",");
+    }
+}
+
+TEST(CompiledTemplateTest, NodesLiveInArena) {
+    const auto compiled = templet::make_compiled("a{% if x %}b{$ x }{% endif %}c");
+    const auto& arena = compiled->arena();
+
+    EXPECT_EQ(arena.blockCount(), 1);
+    EXPECT_GT(arena.bytesUsed(), 0);
+    EXPECT_EQ(compiled->nodes().size(), 3);
+}
+
+TEST(CompiledTemplateTest, EstimatedSize) {
+    const auto compiled = templet::make_compiled("<ul>{% for xs as x %}<li>{$ x }</li>{% endfor %}</ul>");
+    EXPECT_EQ(compiled->program().staticSize(), 18);
+    EXPECT_EQ(compiled->estimatedSize(), 18);
+
+    DataVector xs;
+    for(int i = 0; i < 1000; ++i) {
+        xs.push_back(make_data(std::to_string(i)));
+    }
+    DataMap map;
+    map["xs"] = make_data(std::move(xs));
+
+    const auto first = compiled->render(map);
+    EXPECT_GE(compiled->estimatedSize(), first.size());
+
+    std::string result = "prefix";
+    compiled->render(map, result, templet::RenderOptions());
+    EXPECT_EQ(result, "prefix" + first);
+}
+
+//
+// Test the flattened program
+//
+
+namespace {
+
+std::string renderTree(const templet::CompiledTemplatePtr& compiled, const DataMap& map) {
+    templet::RenderOptions options;
+    options.useNodeTree = true;
+    return compiled->render(map, options);
+}
+
+}
+
+TEST(ProgramTest, BranchTargets) {
+    const auto compiled = templet::make_compiled("{% if a %}x{% else %}y{% endif %}");
+    const auto& code = compiled->program().instructions();
+
+    std::vector<templet::Opcode> ops;
+    for(const auto& instruction : code) {
+        if(instruction.op != templet::Opcode::EmitText || instruction.size > 0) {
+            ops.push_back(instruction.op);
+        }
+    }
+    const std::vector<templet::Opcode> expected {
+        templet::Opcode::JumpIfMissing, templet::Opcode::EmitText,
+        templet::Opcode::Jump, templet::Opcode::EmitText
+    };
+    EXPECT_EQ(ops, expected);
+    for(const auto& instruction : code) {
+        if(instruction.op == templet::Opcode::Jump || instruction.op == templet::Opcode::JumpIfMissing) {
+            EXPECT_LE(instruction.target, code.size());
+        }
+    }
+}
+
+TEST(ProgramTest, MatchesNodeTree) {
+    const std::vector<std::string> templates {
+        "{% if a %}x{% elif b %}y{% endif %}z{% else %}w{% endif %}",
+        "{% for users as user %}[{% for user.tags as tag %}{$ tag }{% endfor %}]{% endfor %}",
+        "{% for users as user %}{% if user.admin %}*{% else %}-{% endif %}{$ user.name }{% endfor %}!",
+        "{% if a %}{% if b %}ab{% elif c %}ac{% endif %}{% endif %}end",
+        "{% for empty as item %}{$ item }{% endfor %}after"
+    };
+
+    DataMap alice;
+    alice["name"] = make_data("alice");
+    alice["admin"] = make_data("true");
+    alice["tags"] = make_data({"x", "y"});
+    DataMap bob;
+    bob["name"] = make_data("bob");
+    bob["tags"] = make_data(DataVector());
+    DataVector users;
+    users.push_back(make_data(std::move(alice)));
+    users.push_back(make_data(std::move(bob)));
+
+    std::vector<DataMap> maps(4);
+    for(auto& map : maps) {
+        map["users"] = make_data(users);
+        map["empty"] = make_data(DataVector());
+    }
+    maps[1]["a"] = make_data("1");
+    maps[2]["b"] = make_data("1");
+    maps[3]["a"] = make_data("1");
+    maps[3]["c"] = make_data("1");
+
+    for(const auto& text : templates) {
+        const auto compiled = templet::make_compiled(text);
+        for(const auto& map : maps) {
+            EXPECT_EQ(compiled->render(map), renderTree(compiled, map)) << text;
+        }
+    }
+}
+
+TEST(ProgramTest, LoopDepth) {
+    const auto compiled = templet::make_compiled(
+                "{% for a as x %}{% for b as y %}{$ y }{% endfor %}{% endfor %}{% for c as z %}{$ z }{% endfor %}");
+    EXPECT_EQ(compiled->program().maxLoopDepth(), 2);
+}
+
+TEST(ProgramTest, MisplacedElseFailsWhenReached) {
+    const auto compiled = templet::make_compiled("{% if debug %}Debug{% else %}Release{% else %}!{% endif %}");
+    DataMap map;
+    ASSERT_THROW(compiled->render(map), templet::exception::InvalidTagError);
+
+    map["debug"] = make_data("true");
+    EXPECT_EQ(compiled->render(map), "Debug");
+}
+
+TEST(ProgramTest, UserDefinedNode) {
+    struct Upper : public templet::nodes::Node {
+        using Node::evaluate;
+        void evaluate(templet::Sink& out, const templet::Scope& scope) const override {
+            const auto value = scope.find("name");
+            std::string text = value ? value->getValue() : "";
+            std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+            out.write(text.data(), text.size());
+        }
+    };
+
+    Upper upper;
+    templet::nodes::Node* nodes[] = {&upper};
+    const templet::Program program(templet::nodes::NodeRange(nodes, 1));
+    ASSERT_EQ(program.instructions().size(), 1);
+    EXPECT_EQ(program.instructions()[0].op, templet::Opcode::EvalNode);
+
+    DataMap map;
+    map["name"] = make_data("bob");
+    std::string result;
+    templet::StringSink out(result);
+    program.run(out, map);
+    EXPECT_EQ(result, "BOB");
+}
+
+//
+// Test the node tree optimizer
+//
+
+namespace {
+
+std::string renderUnoptimized(const std::string& text, const DataMap& map) {
+    std::ostringstream os;
+    templet::parse(text, map, os);
+    return os.str();
+}
+
+}
+
+TEST(OptimizerTest, MergesAndDropsText) {
+    const auto compiled = templet::make_compiled("{\\$x}a{\\ c }");
+    const auto& stats = compiled->stats();
+
+    ASSERT_EQ(compiled->nodes().size(), 1);
+    EXPECT_EQ(compiled->nodes()[0]->type(), templet::nodes::NodeType::Text);
+    EXPECT_EQ(stats.nodesBefore, 6);
+    EXPECT_EQ(stats.nodesAfter, 1);
+    EXPECT_EQ(stats.droppedTexts, 1);
+    EXPECT_EQ(stats.mergedTexts, 4);
+    EXPECT_EQ(compiled->render(DataMap()), "{$x}a{ c }");
+}
+
+TEST(OptimizerTest, FoldsStaticBlocks) {
+    const auto compiled = templet::make_compiled(
+                "{% if a %}A{\\!}{% endif %}{% for xs as x %}-{% endfor %}{% if b %}{$ b }{% endif %}");
+    const auto nodes = compiled->nodes();
+
+    ASSERT_EQ(nodes.size(), 3);
+    EXPECT_EQ(nodes[0]->type(), templet::nodes::NodeType::StaticIfValue);
+    EXPECT_EQ(nodes[1]->type(), templet::nodes::NodeType::StaticForValue);
+    EXPECT_EQ(nodes[2]->type(), templet::nodes::NodeType::IfValue);
+    EXPECT_EQ(compiled->stats().foldedBlocks, 2);
+    EXPECT_LT(compiled->stats().nodesAfter, compiled->stats().nodesBefore);
+
+    DataMap map;
+    map["xs"] = make_data({"1", "2", "3"});
+    EXPECT_EQ(compiled->render(map), "---");
+    map["a"] = make_data("1");
+    map["b"] = make_data("B");
+    EXPECT_EQ(compiled->render(map), "A{!}---B");
+    EXPECT_EQ(renderTree(compiled, map), "A{!}---B");
+}
+
+TEST(OptimizerTest, FoldedBlocksKeepErrors) {
+    const auto compiled = templet::make_compiled("{% for xs as x %}-{% endfor %}");
+    DataMap map;
+    ASSERT_THROW(compiled->render(map), templet::exception::MissingTagError);
+    ASSERT_THROW(renderTree(compiled, map), templet::exception::MissingTagError);
+
+    map["xs"] = make_data("1");
+    ASSERT_THROW(compiled->render(map), templet::exception::InvalidTagError);
+
+    map["xs"] = make_data({"1"});
+    map["x"] = make_data("1");
+    ASSERT_THROW(compiled->render(map), templet::exception::InvalidTagError);
+    ASSERT_THROW(renderTree(compiled, map), templet::exception::InvalidTagError);
+}
+
+TEST(OptimizerTest, MatchesUnoptimized) {
+    const std::vector<std::string> templates {
+        "{% if a %}x{% elif b %}y{% endif %}z{% else %}w{% endif %}",
+        "a{\\b}{% if a %}{\\c}{% else %}{% if b %}b{% endif %}{% endif %}{x}",
+        "{% for xs as x %}{% if a %}{$ x }{% endif %}{% endfor %}{% for xs as x %}{% endfor %}."
+    };
+
+    std::vector<DataMap> maps(3);
+    for(auto& map : maps) {
+        map["xs"] = make_data({"1", "2"});
+    }
+    maps[1]["a"] = make_data("1");
+    maps[2]["b"] = make_data("1");
+
+    for(const auto& text : templates) {
+        const auto compiled = templet::make_compiled(text);
+        for(const auto& map : maps) {
+            EXPECT_EQ(compiled->render(map), renderUnoptimized(text, map)) << text;
+            EXPECT_EQ(renderTree(compiled, map), renderUnoptimized(text, map)) << text;
+        }
+    }
+}
+
+//
+// Test the tag scanner
+//
+
+namespace {
+
+templet::helpers::TagSpan scanTag(const std::string& text, std::size_t pos) {
+    while(pos < text.size()) {
+        const auto open = text.find('{', pos);
+        if(open == std::string::npos) {
+            break;
+        }
+        const auto close = text.find('}', open);
+        if(close == std::string::npos) {
+            return templet::helpers::TagSpan {open, std::string::npos};
+        }
+        const char next = text[open + 1];
+        if(next == '$' || next == '%' || next == '\\') {
+            return templet::helpers::TagSpan {open, close};
+        }
+        pos = close + 1;
+    }
+    return templet::helpers::TagSpan {text.size(), std::string::npos};
+}
+
+}
+
+TEST(ScannerTest, FindByteAtEveryOffset) {
+    for(std::size_t size = 0; size < 80; ++size) {
+        const std::string text(size, 'a');
+        EXPECT_EQ(templet::helpers::find_byte(text.data(), 0, size, '{'), size);
+        for(std::size_t at = 0; at < size; ++at) {
+            std::string marked = text;
+            marked[at] = '{';
+            for(std::size_t pos = 0; pos <= at; pos += 7) {
+                EXPECT_EQ(templet::helpers::find_byte(marked.data(), pos, size, '{'), at);
+            }
+            EXPECT_EQ(templet::helpers::find_byte(marked.data(), at + 1, size, '{'), size);
+        }
+    }
+}
+
+TEST(ScannerTest, SkipsPlainBraces) {
+    const std::string text = "{ a {$x} }{b}{%c%}";
+    const auto span = templet::helpers::find_tag(text.data(), 0, text.size());
+    EXPECT_EQ(span.open, 13);
+    EXPECT_EQ(span.close, 17);
+
+    const std::string unclosed = "{a} {$x";
+    const auto last = templet::helpers::find_tag(unclosed.data(), 0, unclosed.size());
+    EXPECT_EQ(last.open, 4);
+    EXPECT_EQ(last.close, std::string::npos);
+}
+
+TEST(ScannerTest, MatchesScalarScan) {
+    const char alphabet[] = {'a', '{', '}', '$', '%', '\\', ' '};
+    std::uint32_t seed = 12345;
+    for(int round = 0; round < 500; ++round) {
+        std::string text;
+        const auto size = round % 97;
+        for(int i = 0; i < size; ++i) {
+            seed = seed * 1103515245 + 12345;
+            // Mostly text, so the vector loops get full blocks to scan
+            const auto pick = (seed >> 16) % 32;
+            text.push_back(pick < sizeof(alphabet) ? alphabet[pick] : 'a');
+        }
+        for(std::size_t pos = 0; pos <= text.size(); ++pos) {
+            const auto expected = scanTag(text, pos);
+            const auto actual = templet::helpers::find_tag(text.data(), pos, text.size());
+            ASSERT_EQ(actual.open, expected.open) << text << " at " << pos;
+            ASSERT_EQ(actual.close, expected.close) << text << " at " << pos;
+        }
+    }
+}
+
+TEST(ScannerTest, PlainBracesRenderAsText) {
+    DataMap data;
+    data["x"] = make_data("1");
+    const std::string text = std::string(40, 'a') + "{ {$x} }" + std::string(20, 'b') + "{$x}{y";
+    EXPECT_EQ(templet::make_compiled(text)->render(data), std::string(40, 'a') + "{ {$x} }" + std::string(20, 'b') + "1{y");
+}
+
+//
+// Test the output filters
+//
+
+TEST(FilterTest, EscapesHtml) {
+    DataMap data;
+    data["name"] = make_data("<a href=\"x\">Tom & Jerry's</a>");
+    const auto compiled = templet::make_compiled("{$ name|html }|{$name}");
+    EXPECT_EQ(compiled->render(data),
+              "&lt;a href=&quot;x&quot;&gt;Tom &amp; Jerry&#39;s&lt;/a&gt;|<a href=\"x\">Tom & Jerry's</a>");
+    EXPECT_EQ(renderTree(compiled, data), compiled->render(data));
+}
+
+TEST(FilterTest, EncodesUrl) {
+    DataMap data;
+    data["q"] = make_data("a b/c?d=e&f~g_h.i-J\xc3\xa4");
+    const auto compiled = templet::make_compiled("?q={$ q | url }");
+    EXPECT_EQ(compiled->render(data), "?q=a%20b%2Fc%3Fd%3De%26f~g_h.i-J%C3%A4");
+    EXPECT_EQ(renderTree(compiled, data), compiled->render(data));
+}
+
+TEST(FilterTest, LongValuesMatchScalarEscape) {
+    std::string value;
+    for(int i = 0; i < 300; ++i) {
+        value.push_back(static_cast<char>((i * 37) % 128));
+        if(i % 5 == 0) {
+            value.append("safe_text-");
+        }
+    }
+    std::string html;
+    std::string url;
+    for(const char c : value) {
+        switch(c) {
+        case '&': html += "&amp;"; break;
+        case '<': html += "&lt;"; break;
+        case '>': html += "&gt;"; break;
+        case '"': html += "&quot;"; break;
+        case '\'': html += "&#39;"; break;
+        default: html += c; break;
+        }
+        if(std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.' || c == '_' || c == '~') {
+            url += c;
+        }
+        else {
+            static const char digits[] = "0123456789ABCDEF";
+            url += '%';
+            url += digits[(c >> 4) & 0x0f];
+            url += digits[c & 0x0f];
+        }
+    }
+
+    DataMap data;
+    data["v"] = make_data(value);
+    EXPECT_EQ(templet::make_compiled("{$v|html}")->render(data), html);
+    EXPECT_EQ(templet::make_compiled("{$v|url}")->render(data), url);
+}
+
+TEST(FilterTest, UnknownFilterThrows) {
+    EXPECT_THROW(templet::make_compiled("{$ name|upper }"), templet::exception::InvalidTagError);
+}
+
+//
+// Test templates parsed at compile time
+//
+
+TEMPLET_STATIC_TEMPLATE(StaticGreeting, "Hello, {$ name|html }! {x} {\\$y}");
+TEMPLET_STATIC_TEMPLATE(StaticBlocks,
+                        "{% if a %}A{% elif b %}B{$b}{% endif %}{% else %}C{% endif %}|"
+                        "{% for xs as x %}[{$x|url}{% if a %}a{% endif %}]{% endfor %}."
+                        "{% for rows as row %}{% for row.cells as cell %}{$cell} {% endfor %};{% endfor %}");
+TEMPLET_STATIC_TEMPLATE(StaticTruncated, "a{% endif %}b{$x}");
+
+TEST(StaticTemplateTest, MatchesCompiledTemplate) {
+    std::vector<DataMap> maps(4);
+    for(auto& map : maps) {
+        map["name"] = make_data("<Tom & Jerry>");
+        map["xs"] = make_data({"1 2", "3"});
+        DataVector rows;
+        DataMap row;
+        row["cells"] = make_data({"p", "q"});
+        rows.push_back(make_data(row));
+        rows.push_back(make_data(row));
+        map["rows"] = make_data(rows);
+    }
+    maps[1]["a"] = make_data("1");
+    maps[2]["b"] = make_data("2");
+    maps[3]["a"] = make_data("1");
+    maps[3]["b"] = make_data("2");
+
+    for(const auto& map : maps) {
+        EXPECT_EQ(StaticGreeting::render(map), templet::make_compiled(StaticGreeting::text())->render(map));
+        EXPECT_EQ(StaticBlocks::render(map), templet::make_compiled(StaticBlocks::text())->render(map));
+        EXPECT_EQ(StaticTruncated::render(map), templet::make_compiled(StaticTruncated::text())->render(map));
+    }
+    EXPECT_EQ(StaticGreeting::render(maps[0]), "Hello, &lt;Tom &amp; Jerry&gt;! {x} {$y}");
+    EXPECT_EQ(StaticTruncated::render(maps[0]), "a");
+}
+
+TEST(StaticTemplateTest, FunctionScopeAndSinks) {
+    TEMPLET_STATIC_TEMPLATE(Line, "{$ level } {$ message }\n");
+
+    DataMap map;
+    map["level"] = make_data("INFO");
+    map["message"] = make_data("started");
+
+    std::ostringstream os;
+    Line::render(map, os);
+    EXPECT_EQ(os.str(), "INFO started\n");
+
+    templet::IovecSink sink;
+    Line::render(map, sink);
+    EXPECT_EQ(sink.size(), os.str().size());
+
+    std::string out = ">";
+    Line::render(map, out);
+    EXPECT_EQ(out, ">INFO started\n");
+}
+
+TEST(StaticTemplateTest, RuntimeErrors) {
+    TEMPLET_STATIC_TEMPLATE(Missing, "{$ missing }{% for xs as x %}{% endfor %}");
+
+    DataMap map;
+    map["xs"] = make_data("not a list");
+    EXPECT_THROW(Missing::render(map), templet::exception::InvalidTagError);
+
+    map["xs"] = make_data({"1"});
+    EXPECT_EQ(Missing::render(map), "");
+
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+    EXPECT_THROW(Missing::render(Scope(map, options)), templet::exception::MissingTagError);
+}
+
+TEST(StaticTemplateTest, StrayEndCacheEndsTemplate) {
+    TEMPLET_STATIC_TEMPLATE(Stray, "a{$x}{% endcache %}b");
+
+    DataMap map;
+    map["x"] = make_data("1");
+    EXPECT_EQ(Stray::render(map), "a1");
+    EXPECT_EQ(templet::make_compiled(Stray::text())->render(map), Stray::render(map));
+}
+
+TEST(StaticTemplateTest, LongLiteral) {
+    TEMPLET_STATIC_TEMPLATE(Long, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx{$x}xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+
+    DataMap map;
+    map["x"] = make_data("-");
+    EXPECT_EQ(Long::render(map), std::string(1500, 'x') + "-" + std::string(1500, 'x'));
+}
+
+//
+// Test the node arena
+//
+
+namespace {
+
+struct Counted {
+    int& count;
+    explicit Counted(int& c) : count(c) { ++count; }
+    ~Counted() { --count; }
+};
+
+}
+
+TEST(NodeArenaTest, DestroysObjects) {
+    int count = 0;
+    {
+        templet::nodes::NodeArena arena(64);
+        for(int i = 0; i < 100; ++i) {
+            arena.create<Counted>(count);
+        }
+        EXPECT_EQ(count, 100);
+        EXPECT_GT(arena.blockCount(), 1);
+    }
+    EXPECT_EQ(count, 0);
+}
+
+TEST(NodeArenaTest, LargeAllocation) {
+    templet::nodes::NodeArena arena(64);
+    auto small = arena.allocateArray<char>(1);
+    auto large = arena.allocateArray<std::uint64_t>(1000);
+    ASSERT_NE(small, nullptr);
+    ASSERT_NE(large, nullptr);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(large) % alignof(std::uint64_t), 0);
+    large[999] = 1;
+    EXPECT_GE(arena.bytesUsed(), 1001);
+}
+
+//
+// Test chunked rendering
+//
+
+TEST(RenderCursorTest, ChunksMatchRender) {
+    const auto compiled = templet::make_compiled(
+                "<head>{$ title }</head>{% for rows as row %}<tr>{% for row as col %}<td>{$ col }</td>{% endfor %}</tr>{% endfor %}{% if footer %}<footer/>{% endif %}");
+    DataVector rows;
+    for(int i = 0; i < 50; ++i) {
+        rows.push_back(make_data({std::to_string(i), "x", "long cell value"}));
+    }
+    DataMap map;
+    map["title"] = make_data("Report");
+    map["rows"] = make_data(std::move(rows));
+    map["footer"] = make_data("1");
+    const auto expected = compiled->render(map);
+
+    for(std::size_t maxBytes : {1, 3, 7, 64, 100000}) {
+        templet::RenderCursor cursor(compiled, map);
+        std::string result;
+        std::string chunk;
+        std::size_t chunks = 0;
+        while(cursor.next(chunk, maxBytes)) {
+            ASSERT_LE(chunk.size(), maxBytes);
+            result += chunk;
+            ++chunks;
+        }
+        EXPECT_TRUE(cursor.done());
+        EXPECT_EQ(result, expected);
+        EXPECT_EQ(chunks, (expected.size() + maxBytes - 1) / maxBytes);
+        EXPECT_FALSE(cursor.next(chunk, maxBytes));
+    }
+}
+
+TEST(RenderCursorTest, ErrorsAndEmptyTemplate) {
+    DataMap map;
+    templet::RenderCursor empty(templet::make_compiled(""), map);
+    std::string chunk;
+    EXPECT_FALSE(empty.next(chunk, 10));
+    EXPECT_TRUE(empty.done());
+
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+    templet::RenderCursor strict(templet::make_compiled("0123456789{$ missing }"), map, options);
+    ASSERT_THROW(strict.next(chunk, 0), std::runtime_error);
+    EXPECT_TRUE(strict.next(chunk, 10));
+    EXPECT_EQ(chunk, "0123456789");
+    ASSERT_THROW(strict.next(chunk, 10), templet::exception::MissingTagError);
+
+    ASSERT_THROW(templet::RenderCursor(nullptr, map), std::runtime_error);
+}
+
+TEST(RenderCursorTest, PoolDoesNotBufferLoops) {
+    const auto compiled = templet::make_compiled("{% for xs as x %}{$x}{% endfor %}");
+    DataMap map;
+    DataVector items(2000, make_data("p"));
+    map["xs"] = make_data(items);
+
+    templet::RenderProfile profile;
+    templet::WorkerPool pool(4);
+    templet::RenderOptions options;
+    options.instrumentation = &profile;
+    options.pool = &pool;
+    options.parallelLoopItems = 100;
+
+    // A parallel loop would finish in the first chunk and buffer the rest
+    templet::RenderCursor cursor(compiled, map, options);
+    std::string chunk;
+    ASSERT_TRUE(cursor.next(chunk, 16));
+    EXPECT_EQ(chunk, std::string(16, 'p'));
+    EXPECT_EQ(profile.totals().loops, 0);
+
+    std::string result = chunk;
+    while(cursor.next(chunk, 16)) {
+        EXPECT_LE(chunk.size(), 16);
+        result += chunk;
+    }
+    EXPECT_EQ(result, std::string(2000, 'p'));
+    EXPECT_EQ(profile.totals().loopItems, 2000);
+}
+
+namespace {
+
+/**
+ * @brief Sink with a bounded buffer that's drained by the test
+ */
+struct BufferedAsyncSink : templet::AsyncSink {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::string buffer;
+    std::string received;
+    std::size_t limit;
+    std::size_t maxBuffered {0};
+    bool paused {false};
+    int finishes {0};
+    std::exception_ptr error;
+
+    explicit BufferedAsyncSink(std::size_t limit) : limit(limit) {}
+
+    bool write(const char* data, std::size_t size) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.append(data, size);
+        maxBuffered = std::max(maxBuffered, buffer.size());
+        changed.notify_all();
+        paused = buffer.size() >= limit;
+        return !paused;
+    }
+
+    void finished() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++finishes;
+        changed.notify_all();
+    }
+
+    void failed(std::exception_ptr e) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = e;
+        changed.notify_all();
+    }
+
+    /**
+     * @brief Move the buffer to received, returns true if the render paused
+     */
+    bool drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return !buffer.empty() || finishes != 0 || error; });
+        received += buffer;
+        buffer.clear();
+        const bool was = paused;
+        paused = false;
+        return was;
+    }
+
+    bool over() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finishes != 0 || error;
+    }
+};
+
+} // unnamed namespace
+
+TEST(AsyncRenderTest, PausesOnBackpressure) {
+    const auto compiled = templet::make_compiled("{% for rows as row %}<tr>{% for row as col %}<td>{$ col }</td>{% endfor %}</tr>{% endfor %}");
+    DataVector rows;
+    for(int i = 0; i < 200; ++i) {
+        rows.push_back(make_data({std::to_string(i), "x", "long cell value"}));
+    }
+    DataMap map;
+    map["rows"] = make_data(std::move(rows));
+    const auto expected = compiled->render(map);
+
+    BufferedAsyncSink sink(256);
+    std::vector<std::thread> steps;
+    std::mutex stepsMutex;
+    const auto post = [&](std::function<void()> step) {
+        std::lock_guard<std::mutex> lock(stepsMutex);
+        steps.emplace_back(std::move(step));
+    };
+    const auto render = templet::AsyncRender::start(compiled, map, sink, post, templet::RenderOptions(), 64);
+    while(!sink.over()) {
+        if(sink.drain()) {
+            render->resume();
+        }
+    }
+    sink.drain();
+    {
+        std::lock_guard<std::mutex> lock(stepsMutex);
+        for(auto& step : steps) {
+            step.join();
+        }
+    }
+
+    EXPECT_TRUE(render->done());
+    EXPECT_EQ(sink.finishes, 1);
+    EXPECT_EQ(sink.received, expected);
+    EXPECT_LT(sink.maxBuffered, 256 + 64);
+}
+
+TEST(AsyncRenderTest, InlineAndErrors) {
+    DataMap map;
+    map["name"] = make_data("john");
+    BufferedAsyncSink sink(1000);
+    const auto render = templet::AsyncRender::start(templet::make_compiled("Hello, {$name}"), map, sink);
+    EXPECT_TRUE(render->done());
+    EXPECT_EQ(sink.buffer, "Hello, john");
+    EXPECT_EQ(sink.finishes, 1);
+    render->resume();
+    EXPECT_EQ(sink.finishes, 1);
+
+    // Without an executor each resume renders until the sink is full again
+    map["name"] = make_data(std::string(100, 'j'));
+    BufferedAsyncSink small(10);
+    const auto paused = templet::AsyncRender::start(templet::make_compiled("Hello, {$name}"), map, small,
+                                                    templet::AsyncRender::Executor(), templet::RenderOptions(), 4);
+    int resumes = 0;
+    while(!paused->done()) {
+        EXPECT_GE(small.buffer.size(), 10);
+        EXPECT_LT(small.buffer.size(), 10 + 4);
+        small.drain();
+        paused->resume();
+        ++resumes;
+    }
+    small.drain();
+    EXPECT_EQ(small.received, "Hello, " + std::string(100, 'j'));
+    EXPECT_GE(resumes, 7);
+
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+    BufferedAsyncSink strict(1000);
+    templet::AsyncRender::start(templet::make_compiled("x{$ missing }"), map, strict,
+                                templet::AsyncRender::Executor(), options);
+    ASSERT_TRUE(strict.error != nullptr);
+    EXPECT_THROW(std::rethrow_exception(strict.error), templet::exception::MissingTagError);
+    EXPECT_EQ(strict.finishes, 0);
+
+    EXPECT_THROW(templet::AsyncRender::start(nullptr, map, sink), std::runtime_error);
+    EXPECT_THROW(templet::AsyncRender::start(templet::make_compiled("x"), map, sink,
+                                             templet::AsyncRender::Executor(), templet::RenderOptions(), 0),
+                 std::runtime_error);
+}
+
+#if defined(TEMPLET_COROUTINES)
+
+namespace {
+
+/**
+ * @brief Awaitable write that suspends until the test resumes it
+ */
+struct PendingWrites {
+    std::string received;
+    std::coroutine_handle<> waiting;
+
+    struct Write {
+        PendingWrites& writes;
+        std::string chunk;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            writes.received += chunk;
+            writes.waiting = handle;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    Write operator()(const std::string& chunk) {
+        return Write {*this, chunk};
+    }
+};
+
+} // unnamed namespace
+
+TEST(AsyncRenderTest, CoroutineSuspendsPerChunk) {
+    DataMap map;
+    map["xs"] = make_data({"a", "b", "c"});
+    PendingWrites writes;
+    auto task = templet::render_chunks(templet::make_compiled("{% for xs as x %}<{$x}>{% endfor %}"), map,
+                                       std::ref(writes), templet::RenderOptions(), 2);
+    task.start();
+    int suspensions = 0;
+    while(!task.done()) {
+        ++suspensions;
+        std::exchange(writes.waiting, nullptr).resume();
+    }
+    task.get();
+    EXPECT_EQ(writes.received, "<a><b><c>");
+    EXPECT_EQ(suspensions, 5);
+}
+
+#endif // TEMPLET_COROUTINES
+
+//
+// Test batch rendering
+//
+
+TEST(WorkerPoolTest, RunsEveryTask) {
+    templet::WorkerPool pool(4);
+    EXPECT_EQ(pool.size(), 4);
+
+    for(int run = 0; run < 20; ++run) {
+        std::vector<std::atomic<int>> counts(1000);
+        pool.run(counts.size(), [&](std::size_t task) {
+            ++counts[task];
+        });
+        for(const auto& count : counts) {
+            ASSERT_EQ(count, 1);
+        }
+    }
+}
+
+TEST(WorkerPoolTest, NestedRunAndErrors) {
+    templet::WorkerPool pool(3);
+    std::atomic<int> total {0};
+    pool.run(10, [&](std::size_t) {
+        pool.run(10, [&](std::size_t) {
+            ++total;
+        });
+    });
+    EXPECT_EQ(total, 100);
+
+    ASSERT_THROW(pool.run(100, [](std::size_t task) {
+        if(task == 42) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+
+    total = 0;
+    pool.run(5, [&](std::size_t) { ++total; });
+    EXPECT_EQ(total, 5);
+}
+
+TEST(BatchRenderTest, DeliversInOrder) {
+    const auto compiled = templet::make_compiled("Dear {$ name },{% if vip %} thanks!{% endif %}");
+    std::vector<DataMap> contexts(5000);
+    for(std::size_t i = 0; i < contexts.size(); ++i) {
+        contexts[i]["name"] = make_data(std::to_string(i));
+        if(i % 3 == 0) {
+            contexts[i]["vip"] = make_data("1");
+        }
+    }
+
+    templet::WorkerPool pool(4);
+    std::vector<std::string> results;
+    templet::render_batch(pool, *compiled, contexts, [&](std::size_t index, std::string& result) {
+        ASSERT_EQ(index, results.size());
+        results.push_back(std::move(result));
+    });
+
+    ASSERT_EQ(results.size(), contexts.size());
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        ASSERT_EQ(results[i], compiled->render(contexts[i]));
+    }
+}
+
+TEST(BatchRenderTest, DeliversWithoutBlockingRenders) {
+    const auto compiled = templet::make_compiled("{$ name }");
+    std::vector<DataMap> contexts(64);
+    for(std::size_t i = 0; i < contexts.size(); ++i) {
+        contexts[i]["name"] = make_data(std::to_string(i));
+    }
+
+    // The other contexts finish rendering while the first one is delivered
+    templet::RenderProfile profile;
+    templet::RenderOptions options;
+    options.instrumentation = &profile;
+    templet::WorkerPool pool(4);
+    bool overlapped = false;
+    std::vector<std::string> results;
+    templet::render_batch(pool, *compiled, contexts, [&](std::size_t index, std::string& result) {
+        for(int i = 0; index == 0 && i < 5000 && !overlapped; ++i) {
+            overlapped = profile.totals().renders == contexts.size();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        results.push_back(std::move(result));
+    }, options);
+
+    EXPECT_TRUE(overlapped);
+    ASSERT_EQ(results.size(), contexts.size());
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i], std::to_string(i));
+    }
+}
+
+TEST(BatchRenderTest, PerItemSinks) {
+    const auto compiled = templet::make_compiled("{$ name };");
+    std::vector<DataMap> contexts(300);
+    for(std::size_t i = 0; i < contexts.size(); ++i) {
+        contexts[i]["name"] = make_data(std::to_string(i));
+    }
+
+    templet::WorkerPool pool(3);
+    std::vector<std::string> outputs(contexts.size());
+    std::vector<std::unique_ptr<templet::StringSink>> sinks;
+    for(auto& output : outputs) {
+        sinks.emplace_back(new templet::StringSink(output));
+    }
+    templet::render_batch_to_sinks(pool, *compiled, contexts, [&](std::size_t index) -> templet::Sink& {
+        return *sinks[index];
+    });
+    for(std::size_t i = 0; i < outputs.size(); ++i) {
+        EXPECT_EQ(outputs[i], std::to_string(i) + ";");
+    }
+
+    contexts[150].erase("name");
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+    ASSERT_THROW(templet::render_batch(pool, *compiled, contexts, [](std::size_t, std::string&) {}, options),
+                 templet::exception::MissingTagError);
+}
+
+TEST(ParallelLoopTest, MatchesSequential) {
+    const auto compiled = templet::make_compiled(
+                "<table>{% for rows as row %}<tr>{% for row.cells as cell %}<td>{$ cell }</td>{% endfor %}"
+                "{% if row.flag %}!{% endif %}{$ title }</tr>{% endfor %}</table>");
+    DataVector rows;
+    for(int i = 0; i < 20000; ++i) {
+        DataMap row;
+        row["cells"] = make_data({std::to_string(i), "b"});
+        if(i % 7 == 0) {
+            row["flag"] = make_data("1");
+        }
+        rows.push_back(make_data(std::move(row)));
+    }
+    DataMap map;
+    map["rows"] = make_data(std::move(rows));
+    map["title"] = make_data("t");
+    const auto expected = compiled->render(map);
+
+    templet::WorkerPool pool(4);
+    templet::RenderOptions options;
+    options.pool = &pool;
+    options.parallelLoopItems = 1000;
+    EXPECT_EQ(compiled->render(map, options), expected);
+
+    options.parallelLoopItems = 1;
+    EXPECT_EQ(compiled->render(map, options), expected);
+}
+
+TEST(ParallelLoopTest, Errors) {
+    const auto compiled = templet::make_compiled("{% for rows as row %}{$ row.name }{% endfor %}");
+    DataVector rows;
+    for(int i = 0; i < 5000; ++i) {
+        DataMap row;
+        if(i != 4321) {
+            row["name"] = make_data(std::to_string(i));
+        }
+        rows.push_back(make_data(std::move(row)));
+    }
+    DataMap map;
+    map["rows"] = make_data(std::move(rows));
+
+    templet::WorkerPool pool(4);
+    templet::RenderOptions options;
+    options.pool = &pool;
+    options.parallelLoopItems = 100;
+    options.strictMissingTags = true;
+    ASSERT_THROW(compiled->render(map, options), templet::exception::MissingTagError);
+}
+
+//
+// Test the instrumentation hooks
+//
+
+TEST(InstrumentationTest, ProfilesRenders) {
+    const auto compiled = templet::make_compiled(
+                "{$ title }{$ missing }{% for rows as row %}({% for row.cells as cell %}{$cell}{% endfor %}){% endfor %}"
+                "{% for rows as row %}-{% endfor %}{% for empty as x %}{$x}{% endfor %}");
+    DataVector rows;
+    for(int i = 0; i < 3; ++i) {
+        DataMap row;
+        row["cells"] = make_data({"a", "b"});
+        rows.push_back(make_data(std::move(row)));
+    }
+    DataMap map;
+    map["title"] = make_data("T");
+    map["rows"] = make_data(std::move(rows));
+    map["empty"] = make_data(DataVector());
+
+    templet::RenderProfile profile;
+    templet::RenderOptions options;
+    options.instrumentation = &profile;
+    const auto expected = compiled->render(map);
+    EXPECT_EQ(compiled->render(map, options), expected);
+    options.useNodeTree = true;
+    EXPECT_EQ(compiled->render(map, options), expected);
+
+    const auto totals = profile.totals();
+    EXPECT_EQ(totals.renders, 2);
+    EXPECT_EQ(totals.bytes, 2 * expected.size());
+    EXPECT_EQ(totals.missingTags, 2);
+    EXPECT_EQ(totals.loops, 2 * (1 + 3 + 1 + 1));
+    EXPECT_EQ(totals.loopItems, 2 * (3 + 6 + 3 + 0));
+
+    // Both engines report the same nodes, the two loops over rows are kept apart
+    const auto tags = profile.tags(*compiled);
+    ASSERT_EQ(tags.size(), 5);
+    EXPECT_EQ(tags[0].index, 1);
+    EXPECT_EQ(tags[0].tag, "missing");
+    EXPECT_EQ(tags[0].missing, 2);
+    EXPECT_EQ(tags[1].index, 2);
+    EXPECT_EQ(tags[1].tag, "rows");
+    EXPECT_EQ(tags[1].loops, 2);
+    EXPECT_EQ(tags[1].loopItems, 6);
+    EXPECT_EQ(tags[2].tag, "row.cells");
+    EXPECT_EQ(tags[2].loops, 6);
+    EXPECT_EQ(tags[2].loopItems, 12);
+    EXPECT_EQ(tags[3].index, 5);
+    EXPECT_EQ(tags[3].tag, "rows");
+    EXPECT_EQ(tags[3].loopItems, 6);
+    EXPECT_EQ(tags[4].tag, "empty");
+    EXPECT_EQ(tags[4].loops, 2);
+    EXPECT_EQ(tags[4].loopItems, 0);
+    EXPECT_EQ(profile.counters(*compiled).renders, 2);
+    EXPECT_EQ(profile.counters(*templet::make_compiled("x")).renders, 0);
+
+    profile.reset();
+    EXPECT_EQ(profile.totals().renders, 0);
+    EXPECT_TRUE(profile.tags(*compiled).empty());
+}
+
+TEST(InstrumentationTest, KeepsTemplatesApart) {
+    const auto page = templet::make_compiled("{% include partial %}{% for xs as x %}{$x}{% endfor %}");
+    const auto partial = templet::make_compiled("{% for xs as x %}{$x}{% endfor %}{$ missing }");
+    templet::nodes::find_includes(page->nodes())[0]->bind(partial);
+    const auto copy = templet::make_compiled("{% for xs as x %}{$x}{% endfor %}{$ missing }");
+    EXPECT_NE(copy->id(), partial->id());
+
+    DataMap map;
+    map["xs"] = make_data(DataVector(1000, make_data("x")));
+    templet::RenderProfile profile;
+    templet::RenderOptions options;
+    options.instrumentation = &profile;
+    page->render(map, options);
+    copy->render(map, options);
+    copy->render(map, options);
+
+    // Tags of an included template are reported for the partial
+    const auto pageTags = profile.tags(*page);
+    ASSERT_EQ(pageTags.size(), 1);
+    EXPECT_EQ(pageTags[0].index, 0);
+    EXPECT_EQ(pageTags[0].loopItems, 1000);
+    EXPECT_GT(pageTags[0].nanoseconds, 0);
+    const auto partialTags = profile.tags(*partial);
+    ASSERT_EQ(partialTags.size(), 2);
+    EXPECT_EQ(partialTags[0].loops, 1);
+    EXPECT_EQ(partialTags[1].missing, 1);
+    EXPECT_EQ(profile.counters(*partial).renders, 0);
+    EXPECT_EQ(profile.tags(*copy)[0].loops, 2);
+
+    profile.forget(*copy);
+    EXPECT_TRUE(profile.tags(*copy).empty());
+    EXPECT_EQ(profile.counters(*copy).renders, 0);
+    EXPECT_EQ(profile.counters(*page).renders, 1);
+    EXPECT_EQ(profile.totals().renders, 3);
+}
+
+TEST(InstrumentationTest, StreamsParallelLoopsAndCursors) {
+    const auto compiled = templet::make_compiled("{% for xs as x %}{$x}{% endfor %}");
+    DataMap map;
+    map["xs"] = templet::make_data_stream([]() {
+        auto count = std::make_shared<int>(0);
+        return templet::types::DataGenerator([count]() -> DataPtr {
+            return (*count)++ < 5 ? make_data("s") : nullptr;
+        });
+    });
+
+    templet::RenderProfile profile;
+    templet::RenderOptions options;
+    options.instrumentation = &profile;
+    EXPECT_EQ(compiled->render(map, options), "sssss");
+    EXPECT_EQ(profile.tags(*compiled).at(0).loopItems, 5);
+
+    DataVector items(2000, make_data("p"));
+    map["xs"] = make_data(items);
+    templet::WorkerPool pool(4);
+    options.pool = &pool;
+    options.parallelLoopItems = 100;
+    compiled->render(map, options);
+    EXPECT_EQ(profile.tags(*compiled).at(0).loopItems, 2005);
+
+    // Cursors report the same events but no completed renders
+    templet::RenderCursor cursor(compiled, map, options);
+    std::string chunk;
+    while(cursor.next(chunk, 512)) {
+    }
+    EXPECT_EQ(profile.tags(*compiled).at(0).loopItems, 4005);
+    EXPECT_EQ(profile.totals().renders, 2);
+}
+
+TEST(InstrumentationTest, DefaultHooksDoNothing) {
+    templet::Instrumentation hooks;
+    templet::RenderOptions options;
+    options.instrumentation = &hooks;
+
+    DataMap map;
+    map["xs"] = make_data({"1"});
+    const auto compiled = templet::make_compiled("{% for xs as x %}{$x}{$y}{% endfor %}");
+    EXPECT_EQ(compiled->render(map, options), "1");
+}
+
+//
+// Test the fragment cache
+//
+
+TEST(FragmentCacheTest, CachesBlocksByKey) {
+    const auto compiled = templet::make_compiled(
+                "<{% cache nav %}{% for xs as x %}{$x}{% endfor %}{% endcache %}|{% cache nav %}{$nav}{% endcache %}>");
+    DataMap map;
+    map["nav"] = make_data("k1");
+    map["xs"] = make_data({"a", "b"});
+
+    templet::FragmentCache cache;
+    templet::RenderOptions options;
+    options.fragmentCache = &cache;
+    EXPECT_EQ(compiled->render(map, options), "<ab|k1>");
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.misses(), 2);
+
+    // The cached output is written while the key stays the same
+    map["xs"] = make_data({"c"});
+    EXPECT_EQ(compiled->render(map, options), "<ab|k1>");
+    options.useNodeTree = true;
+    EXPECT_EQ(compiled->render(map, options), "<ab|k1>");
+    EXPECT_EQ(cache.hits(), 4);
+
+    map["nav"] = make_data("k2");
+    EXPECT_EQ(compiled->render(map, options), "<c|k2>");
+    options.useNodeTree = false;
+    map["xs"] = make_data({"d"});
+    EXPECT_EQ(compiled->render(map, options), "<c|k2>");
+    EXPECT_EQ(cache.size(), 4);
+
+    // Without a cache or a key the block renders every time
+    EXPECT_EQ(compiled->render(map), "<d|k2>");
+    map.erase("nav");
+    EXPECT_EQ(compiled->render(map, options), "<d|>");
+
+    map["nav"] = make_data({"x"});
+    EXPECT_THROW(compiled->render(map, options), templet::exception::InvalidTagError);
+    EXPECT_THROW(templet::make_compiled("{% cache a!b %}{% endcache %}"), templet::exception::InvalidTagError);
+}
+
+TEST(FragmentCacheTest, EvictsLeastRecentlyUsed) {
+    templet::FragmentCache cache(10);
+    cache.insert("a", "1234");
+    cache.insert("b", "1234");
+    EXPECT_EQ(cache.bytes(), 10);
+    ASSERT_TRUE(cache.find("a") != nullptr);
+
+    const auto fragment = cache.find("b");
+    cache.insert("c", "1");
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_TRUE(cache.find("a") == nullptr);
+    EXPECT_EQ(*cache.find("c"), "1");
+    EXPECT_EQ(*fragment, "1234");
+
+    cache.insert("d", "12345678901");
+    EXPECT_TRUE(cache.find("d") == nullptr);
+    cache.insert("c", "123");
+    EXPECT_EQ(*cache.find("c"), "123");
+    EXPECT_EQ(cache.bytes(), 9);
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+    EXPECT_EQ(cache.bytes(), 0);
+}
+
+TEST(FragmentCacheTest, SharedBetweenThreads) {
+    const auto compiled = templet::make_compiled("{% cache key %}[{$key}]{% endcache %}");
+    templet::FragmentCache cache(64);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            templet::RenderOptions options;
+            options.fragmentCache = &cache;
+            for(int i = 0; i < 500; ++i) {
+                const auto key = std::to_string((i * 7 + t) % 20);
+                DataMap map;
+                map["key"] = make_data(key);
+                if(compiled->render(map, options) != "[" + key + "]") {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_LE(cache.bytes(), 64);
+    EXPECT_EQ(cache.hits() + cache.misses(), 2000);
+}
+
+//
+// Test the template registry
+//
+
+struct MemoryFiles {
+    static std::map<std::string, std::pair<std::string, std::int64_t>>& files() {
+        static std::map<std::string, std::pair<std::string, std::int64_t>> files;
+        return files;
+    }
+
+    static void set(const std::string& path, std::string text) {
+        auto& file = files()[path];
+        file.first = std::move(text);
+        ++file.second;
+    }
+
+    static std::map<std::string, int>& checks() {
+        static std::map<std::string, int> checks;
+        return checks;
+    }
+};
+
+struct MemoryFileReader {
+    static std::string fromFile(const std::string& path) {
+        if(!MemoryFiles::files().count(path)) {
+            throw std::runtime_error("File not found: " + path);
+        }
+        return MemoryFiles::files().at(path).first;
+    }
+
+    static std::int64_t lastModified(const std::string& path) {
+        if(!MemoryFiles::files().count(path)) {
+            throw std::runtime_error("File not found: " + path);
+        }
+        ++MemoryFiles::checks()[path];
+        return MemoryFiles::files().at(path).second;
+    }
+};
+
+struct MemoryFileReaderWithoutTime {
+    static std::string fromFile(const std::string& path) {
+        return MemoryFileReader::fromFile(path);
+    }
+};
+
+TEST(TemplateRegistryTest, CachesUntilModified) {
+    MemoryFiles::set("tpl/a", "hello {$name}");
+    templet::TemplateRegistry<MemoryFileReader> registry("tpl");
+
+    DataMap map;
+    map["name"] = make_data("John");
+
+    const auto first = registry.get("a");
+    EXPECT_EQ(first->render(map), "hello John");
+    EXPECT_EQ(registry.get("a"), first);
+    EXPECT_EQ(registry.compilations(), 1);
+
+    MemoryFiles::set("tpl/a", "bye {$name}");
+    const auto second = registry.get("a");
+    EXPECT_NE(second, first);
+    EXPECT_EQ(second->render(map), "bye John");
+    EXPECT_EQ(registry.compilations(), 2);
+
+    ASSERT_ANY_THROW(registry.get("missing"));
+    EXPECT_FALSE(registry.contains("missing"));
+}
+
+TEST(TemplateRegistryTest, CachesUntilContentChanges) {
+    MemoryFiles::set("b", "hello");
+    templet::TemplateRegistry<MemoryFileReaderWithoutTime> registry;
+
+    const auto first = registry.get("b");
+    MemoryFiles::set("b", "hello");
+    EXPECT_EQ(registry.get("b"), first);
+
+    MemoryFiles::set("b", "bye");
+    EXPECT_NE(registry.get("b"), first);
+    EXPECT_EQ(registry.compilations(), 2);
+}
+
+TEST(TemplateRegistryTest, EvictsLeastRecentlyUsed) {
+    MemoryFiles::set("x", "x");
+    MemoryFiles::set("y", "y");
+    MemoryFiles::set("z", "z");
+    templet::TemplateRegistry<MemoryFileReader> registry("", 2);
+
+    registry.get("x");
+    registry.get("y");
+    registry.get("x");
+    registry.get("z");
+
+    EXPECT_EQ(registry.size(), 2);
+    EXPECT_TRUE(registry.contains("x"));
+    EXPECT_FALSE(registry.contains("y"));
+    EXPECT_TRUE(registry.contains("z"));
+}
+
+TEST(TemplateRegistryTest, FileReader) {
+    templet::TemplateRegistry<> registry;
+
+    DataMap map;
+    map["first_name"] = make_data("john");
+    map["last_name"] = make_data("doe");
+    EXPECT_EQ(registry.get("example.tpl")->render(map), "Hello, john doe");
+    EXPECT_EQ(registry.get("example.tpl")->render(map), "Hello, john doe");
+    EXPECT_EQ(registry.compilations(), 1);
+}
+
+TEST(TemplateRegistryTest, MappedFileReader) {
+    templet::TemplateRegistry<templet::helpers::MappedFileReader> registry;
+
+    DataMap map;
+    map["first_name"] = make_data("john");
+    map["last_name"] = make_data("doe");
+    EXPECT_EQ(registry.get("example.tpl")->render(map), "Hello, john doe");
+    EXPECT_EQ(registry.get("example.tpl")->render(map), "Hello, john doe");
+    EXPECT_EQ(registry.compilations(), 1);
+}
+
+TEST(TemplateRegistryTest, IncludesShareCompiledPartials) {
+    MemoryFiles::set("inc/header", "<h>{$title}</h>");
+    MemoryFiles::set("inc/item", "[{$x}]");
+    MemoryFiles::set("inc/page", "{% include header %}{% for xs as x %}{% include item %}{% endfor %}");
+    MemoryFiles::set("inc/other", "{% if title %}{% include header %}{% endif %}!");
+    templet::TemplateRegistry<MemoryFileReader> registry("inc");
+
+    DataMap map;
+    map["title"] = make_data("T");
+    map["xs"] = make_data({"1", "2"});
+    const auto page = registry.get("page");
+    templet::RenderOptions options;
+    EXPECT_EQ(page->render(map, options), "<h>T</h>[1][2]");
+    options.useNodeTree = true;
+    EXPECT_EQ(page->render(map, options), "<h>T</h>[1][2]");
+    EXPECT_EQ(registry.get("other")->render(map), "<h>T</h>!");
+    EXPECT_EQ(registry.compilations(), 4);
+
+    const auto includes = templet::nodes::find_includes(page->nodes());
+    ASSERT_EQ(includes.size(), 2);
+    EXPECT_EQ(includes[0]->name(), "header");
+    EXPECT_EQ(includes[0]->target(), registry.get("header"));
+    EXPECT_EQ(templet::nodes::find_includes(registry.get("other")->nodes())[0]->target(), includes[0]->target());
+    EXPECT_EQ(registry.compilations(), 4);
+}
+
+TEST(TemplateRegistryTest, RecompilesDependentsOfChangedPartials) {
+    MemoryFiles::set("dep/inner", "a");
+    MemoryFiles::set("dep/middle", "({% include inner %})");
+    MemoryFiles::set("dep/outer", "{% include middle %}");
+    templet::TemplateRegistry<MemoryFileReader> registry("dep");
+    const auto before = registry.get("outer");
+    EXPECT_EQ(before->render(DataMap()), "(a)");
+    EXPECT_EQ(registry.get("outer"), before);
+    EXPECT_EQ(registry.compilations(), 3);
+
+    MemoryFiles::set("dep/inner", "b");
+    const auto after = registry.get("outer");
+    EXPECT_NE(after, before);
+    EXPECT_EQ(after->render(DataMap()), "(b)");
+    EXPECT_EQ(before->render(DataMap()), "(a)");
+    EXPECT_EQ(registry.compilations(), 6);
+
+    MemoryFiles::set("dep/inner", "{% include outer %}");
+    EXPECT_THROW(registry.get("outer"), templet::exception::InvalidTagError);
+    MemoryFiles::set("dep/inner", "c");
+    EXPECT_EQ(registry.get("outer")->render(DataMap()), "(c)");
+}
+
+TEST(TemplateRegistryTest, RestoresEvictedPartials) {
+    MemoryFiles::set("evict/partial", "p");
+    MemoryFiles::set("evict/page", "[{% include partial %}]");
+    templet::TemplateRegistry<MemoryFileReader> registry("evict", 1);
+
+    const auto page = registry.get("page");
+    EXPECT_EQ(page->render(DataMap()), "[p]");
+    EXPECT_EQ(registry.compilations(), 2);
+    for(int i = 0; i < 3; ++i) {
+        EXPECT_EQ(registry.get("page"), page);
+        EXPECT_FALSE(registry.contains("partial"));
+    }
+    EXPECT_EQ(registry.compilations(), 2);
+
+    MemoryFiles::set("evict/partial", "q");
+    EXPECT_EQ(registry.get("page")->render(DataMap()), "[q]");
+    EXPECT_EQ(registry.compilations(), 4);
+}
+
+TEST(TemplateRegistryTest, ChecksSharedPartialsOnce) {
+    MemoryFiles::set("once/c", "c");
+    MemoryFiles::set("once/a", "a{% include c %}");
+    MemoryFiles::set("once/b", "b{% include c %}");
+    MemoryFiles::set("once/page", "{% include a %}{% include b %}");
+    templet::TemplateRegistry<MemoryFileReader> registry("once");
+
+    EXPECT_EQ(registry.get("page")->render(DataMap()), "acbc");
+    EXPECT_EQ(MemoryFiles::checks()["once/c"], 1);
+    registry.get("page");
+    EXPECT_EQ(MemoryFiles::checks()["once/c"], 2);
+    EXPECT_EQ(MemoryFiles::checks()["once/page"], 2);
+    EXPECT_EQ(registry.compilations(), 4);
+}
+
+TEST(TemplateRegistryTest, IncludeWithoutRegistry) {
+    EXPECT_THROW(templet::make_compiled("{% include a b %}"), templet::exception::InvalidTagError);
+    EXPECT_THROW(templet::make_compiled("x{% include header %}")->render(DataMap()),
+                 templet::exception::InvalidTagError);
+}
+
+//
+// Test serialized templates
+//
+
+TEST(SerializeTest, RoundTrip) {
+    const std::vector<std::string> templates {
+        "Hello, {$ name|html }! {x}",
+        "{% if a %}x{% elif b %}y{% else %}{$ a.b[0] }{% endif %}z",
+        "{% for xs as x %}{$x|url},{% endfor %}{% for xs as x %}-{% endfor %}{% if a %}A{% endif %}",
+        ""
+    };
+
+    DataMap map;
+    map["name"] = make_data("<b>");
+    map["xs"] = make_data({"1 2", "3"});
+    map["a"] = make_data("1");
+
+    for(const auto& text : templates) {
+        const auto compiled = templet::make_compiled(text);
+        const auto blob = templet::make_source(templet::serialize_compiled(*compiled));
+        const auto loaded = templet::load_compiled(blob);
+        ASSERT_NE(loaded, nullptr) << text;
+        EXPECT_EQ(loaded->render(map), compiled->render(map)) << text;
+        EXPECT_EQ(loaded->nodes().size(), compiled->nodes().size());
+        EXPECT_EQ(loaded->stats().nodesBefore, compiled->stats().nodesBefore);
+        EXPECT_EQ(loaded->stats().foldedBlocks, compiled->stats().foldedBlocks);
+        EXPECT_EQ(loaded->program().instructions().size(), compiled->program().instructions().size());
+    }
+}
+
+TEST(SerializeTest, TextReferencesBlob) {
+    const auto blob = templet::make_source(templet::serialize_compiled(*templet::make_compiled("static text")));
+    const auto loaded = templet::load_compiled(blob);
+    ASSERT_NE(loaded, nullptr);
+    ASSERT_EQ(loaded->nodes().size(), 1);
+
+    const auto text = dynamic_cast<const templet::nodes::Text*>(loaded->nodes()[0]);
+    ASSERT_NE(text, nullptr);
+    EXPECT_GE(text->data(), blob->data());
+    EXPECT_LE(text->data() + text->size(), blob->data() + blob->size());
+}
+
+TEST(SerializeTest, RejectsOtherVersion) {
+    auto blob = templet::serialize_compiled(*templet::make_compiled("{$x}"));
+    const std::uint32_t version = templet::serializedVersion + 1;
+    blob.replace(4, sizeof(version), reinterpret_cast<const char*>(&version), sizeof(version));
+
+    EXPECT_EQ(templet::load_compiled(templet::make_source(blob)), nullptr);
+    EXPECT_EQ(templet::load_compiled(templet::make_source("{$x}")), nullptr);
+    EXPECT_EQ(templet::load_compiled(nullptr), nullptr);
+
+    DataMap map;
+    map["x"] = make_data("y");
+    const auto fallback = templet::load_compiled(templet::make_source(blob), templet::make_source("<{$x}>"));
+    EXPECT_EQ(fallback->render(map), "<y>");
+}
+
+TEST(SerializeTest, RejectsDamagedBlobs) {
+    const auto blob = templet::serialize_compiled(*templet::make_compiled(
+                "a{% for xs as x %}{$x|html}{% if x %}b{% endif %}{% endfor %}{% if y %}c{% else %}d{% endif %}"));
+    for(std::size_t size = 0; size < blob.size(); ++size) {
+        EXPECT_EQ(templet::load_compiled(templet::make_source(blob.substr(0, size))), nullptr) << size;
+    }
+
+    // Damaged fields may still describe a valid template, loading must
+    // never read outside the blob
+    for(std::size_t pos = 0; pos < blob.size(); ++pos) {
+        auto damaged = blob;
+        damaged[pos] = static_cast<char>(damaged[pos] ^ 0x5a);
+        templet::load_compiled(templet::make_source(damaged));
+    }
+}
+
+TEST(SerializeTest, LoadsFromFile) {
+    DataMap map;
+    map["first_name"] = make_data("john");
+    map["last_name"] = make_data("doe");
+
+    // Without a blob the template file is compiled
+    const auto compiled = templet::load_compiled_file("missing.tplc", "example.tpl");
+    EXPECT_EQ(compiled->render(map), "Hello, john doe");
+    EXPECT_EQ(compiled->source()->size(), templet::helpers::FileReader::fromFile("example.tpl").size());
+
+    templet::save_compiled("example.tplc", *compiled);
+    const auto loaded = templet::load_compiled_file("example.tplc", "missing.tpl");
+    std::remove("example.tplc");
+    EXPECT_EQ(loaded->render(map), "Hello, john doe");
+    EXPECT_NE(dynamic_cast<const templet::MappedSource*>(loaded->source().get()), nullptr);
+
+    MemoryFiles::set("blob", "not a blob");
+    MemoryFiles::set("template", "{$first_name}");
+    EXPECT_EQ((templet::load_compiled_file<MemoryFileReader, MemoryFileReader>("blob", "template")->render(map)), "john");
+}
+
+//
+// Test the output sinks
+//
+
+TEST(SinkTest, StringSinkAppends) {
+    templet::DataMap map;
+    map["name"] = templet::make_data("John");
+
+    std::string out = "> ";
+    templet::StringSink sink(out);
+    templet::parse("hello {$name}", map, sink);
+
+    EXPECT_EQ(out, "> hello John");
+}
+
+TEST(SinkTest, BufferSinkOverflow) {
+    templet::DataMap map;
+    map["name"] = templet::make_data("John");
+
+    char buffer[8];
+    templet::BufferSink sink(buffer, sizeof(buffer));
+    templet::parse("hello {$name}", map, sink);
+
+    EXPECT_TRUE(sink.overflowed());
+    EXPECT_EQ(sink.size(), 8);
+    EXPECT_EQ(sink.required(), 10);
+    EXPECT_EQ(std::string(buffer, sink.size()), "hello Jo");
+
+    char large[16];
+    templet::BufferSink fits(large, sizeof(large));
+    templet::parse("hello {$name}", map, fits);
+
+    EXPECT_FALSE(fits.overflowed());
+    EXPECT_EQ(std::string(large, fits.size()), "hello John");
+}
+
+TEST(SinkTest, IovecSinkReferencesTemplateText) {
+    templet::Templet tpl("hello {$name}, bye {$name}");
+    templet::DataMap map;
+    map["name"] = templet::make_data("John");
+
+    templet::IovecSink sink;
+    tpl.parse(map, sink);
+
+    const auto slices = sink.slices();
+    std::string joined;
+    for(const auto& slice : slices) {
+        joined.append(slice.data, slice.size);
+    }
+    EXPECT_EQ(joined, "hello John, bye John");
+    EXPECT_EQ(sink.size(), joined.size());
+    EXPECT_EQ(slices.size(), 4);
+
+    // Rendering to a sink leaves the stored result alone
+    EXPECT_EQ(tpl.result(), "");
+}
+
 //
 // Test the make_data functions
 //
@@ -33,6 +1675,29 @@ TEST(MakeDataHelperTest, StringToDataPtr) {
     EXPECT_EQ(res->getValue(), "john");
 }
 
+TEST(MakeDataHelperTest, StringToDataPtrValueRef) {
+    DataPtr res = make_data("john");
+    EXPECT_EQ(res->getValueRef(), "john");
+    EXPECT_EQ(&res->getValueRef(), &res->getValueRef());
+}
+
+TEST(MakeDataHelperTest, ValueRefFallsBackToValue) {
+    struct Upper : templet::types::Data {
+        bool empty() const override { return false; }
+        std::string getValue() const override { return "JOHN"; }
+        templet::types::DataType type() const override { return templet::types::DataType::String; }
+    };
+
+    DataPtr res = std::make_shared<Upper>();
+    EXPECT_EQ(res->getValueRef(), "JOHN");
+
+    DataMap map;
+    map["name"] = res;
+    std::ostringstream os;
+    templet::parse("hello {$name}", map, os);
+    EXPECT_EQ(os.str(), "hello JOHN");
+}
+
 TEST(MakeDataHelperTest, StringToDataPtrIsNotEmpty) {
     DataPtr res = make_data("john");
     EXPECT_EQ(res->empty(), false);
@@ -113,6 +1778,278 @@ TEST(MakeDataHelperTest, StringVectorToDataPtr) {
     EXPECT_EQ(r[2]->getValue(), "third");
 }
 
+TEST(MakeDataHelperTest, IntegersFormattedWhenWritten) {
+    EXPECT_EQ(make_data(0)->getValue(), "0");
+    EXPECT_EQ(make_data(-42)->getValue(), "-42");
+    EXPECT_EQ(make_data(std::numeric_limits<std::int64_t>::min())->getValue(),
+              std::to_string(std::numeric_limits<std::int64_t>::min()));
+    EXPECT_EQ(make_data(std::numeric_limits<std::uint64_t>::max())->getValue(),
+              std::to_string(std::numeric_limits<std::uint64_t>::max()));
+    EXPECT_EQ(make_data(true)->getValue(), "1");
+    EXPECT_EQ(make_data(static_cast<signed char>(-3))->getValue(), "-3");
+    EXPECT_FALSE(make_data(0)->empty());
+    EXPECT_EQ(make_data(17)->getValueRef(), "17");
+
+    DataMap map;
+    map["id"] = make_data(12345);
+    EXPECT_EQ(templet::make_compiled("#{$id}")->render(map), "#12345");
+}
+
+TEST(MakeDataHelperTest, ScalarListsStoredContiguously) {
+    const std::string longText(40, 'x');
+    std::vector<templet::types::DataScalar> texts;
+    for(const auto& text : {std::string("a"), std::string(), longText}) {
+        texts.emplace_back(text);
+    }
+    DataPtr strings = std::make_shared<templet::types::DataScalarList>(std::move(texts));
+    ASSERT_EQ(strings->listSize(), 3);
+    EXPECT_EQ(strings->listItem(1)->getValue(), "");
+    EXPECT_TRUE(strings->listItem(1)->empty());
+    EXPECT_EQ(strings->listItem(2)->getValue(), longText);
+    EXPECT_EQ(&strings->getList(), &strings->getList());
+    EXPECT_EQ(strings->getList()[0]->getValue(), "a");
+
+    DataMap map;
+    map["xs"] = make_data(std::vector<int> {3, -1, 20});
+    map["ys"] = strings;
+    const auto compiled = templet::make_compiled("{% for xs as x %}{$x},{% endfor %}{$xs[2]}{$ys[2]|url}");
+    templet::RenderOptions options;
+    EXPECT_EQ(compiled->render(map, options), "3,-1,20," + std::string("20") + longText);
+    options.useNodeTree = true;
+    EXPECT_EQ(compiled->render(map, options), "3,-1,20,20" + longText);
+
+    std::vector<templet::types::DataScalar> items;
+    items.emplace_back(longText);
+    items.emplace_back(std::int64_t(7));
+    auto copy = items;
+    auto moved = std::move(items);
+    copy[0] = copy[1];
+    EXPECT_EQ(moved[0].getValue(), longText);
+    EXPECT_EQ(copy[0].getValue(), "7");
+}
+
+TEST(MakeDataHelperTest, StringListValueRefsAreStable) {
+    DataPtr xs = make_data({"first", "second"});
+    const auto& first = xs->getList()[0]->getValueRef();
+    const auto& second = xs->listItem(1)->getValueRef();
+    EXPECT_NE(&first, &second);
+    EXPECT_EQ(first, "first");
+    EXPECT_EQ(second, "second");
+}
+
+TEST(MakeDataHelperTest, ScalarListItemsOutliveList) {
+    const std::string longText(40, 'y');
+    DataPtr kept;
+    {
+        DataPtr ids = make_data(std::vector<std::int64_t> {-5, 6});
+        kept = ids->getList()[0];
+    }
+    EXPECT_EQ(kept.use_count(), 1);
+    EXPECT_EQ(kept->getValue(), "-5");
+
+    {
+        std::vector<templet::types::DataScalar> items;
+        items.emplace_back(longText);
+        const auto list = std::make_shared<templet::types::DataScalarList>(std::move(items));
+        kept = list->getList()[0];
+    }
+    EXPECT_EQ(kept->getValue(), longText);
+}
+
+//
+// Test the flat data map
+//
+
+TEST(FlatDataMapTest, InternedSymbols) {
+    const auto symbol = templet::types::intern("flat_symbol_test");
+    EXPECT_NE(symbol, templet::types::invalidSymbol);
+    EXPECT_EQ(templet::types::intern("flat_symbol_test"), symbol);
+    EXPECT_EQ(templet::types::find_symbol("flat_symbol_test"), symbol);
+    EXPECT_EQ(templet::types::symbol_name(symbol), "flat_symbol_test");
+    EXPECT_EQ(templet::types::find_symbol("flat_symbol_never_interned"), templet::types::invalidSymbol);
+}
+
+TEST(FlatDataMapTest, InsertAndFind) {
+    FlatDataMap map;
+    EXPECT_TRUE(map.empty());
+    for(int i = 0; i < 100; ++i) {
+        map.insert("key" + std::to_string(i), make_data(i));
+    }
+    map.insert("key7", make_data("seven"));
+
+    EXPECT_EQ(map.size(), 100);
+    EXPECT_EQ(map.find("key7")->getValue(), "seven");
+    EXPECT_EQ(map.find(templet::types::intern("key99"))->getValue(), "99");
+    EXPECT_EQ(map.find("key100"), nullptr);
+    EXPECT_EQ(map.toMap().size(), 100);
+}
+
+TEST(FlatDataMapTest, Render) {
+    FlatDataMap user;
+    user.insert("name", make_data("alice"));
+    DataMap values;
+    values["user"] = make_data(FlatDataMap(DataMap {{"name", make_data("bob")}}));
+    FlatDataMap root(values);
+    root.insert("admin", make_data(std::move(user)));
+
+    const auto compiled = templet::make_compiled("{$ user.name } {$ admin.name }{$ missing }");
+    EXPECT_EQ(compiled->render(root), "bob alice");
+
+    const auto& admin = root.find("admin")->getMap();
+    ASSERT_EQ(admin.size(), 1);
+    EXPECT_EQ(admin.at("name")->getValue(), "alice");
+
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+    ASSERT_THROW(compiled->render(templet::Scope(root, options)), templet::exception::MissingTagError);
+}
+
+TEST(FlatDataMapTest, AliasCollision) {
+    FlatDataMap root;
+    root.insert("xs", make_data({"1", "2"}));
+    root.insert("taken", make_data("t"));
+
+    const templet::Scope scope(root);
+    EXPECT_TRUE(scope.contains("taken", templet::types::intern("taken")));
+    EXPECT_FALSE(scope.contains("free", templet::types::intern("free")));
+    EXPECT_TRUE(scope.contains("taken", templet::types::invalidSymbol));
+
+    const auto compiled = templet::make_compiled("{% for xs as taken %}{$taken}{% endfor %}");
+    ASSERT_THROW(compiled->render(root), templet::exception::InvalidTagError);
+    templet::RenderOptions options;
+    options.useNodeTree = true;
+    ASSERT_THROW(compiled->render(templet::Scope(root, options)), templet::exception::InvalidTagError);
+    EXPECT_EQ(templet::make_compiled("{% for xs as x %}{$x}{% endfor %}")->render(root), "12");
+}
+
+//
+// Test lazy data
+//
+
+TEST(LazyDataTest, NotEvaluatedByIf) {
+    int calls = 0;
+    const auto report = make_lazy_data(templet::types::DataType::String, [&calls]() {
+        ++calls;
+        return make_data("report");
+    });
+    DataMap map;
+    map["report"] = report;
+
+    const auto compiled = templet::make_compiled("{% if report %}yes{% endif %}");
+    EXPECT_EQ(compiled->render(map), "yes");
+    EXPECT_EQ(calls, 0);
+    EXPECT_FALSE(std::static_pointer_cast<templet::types::LazyData>(report)->evaluated());
+}
+
+TEST(LazyDataTest, EvaluatedOnce) {
+    int calls = 0;
+    DataMap map;
+    map["users"] = make_lazy_data(templet::types::DataType::List, [&calls]() {
+        ++calls;
+        return make_data({"a", "b"});
+    });
+    map["config"] = make_lazy_data(templet::types::DataType::Mapper, [&calls]() {
+        ++calls;
+        DataMap config;
+        config["name"] = make_data("site");
+        return make_data(std::move(config));
+    });
+
+    const auto compiled = templet::make_compiled(
+                "{% for users as user %}{$ user }{% endfor %}{$ users[1] }{$ config.name }{$ config.name }");
+    EXPECT_EQ(compiled->render(map), "abbsitesite");
+    EXPECT_EQ(calls, 2);
+}
+
+TEST(LazyDataTest, WrongType) {
+    DataMap map;
+    map["name"] = make_lazy_data(templet::types::DataType::String, []() {
+        return make_data({"a"});
+    });
+
+    ASSERT_THROW(templet::make_compiled("{$ name }")->render(map), std::runtime_error);
+}
+
+//
+// Test streamed lists
+//
+
+namespace {
+
+struct CountedValue : public templet::types::DataValue {
+    static int alive;
+    static int peak;
+
+    CountedValue(std::string value) : DataValue(std::move(value)) {
+        peak = std::max(peak, ++alive);
+    }
+    ~CountedValue() {
+        --alive;
+    }
+};
+
+int CountedValue::alive = 0;
+int CountedValue::peak = 0;
+
+DataPtr make_counted_stream(int count, int& passes) {
+    return templet::make_data_stream([count, &passes]() {
+        ++passes;
+        auto index = std::make_shared<int>(0);
+        return templet::types::DataGenerator([count, index]() -> DataPtr {
+            if(*index == count) {
+                return nullptr;
+            }
+            return std::make_shared<CountedValue>(std::to_string((*index)++));
+        });
+    });
+}
+
+}
+
+TEST(DataStreamTest, ItemsReleasedOneByOne) {
+    int passes = 0;
+    DataMap map;
+    map["rows"] = make_counted_stream(10000, passes);
+    CountedValue::peak = 0;
+
+    const auto compiled = templet::make_compiled("{% for rows as row %}{$ row },{% endfor %}");
+    std::ostringstream os;
+    templet::OstreamSink out(os);
+    compiled->render(map, out);
+    EXPECT_EQ(os.str().substr(0, 8), "0,1,2,3,");
+    EXPECT_EQ(CountedValue::alive, 0);
+    EXPECT_EQ(CountedValue::peak, 1);
+
+    templet::RenderOptions options;
+    options.useNodeTree = true;
+    CountedValue::peak = 0;
+    EXPECT_EQ(compiled->render(map, options), os.str());
+    EXPECT_EQ(CountedValue::peak, 1);
+    EXPECT_EQ(passes, 2);
+}
+
+TEST(DataStreamTest, StaticAndNestedLoops) {
+    int passes = 0;
+    DataMap map;
+    map["rows"] = make_counted_stream(3, passes);
+    map["cols"] = make_data({"a", "b"});
+
+    const auto compiled = templet::make_compiled(
+                "{% for rows as row %}-{% endfor %}|{% for rows as row %}{% for cols as col %}{$ row }{$ col }{% endfor %}{% endfor %}");
+    EXPECT_EQ(compiled->render(map), "---|0a0b1a1b2a2b");
+    EXPECT_EQ(passes, 2);
+}
+
+TEST(DataStreamTest, CantBeIndexed) {
+    int passes = 0;
+    DataMap map;
+    map["rows"] = make_counted_stream(3, passes);
+
+    EXPECT_EQ(templet::make_compiled("{$ rows[0] }{% if rows[0] %}!{% endif %}")->render(map), "");
+    ASSERT_THROW(templet::make_compiled("{$ rows }")->render(map), templet::exception::InvalidTagError);
+    EXPECT_EQ(passes, 0);
+}
+
 //
 // Test the parser
 //
@@ -216,6 +2153,31 @@ TEST_F(TempletParserTest, UnsetVariables) {
     ASSERT_EQ(tpl.parse(map), "hello,  ");
 }
 
+TEST_F(TempletParserTest, UnsetVariablesStrict) {
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+    tpl.setOptions(options);
+
+    tpl.setTemplate("hello, {$first_name}");
+    ASSERT_THROW(tpl.parse(map), templet::exception::MissingTagError);
+
+    map["first_name"] = make_data("john");
+    EXPECT_EQ(tpl.parse(map), "hello, john");
+
+    // If blocks test whether a name is set and never throw
+    tpl.setTemplate("hello{% if last_name %}, {$last_name}{% endif %}");
+    EXPECT_EQ(tpl.parse(map), "hello");
+}
+
+TEST(FreeParseFunctionTest, UnsetVariablesStrict) {
+    templet::DataMap map;
+    templet::RenderOptions options;
+    options.strictMissingTags = true;
+
+    std::ostringstream os;
+    ASSERT_THROW(templet::parse("hello {$name}", map, os, options), templet::exception::MissingTagError);
+}
+
 TEST_F(TempletParserTest, SetVariables) {
     tpl.setTemplate("hello, {$first_name} {$last_name}");
     map["first_name"] = make_data("john");
@@ -235,6 +2197,52 @@ TEST_F(TempletParserTest, ParseWithDifferentValues) {
     EXPECT_EQ(tpl.parse(map), "hello, jane roe");
 }
 
+TEST_F(TempletParserTest, CompiledTreeIsReused) {
+    tpl.setTemplate("hello, {$first_name}");
+    EXPECT_FALSE(tpl.isCompiled());
+
+    map["first_name"] = make_data("john");
+    EXPECT_EQ(tpl.parse(map), "hello, john");
+    EXPECT_TRUE(tpl.isCompiled());
+    EXPECT_FALSE(tpl.reusedCompiled());
+
+    map["first_name"] = make_data("jane");
+    EXPECT_EQ(tpl.parse(map), "hello, jane");
+    EXPECT_TRUE(tpl.reusedCompiled());
+
+    tpl.setTemplate("bye, {$first_name}");
+    EXPECT_FALSE(tpl.isCompiled());
+    EXPECT_EQ(tpl.parse(map), "bye, jane");
+    EXPECT_FALSE(tpl.reusedCompiled());
+}
+
+TEST_F(TempletParserTest, CompileBeforeParse) {
+    tpl.setTemplate("hello, {$first_name}");
+    ASSERT_NO_THROW(tpl.compile());
+    EXPECT_TRUE(tpl.isCompiled());
+
+    map["first_name"] = make_data("john");
+    EXPECT_EQ(tpl.parse(map), "hello, john");
+    EXPECT_TRUE(tpl.reusedCompiled());
+
+    tpl.setTemplate("{$foo&bar}");
+    ASSERT_THROW(tpl.compile(), templet::exception::InvalidTagError);
+    EXPECT_FALSE(tpl.isCompiled());
+}
+
+TEST_F(TempletParserTest, CopiedTempletSharesCompiledTree) {
+    tpl.setTemplate("hello, {$first_name}");
+    tpl.compile();
+
+    templet::Templet copy;
+    copy = tpl;
+    EXPECT_TRUE(copy.isCompiled());
+
+    map["first_name"] = make_data("john");
+    EXPECT_EQ(copy.parse(map), "hello, john");
+    EXPECT_TRUE(copy.reusedCompiled());
+}
+
 TEST_F(TempletParserTest, InvalidValueTagName) {
     tpl.setTemplate("{$foo&bar}");
     ASSERT_THROW(tpl.parse(map), templet::exception::InvalidTagError);
@@ -292,6 +2300,18 @@ TEST_F(TempletParserTest, ParseValidFile) {
     EXPECT_EQ(tpl.parse(map), "Hello, john doe");
 }
 
+TEST_F(TempletParserTest, ParseValidMappedFile) {
+    ASSERT_NO_THROW(tpl.setTemplateFromFile<templet::helpers::MappedFileReader>("example.tpl"));
+    map["first_name"] = make_data("john");
+    map["last_name"] = make_data("doe");
+    EXPECT_EQ(tpl.parse(map), "Hello, john doe");
+
+    const auto& source = tpl.compiled()->source();
+    EXPECT_NE(dynamic_cast<const templet::MappedSource*>(source.get()), nullptr);
+
+    ASSERT_ANY_THROW(tpl.setTemplateFromFile<templet::helpers::MappedFileReader>("badfile.tpl"));
+}
+
 TEST_F(TempletParserTest, UnsetIfBlock) {
     tpl.setTemplate("This is {% if is_not_test %}not {% endif %}a test");
     EXPECT_EQ(tpl.parse(map), "This is a test");
@@ -640,6 +2660,52 @@ TEST_F(TempletParserTest, DotNotationValueArrayListWithoutName) {
     ASSERT_THROW(tpl.parse(map), templet::exception::InvalidTagError);
 }
 
+TEST_F(TempletParserTest, InvalidTagPathInUnreachedBlock) {
+    // Syntax errors are reported when the template is compiled,
+    // even if the tag is never evaluated
+    tpl.setTemplate("{% if debug %}{$ config.[1] }{% endif %}");
+    ASSERT_THROW(tpl.compile(), templet::exception::InvalidTagError);
+
+    tpl.setTemplate("{% if debug %}{$ items[x] }{% endif %}");
+    ASSERT_THROW(tpl.compile(), templet::exception::InvalidTagError);
+}
+
+TEST(TagPathTest, CompiledSteps) {
+    using templet::nodes::PathStep;
+
+    const templet::nodes::TagPath path("config.servers[1][-1].name");
+    const auto& steps = path.steps();
+
+    EXPECT_EQ(path.str(), "config.servers[1][-1].name");
+    ASSERT_EQ(steps.size(), 5);
+    EXPECT_EQ(steps[0].kind, PathStep::Kind::Key);
+    EXPECT_EQ(steps[0].key, "config");
+    EXPECT_EQ(steps[1].key, "servers");
+    EXPECT_EQ(steps[2].kind, PathStep::Kind::Index);
+    EXPECT_EQ(steps[2].index, 1);
+    EXPECT_EQ(steps[3].kind, PathStep::Kind::Index);
+    EXPECT_EQ(steps[4].key, "name");
+}
+
+TEST(TagPathTest, Resolve) {
+    DataMap server;
+    server["name"] = make_data("localhost");
+
+    DataVector servers;
+    servers.push_back(make_data(std::move(server)));
+
+    DataMap map;
+    map["servers"] = make_data(std::move(servers));
+
+    const auto* found = templet::nodes::TagPath("servers[0].name").resolve(map);
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(found->getValue(), "localhost");
+
+    EXPECT_EQ(templet::nodes::TagPath("servers[1].name").resolve(map), nullptr);
+    EXPECT_EQ(templet::nodes::TagPath("servers[0].ip").resolve(map), nullptr);
+    ASSERT_THROW(templet::nodes::TagPath("servers.name").resolve(map), templet::exception::InvalidTagError);
+}
+
 TEST_F(TempletParserTest, DotNotationValueArrayMap) {
     DataMap data;
     data["ips"] = make_data({"192.168.101.1", "192.168.101.2", "192.168.101.3"});
@@ -819,6 +2885,47 @@ TEST_F(TempletParserTest, ForLoopInnerForLoop) {
     EXPECT_EQ(tpl.parse(map), "Users: John,Jane,Mark,Mary,");
 }
 
+TEST_F(TempletParserTest, ForLoopInnerLoopSeesOuterNames) {
+    DataVector groups;
+    groups.push_back(make_data({"John", "Jane"}));
+    groups.push_back(make_data({"Mark"}));
+
+    map["groups"] = make_data(std::move(groups));
+    map["sep"] = make_data(";");
+
+    tpl.setTemplate("{% for groups as group %}{% for group as user %}{$ user }{$ sep }{% endfor %}|{% endfor %}");
+    EXPECT_EQ(tpl.parse(map), "John;Jane;|Mark;|");
+}
+
+TEST_F(TempletParserTest, ForLoopInnerAliasCollidesWithOuterAlias) {
+    DataVector users;
+    users.push_back(make_data({"John", "Jane"}));
+
+    map["users"] = make_data(std::move(users));
+
+    tpl.setTemplate("{% for users as user %}{% for user as user %}{$ user }{% endfor %}{% endfor %}");
+    ASSERT_THROW(tpl.parse(map), templet::exception::InvalidTagError);
+}
+
+TEST(ScopeTest, ChildScopeShadowsParent) {
+    DataMap map;
+    map["name"] = make_data("root");
+    map["other"] = make_data("other");
+
+    const templet::Scope root(map);
+    const std::string alias = "name";
+    templet::Scope child(root, alias);
+    const auto value = make_data("child");
+    child.bind(value.get());
+
+    EXPECT_EQ(root.find("name")->getValue(), "root");
+    EXPECT_EQ(child.find("name")->getValue(), "child");
+    EXPECT_EQ(child.find("other")->getValue(), "other");
+    EXPECT_EQ(child.find("missing"), nullptr);
+    EXPECT_TRUE(child.contains("other"));
+    EXPECT_FALSE(child.contains("missing"));
+}
+
 TEST_F(TempletParserTest, ForLoopMap) {
     DataMap server1;
     server1["name"] = make_data("stream-server");
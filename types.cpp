@@ -25,24 +25,145 @@ THE SOFTWARE.
 */
 
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include "types.hpp"
 
 using namespace templet;
 using namespace templet::types;
 
+namespace {
+
+/**
+ * @brief Spread sequential symbols over the table
+ * @param symbol Symbol to hash
+ * @return Hash of the symbol
+ */
+std::size_t hash_symbol(Symbol symbol) {
+    const std::uint32_t hash = symbol * 2654435769u;
+    return hash ^ (hash >> 16);
+}
+
+} // unnamed namespace
+
+FlatDataMap::FlatDataMap(const DataMap& values) {
+    // Keep the load factor at or below one half
+    std::size_t capacity = 8;
+    while(capacity < values.size() * 2) {
+        capacity *= 2;
+    }
+    _slots.resize(capacity);
+    for(const auto& value : values) {
+        insert(value.first, value.second);
+    }
+}
+
+std::size_t FlatDataMap::indexOf(Symbol symbol) const {
+    const auto mask = _slots.size() - 1;
+    auto index = hash_symbol(symbol) & mask;
+    while(_slots[index].symbol != invalidSymbol && _slots[index].symbol != symbol) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void FlatDataMap::rehash(std::size_t capacity) {
+    std::vector<Slot> slots(capacity);
+    slots.swap(_slots);
+    for(auto& slot : slots) {
+        if(slot.symbol != invalidSymbol) {
+            auto& target = _slots[indexOf(slot.symbol)];
+            target.symbol = slot.symbol;
+            target.value = std::move(slot.value);
+        }
+    }
+}
+
+void FlatDataMap::insert(const std::string& key, DataPtr value) {
+    if((_size + 1) * 2 > _slots.size()) {
+        rehash(_slots.empty() ? 8 : _slots.size() * 2);
+    }
+
+    const auto symbol = intern(key);
+    auto& slot = _slots[indexOf(symbol)];
+    if(slot.symbol == invalidSymbol) {
+        slot.symbol = symbol;
+        ++_size;
+    }
+    slot.value = std::move(value);
+}
+
+const Data* FlatDataMap::find(Symbol symbol) const {
+    if(_size == 0 || symbol == invalidSymbol) {
+        return nullptr;
+    }
+    const auto& slot = _slots[indexOf(symbol)];
+    return (slot.symbol == symbol) ? slot.value.get() : nullptr;
+}
+
+const Data* FlatDataMap::find(const std::string& key) const {
+    if(_size == 0) {
+        return nullptr;
+    }
+    return find(find_symbol(key));
+}
+
+bool FlatDataMap::empty() const {
+    return _size == 0;
+}
+
+std::size_t FlatDataMap::size() const {
+    return _size;
+}
+
+DataMap FlatDataMap::toMap() const {
+    DataMap map;
+    for(const auto& slot : _slots) {
+        if(slot.symbol != invalidSymbol) {
+            map.emplace(symbol_name(slot.symbol), slot.value);
+        }
+    }
+    return map;
+}
+
 std::string Data::getValue() const {
     throw std::runtime_error("Data item is not of type value");
 }
 
+const std::string& Data::getValueRef() const {
+    thread_local std::string value;
+    value = getValue();
+    return value;
+}
+
+const char* Data::text(char* /*buffer*/, std::size_t& size) const {
+    const auto& value = getValueRef();
+    size = value.size();
+    return value.data();
+}
+
 const DataVector& Data::getList() const {
     throw std::runtime_error("Data item is not of type list");
 }
 
+std::size_t Data::listSize() const {
+    return getList().size();
+}
+
+const Data* Data::listItem(std::size_t index) const {
+    return getList()[index].get();
+}
+
 const DataMap& Data::getMap() const {
     throw std::runtime_error("Data item is not of type map");
 }
 
+const Data* Data::find(const std::string& name, Symbol /*symbol*/) const {
+    const auto& map = getMap();
+    const auto it = map.find(name);
+    return (it != map.end()) ? it->second.get() : nullptr;
+}
+
 DataValue::DataValue(std::string value)
     : _value(std::move(value)) {
 
@@ -56,10 +177,194 @@ std::string DataValue::getValue() const {
     return _value;
 }
 
+const std::string& DataValue::getValueRef() const {
+    return _value;
+}
+
 DataType DataValue::type() const {
     return DataType::String;
 }
 
+namespace {
+
+/**
+ * @brief Format an integer in decimal at the end of a buffer
+ * @param value Magnitude of the integer
+ * @param negative Prefix a minus sign
+ * @param end One past the last character of the buffer
+ * @return First character
+ */
+char* format_integer(std::uint64_t value, bool negative, char* end) {
+    auto pos = end;
+    do {
+        *--pos = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    if(negative) {
+        *--pos = '-';
+    }
+    return pos;
+}
+
+} // unnamed namespace
+
+DataScalar::DataScalar(const std::string& value) {
+    assign(value.data(), value.size());
+}
+
+DataScalar::DataScalar(std::int64_t value)
+    : _signed(value), _kind(Kind::Signed), _size(0) {
+
+}
+
+DataScalar::DataScalar(std::uint64_t value)
+    : _unsigned(value), _kind(Kind::Unsigned), _size(0) {
+
+}
+
+DataScalar::DataScalar(const DataScalar& other) {
+    copy(other);
+}
+
+DataScalar::DataScalar(DataScalar&& other) noexcept {
+    take(other);
+}
+
+DataScalar& DataScalar::operator=(const DataScalar& other) {
+    if(this != &other) {
+        release();
+        copy(other);
+    }
+    return *this;
+}
+
+DataScalar& DataScalar::operator=(DataScalar&& other) noexcept {
+    if(this != &other) {
+        release();
+        take(other);
+    }
+    return *this;
+}
+
+DataScalar::~DataScalar() {
+    release();
+}
+
+void DataScalar::assign(const char* data, std::size_t size) {
+    if(size <= inlineSize) {
+        std::memcpy(_chars, data, size);
+        _kind = Kind::Inline;
+        _size = static_cast<unsigned char>(size);
+        return;
+    }
+
+    _heap.data = new char[size];
+    std::memcpy(_heap.data, data, size);
+    _heap.size = size;
+    _kind = Kind::Heap;
+    _size = 0;
+}
+
+void DataScalar::copy(const DataScalar& other) {
+    if(other._kind == Kind::Heap) {
+        assign(other._heap.data, other._heap.size);
+        return;
+    }
+    // Integers fit in the inline characters
+    std::memcpy(_chars, other._chars, inlineSize);
+    _kind = other._kind;
+    _size = other._size;
+}
+
+void DataScalar::take(DataScalar& other) {
+    if(other._kind == Kind::Heap) {
+        // The heap text now belongs to this value
+        _heap = other._heap;
+        _kind = Kind::Heap;
+        _size = 0;
+        other._kind = Kind::Inline;
+        other._size = 0;
+        return;
+    }
+    copy(other);
+}
+
+void DataScalar::release() {
+    if(_kind == Kind::Heap) {
+        delete[] _heap.data;
+        _kind = Kind::Inline;
+        _size = 0;
+    }
+}
+
+bool DataScalar::empty() const {
+    return (_kind == Kind::Inline && _size == 0) || (_kind == Kind::Heap && _heap.size == 0);
+}
+
+std::string DataScalar::getValue() const {
+    char buffer[textBufferSize];
+    std::size_t size = 0;
+    const auto data = text(buffer, size);
+    return std::string(data, size);
+}
+
+const char* DataScalar::text(char* buffer, std::size_t& size) const {
+    const char* first = nullptr;
+    switch(_kind) {
+    case Kind::Inline:
+        size = _size;
+        return _chars;
+    case Kind::Heap:
+        size = _heap.size;
+        return _heap.data;
+    case Kind::Signed:
+        // Negate as unsigned so the smallest value doesn't overflow
+        first = format_integer(_signed < 0 ? 0 - static_cast<std::uint64_t>(_signed) : static_cast<std::uint64_t>(_signed),
+                               _signed < 0, buffer + textBufferSize);
+        break;
+    case Kind::Unsigned:
+        first = format_integer(_unsigned, false, buffer + textBufferSize);
+        break;
+    }
+    size = static_cast<std::size_t>(buffer + textBufferSize - first);
+    return first;
+}
+
+DataType DataScalar::type() const {
+    return DataType::String;
+}
+
+DataScalarList::DataScalarList(std::vector<DataScalar> items)
+    : _items(std::move(items)) {
+
+}
+
+bool DataScalarList::empty() const {
+    return _items.empty();
+}
+
+const DataVector& DataScalarList::getList() const {
+    std::call_once(_listBuilt, [this]() {
+        _list.reserve(_items.size());
+        for(const auto& item : _items) {
+            _list.push_back(std::make_shared<DataScalar>(item));
+        }
+    });
+    return _list;
+}
+
+std::size_t DataScalarList::listSize() const {
+    return _items.size();
+}
+
+const Data* DataScalarList::listItem(std::size_t index) const {
+    return &_items[index];
+}
+
+DataType DataScalarList::type() const {
+    return DataType::List;
+}
+
 DataList::DataList(DataVector data)
     : _data(std::move(data)) {
 
@@ -85,18 +390,119 @@ DataType DataList::type() const {
 }
 
 
+DataGenerator Data::stream() const {
+    throw std::runtime_error("Data item is not of type stream");
+}
+
+DataStream::DataStream(Factory factory)
+    : _factory(std::move(factory)) {
+
+}
+
+bool DataStream::empty() const {
+    return false;
+}
+
+DataGenerator DataStream::stream() const {
+    return _factory();
+}
+
+DataType DataStream::type() const {
+    return DataType::Stream;
+}
+
 DataMapper::DataMapper(DataMap data) : _data(std::move(data)) {
 
 }
 
+DataMapper::DataMapper(FlatDataMap data) : _data(), _flat(std::move(data)), _isFlat(true) {
+
+}
+
 bool DataMapper::empty() const {
-    return _data.empty();
+    return _isFlat ? _flat.empty() : _data.empty();
 }
 
 const DataMap& DataMapper::getMap() const {
+    if(_isFlat) {
+        std::call_once(_mapBuilt, [this]() { _data = _flat.toMap(); });
+    }
     return _data;
 }
 
+const Data* DataMapper::find(const std::string& name, Symbol symbol) const {
+    if(_isFlat) {
+        return (symbol != invalidSymbol) ? _flat.find(symbol) : _flat.find(name);
+    }
+    const auto it = _data.find(name);
+    return (it != _data.end()) ? it->second.get() : nullptr;
+}
+
 DataType DataMapper::type() const {
     return DataType::Mapper;
 }
+
+LazyData::LazyData(DataType type, Provider provider)
+    : _type(type), _provider(std::move(provider)) {
+
+}
+
+const Data& LazyData::get() const {
+    std::call_once(_once, [this]() {
+        auto value = _provider();
+        if(!value || value->type() != _type) {
+            throw std::runtime_error("Lazy data provider returned a value of the wrong type");
+        }
+        _value = std::move(value);
+        _evaluated = true;
+    });
+    return *_value;
+}
+
+bool LazyData::empty() const {
+    return get().empty();
+}
+
+std::string LazyData::getValue() const {
+    return get().getValue();
+}
+
+const std::string& LazyData::getValueRef() const {
+    return get().getValueRef();
+}
+
+const char* LazyData::text(char* buffer, std::size_t& size) const {
+    return get().text(buffer, size);
+}
+
+const DataVector& LazyData::getList() const {
+    return get().getList();
+}
+
+std::size_t LazyData::listSize() const {
+    return get().listSize();
+}
+
+const Data* LazyData::listItem(std::size_t index) const {
+    return get().listItem(index);
+}
+
+const DataMap& LazyData::getMap() const {
+    return get().getMap();
+}
+
+const Data* LazyData::find(const std::string& name, Symbol symbol) const {
+    return get().find(name, symbol);
+}
+
+DataGenerator LazyData::stream() const {
+    return get().stream();
+}
+
+DataType LazyData::type() const {
+    return _type;
+}
+
+bool LazyData::evaluated() const {
+    return _evaluated;
+}
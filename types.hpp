@@ -27,12 +27,18 @@ THE SOFTWARE.
 #ifndef TYPES_HPP
 #define TYPES_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <type_traits>
 #include <vector>
+#include "symbols.hpp"
 
 // TODO: Add conversion operators to data classes
 
@@ -44,13 +50,95 @@ using DataPtr = std::shared_ptr<Data>;
 using DataVector = std::vector<DataPtr>;
 using DataMap = std::map<std::string, DataPtr>;
 
+/**
+ * @brief Returns the next item of a streamed list, or nullptr at the end
+ */
+using DataGenerator = std::function<DataPtr()>;
+
+/**
+ * @brief The FlatDataMap class is a hash map of values keyed by symbols
+ *
+ * Meant for values that are built once and read many times. Keys are
+ * interned and the values are kept in one open addressing table, so a
+ * lookup with a symbol is a single probe in most cases.
+ */
+class FlatDataMap {
+private:
+    struct Slot {
+        Symbol symbol {invalidSymbol};
+        DataPtr value;
+    };
+
+    std::vector<Slot> _slots;
+    std::size_t _size {0};
+
+    std::size_t indexOf(Symbol symbol) const;
+    void rehash(std::size_t capacity);
+
+public:
+    FlatDataMap() = default;
+
+    /**
+     * @brief Construct a flat map with the values of a map
+     * @param values Map of values
+     */
+    explicit FlatDataMap(const DataMap& values);
+
+    /**
+     * @brief Insert a value, replacing any value with the same key
+     * @param key Key of the value
+     * @param value Value to insert
+     */
+    void insert(const std::string& key, DataPtr value);
+
+    /**
+     * @brief Find a value by symbol
+     * @param symbol Interned key
+     * @return Pointer to the value or nullptr if not found
+     */
+    const Data* find(Symbol symbol) const;
+
+    /**
+     * @brief Find a value by key
+     * @param key Key of the value
+     * @return Pointer to the value or nullptr if not found
+     */
+    const Data* find(const std::string& key) const;
+
+    /**
+     * @brief Check if the map has no values
+     * @return True if empty, otherwise false
+     */
+    bool empty() const;
+
+    /**
+     * @brief Get the number of values
+     * @return Number of values
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Copy the values into a map
+     * @return Map of values
+     */
+    DataMap toMap() const;
+};
+
+/**
+ * @brief Size of the buffer Data::text() may format a value into
+ *
+ * Fits any 64-bit integer in decimal with its sign
+ */
+constexpr std::size_t textBufferSize = 24;
+
 /**
  * @brief Represents the type of a data object
  */
 enum class DataType {
     String,
     List,
-    Mapper
+    Mapper,
+    Stream  ///< A list that can only be iterated
 };
 
 /**
@@ -72,6 +160,32 @@ public:
      */
     virtual std::string getValue() const;
 
+    /**
+     * @brief Get string value from object without copying it
+     *
+     * The default implementation calls getValue() and keeps the result in
+     * a per-thread buffer, the reference is valid until the next call.
+     * Derived classes that store a string should return a reference to it.
+     *
+     * @exception std::runtime_error if the derived class doesn't support this type
+     * @return Value as a string reference
+     */
+    virtual const std::string& getValueRef() const;
+
+    /**
+     * @brief Get string value from object as characters
+     *
+     * Used to write values to the output. Values that aren't stored as
+     * text, e.g. integers, are formatted into the buffer. The default
+     * implementation returns the characters of getValueRef().
+     *
+     * @param buffer At least textBufferSize characters to format into
+     * @param size Set to the number of characters
+     * @exception std::runtime_error if the derived class doesn't support this type
+     * @return First character, valid until the buffer or the object changes
+     */
+    virtual const char* text(char* buffer, std::size_t& size) const;
+
     /**
      * @brief Get list of values from object
      * @exception std::runtime_error if the derived class doesn't support this type
@@ -79,6 +193,27 @@ public:
      */
     virtual const DataVector& getList() const;
 
+    /**
+     * @brief Get the number of values in a list
+     *
+     * The default implementation returns the size of getList()
+     *
+     * @exception std::runtime_error if the derived class doesn't support this type
+     * @return Number of values
+     */
+    virtual std::size_t listSize() const;
+
+    /**
+     * @brief Get a value from a list without going through getList()
+     *
+     * The default implementation indexes getList()
+     *
+     * @param index Index of the value, less than listSize()
+     * @exception std::runtime_error if the derived class doesn't support this type
+     * @return Pointer to the value
+     */
+    virtual const Data* listItem(std::size_t index) const;
+
     /**
      * @brief Get map values from object
      * @exception std::runtime_error if the derived class doesn't support this type
@@ -86,6 +221,25 @@ public:
      */
     virtual const DataMap& getMap() const;
 
+    /**
+     * @brief Find a value in map values by key
+     *
+     * The default implementation looks the name up in getMap()
+     *
+     * @param name Key of the value
+     * @param symbol Interned key, or invalidSymbol if not known
+     * @exception std::runtime_error if the derived class doesn't support this type
+     * @return Pointer to the value or nullptr if not found
+     */
+    virtual const Data* find(const std::string& name, Symbol symbol) const;
+
+    /**
+     * @brief Start iterating a streamed list
+     * @exception std::runtime_error if the derived class doesn't support this type
+     * @return Generator of the items
+     */
+    virtual DataGenerator stream() const;
+
     /**
      * @brief Get the type of the data object
      * @return type as DataType
@@ -108,6 +262,109 @@ public:
     DataValue(std::string value);
     bool empty() const override;
     std::string getValue() const override;
+    const std::string& getValueRef() const override;
+    DataType type() const override;
+};
+
+/**
+ * @brief The DataScalar class holds a short string or an integer inline
+ *
+ * Strings of up to inlineSize characters are stored in the object, longer
+ * ones in one heap block. Integers are kept as numbers and only formatted
+ * when written to the output. A scalar is 32 bytes on 64-bit platforms,
+ * so lists of scalars can be stored contiguously, see
+ * \link DataScalarList \endlink.
+ *
+ * getValueRef() formats the value into a per-thread buffer, see
+ * Data::getValueRef()
+ */
+class DataScalar final : public Data {
+public:
+    static constexpr std::size_t inlineSize = 14;
+    static_assert(inlineSize >= sizeof(std::uint64_t), "Integers are copied as inline characters");
+
+private:
+    enum class Kind : unsigned char {
+        Inline,
+        Heap,
+        Signed,
+        Unsigned
+    };
+
+    struct HeapText {
+        char* data;
+        std::size_t size;
+    };
+
+    union {
+        char _chars[inlineSize];
+        HeapText _heap;
+        std::int64_t _signed;
+        std::uint64_t _unsigned;
+    };
+    Kind _kind;
+    unsigned char _size;
+
+    void assign(const char* data, std::size_t size);
+    void copy(const DataScalar& other);
+    void take(DataScalar& other);
+    void release();
+
+public:
+    /**
+     * @brief Construct a DataScalar with a string
+     * @param value String value
+     */
+    explicit DataScalar(const std::string& value);
+
+    /**
+     * @brief Construct a DataScalar with a signed integer
+     * @param value Integer value
+     */
+    explicit DataScalar(std::int64_t value);
+
+    /**
+     * @brief Construct a DataScalar with an unsigned integer
+     * @param value Integer value
+     */
+    explicit DataScalar(std::uint64_t value);
+
+    DataScalar(const DataScalar& other);
+    DataScalar(DataScalar&& other) noexcept;
+    DataScalar& operator=(const DataScalar& other);
+    DataScalar& operator=(DataScalar&& other) noexcept;
+    ~DataScalar();
+
+    bool empty() const override;
+    std::string getValue() const override;
+    const char* text(char* buffer, std::size_t& size) const override;
+    DataType type() const override;
+};
+
+/**
+ * @brief The DataScalarList class stores a list of scalars contiguously
+ *
+ * One allocation holds every value, loops and indexes read the values
+ * with listItem(). getList() copies the values into shared values the
+ * first time it's called, so items taken from it outlive the list.
+ */
+class DataScalarList : public Data {
+private:
+    std::vector<DataScalar> _items;
+    mutable DataVector _list;
+    mutable std::once_flag _listBuilt;
+
+public:
+    /**
+     * @brief Construct a DataScalarList with a vector of values
+     * @param items Vector of values
+     */
+    DataScalarList(std::vector<DataScalar> items);
+
+    bool empty() const override;
+    const DataVector& getList() const override;
+    std::size_t listSize() const override;
+    const Data* listItem(std::size_t index) const override;
     DataType type() const override;
 };
 
@@ -138,10 +395,16 @@ public:
 
 /**
  * @brief The DataMapper class wraps a map
+ *
+ * The map is either a DataMap or a FlatDataMap. A DataMapper made from
+ * a FlatDataMap only builds a DataMap if getMap() is called.
  */
 class DataMapper : public Data {
 private:
-    DataMap _data;
+    mutable DataMap _data;
+    FlatDataMap _flat;
+    bool _isFlat {false};
+    mutable std::once_flag _mapBuilt;
 
 public:
     /**
@@ -150,28 +413,167 @@ public:
      */
     DataMapper(DataMap data);
 
+    /**
+     * @brief Construct a DataMapper with a flat map
+     * @param data Flat map
+     */
+    DataMapper(FlatDataMap data);
+
     // TODO: Add initializer list constructor
 
     bool empty() const override;
     const DataMap& getMap() const override;
+    const Data* find(const std::string& name, Symbol symbol) const override;
     DataType type() const override;
 };
 
+/**
+ * @brief The DataStream class wraps a list that is generated item by item
+ *
+ * For loops pull one item at a time and release it before pulling the
+ * next, so a large list never has to be held in memory. The factory is
+ * called once per loop over the list. Streamed lists can't be indexed.
+ */
+class DataStream : public Data {
+public:
+    using Factory = std::function<DataGenerator()>;
+
+private:
+    Factory _factory;
+
+public:
+    /**
+     * @brief Construct a DataStream with a generator factory
+     * @param factory Callback that starts a new pass over the items
+     */
+    DataStream(Factory factory);
+
+    /**
+     * @brief A stream is always considered set, its items are not counted
+     * @return False
+     */
+    bool empty() const override;
+    DataGenerator stream() const override;
+    DataType type() const override;
+};
+
+/**
+ * @brief The LazyData class wraps a value that is computed on demand
+ *
+ * The type is declared up front, so tags that only check whether the
+ * value is set, e.g. if blocks, never call the provider. The provider
+ * is called at most once, the first time the value is read, and its
+ * result is kept for the lifetime of the object.
+ *
+ * Thread safe, concurrent readers wait for the first call to finish.
+ */
+class LazyData : public Data {
+public:
+    using Provider = std::function<DataPtr()>;
+
+private:
+    DataType _type;
+    Provider _provider;
+    mutable DataPtr _value;
+    mutable std::once_flag _once;
+    mutable std::atomic<bool> _evaluated {false};
+
+    /**
+     * @brief Get the computed value, calling the provider if needed
+     * @exception std::runtime_error if the provider returns null or a value of the wrong type
+     * @return Computed value
+     */
+    const Data& get() const;
+
+public:
+    /**
+     * @brief Construct a LazyData with a provider
+     * @param type Type of the value returned by the provider
+     * @param provider Callback that computes the value
+     */
+    LazyData(DataType type, Provider provider);
+
+    bool empty() const override;
+    std::string getValue() const override;
+    const std::string& getValueRef() const override;
+    const char* text(char* buffer, std::size_t& size) const override;
+    const DataVector& getList() const override;
+    std::size_t listSize() const override;
+    const Data* listItem(std::size_t index) const override;
+    const DataMap& getMap() const override;
+    const Data* find(const std::string& name, Symbol symbol) const override;
+    DataGenerator stream() const override;
+    DataType type() const override;
+
+    /**
+     * @brief Check if the provider has been called
+     * @return True if the value has been computed, otherwise false
+     */
+    bool evaluated() const;
+};
+
 } // namespace types
 
 // Expose user data types in general templet namespace
 using types::DataMap;
 using types::DataPtr;
+using types::FlatDataMap;
 using types::DataVector;
 
+namespace helpers {
+
+/**
+ * @brief Store an integral value in a scalar without formatting it
+ * @param value Value to store
+ * @return Scalar
+ */
+template <typename T>
+static inline types::DataScalar make_scalar(T value, std::true_type /*isSigned*/) {
+    return types::DataScalar(static_cast<std::int64_t>(value));
+}
+
+/**
+ * @brief \sa make_scalar
+ */
+template <typename T>
+static inline types::DataScalar make_scalar(T value, std::false_type /*isSigned*/) {
+    return types::DataScalar(static_cast<std::uint64_t>(value));
+}
+
+} // namespace helpers
+
 /**
  * @brief Wrap an integral type in a DataPtr
+ *
+ * The value is formatted like std::to_string when it's written.
+ * getValueRef() returns a per-thread buffer, see
+ * \link types::DataScalar \endlink
+ *
  * @param value Value to wrap
  * @return Value wrapped in DataPtr
  */
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
 static inline types::DataPtr make_data(T value) {
-    return std::make_shared<types::DataValue>(std::to_string(value));
+    return std::make_shared<types::DataScalar>(helpers::make_scalar(value, std::is_signed<T>()));
+}
+
+/**
+ * @brief Wrap a vector of integral values in a DataPtr
+ *
+ * The values are stored contiguously, see \link types::DataScalarList \endlink.
+ * Like make_data(T), getValueRef() of the items returns a per-thread buffer
+ *
+ * @param value Vector of values to wrap
+ * @return Value wrapped in DataPtr
+ */
+template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+static inline types::DataPtr make_data(const std::vector<T>& value) {
+    std::vector<types::DataScalar> items;
+    items.reserve(value.size());
+    for(const T v : value) {
+        items.push_back(helpers::make_scalar(v, std::is_signed<T>()));
+    }
+    return std::make_shared<types::DataScalarList>(std::move(items));
 }
 
 /**
@@ -223,6 +625,34 @@ static inline types::DataPtr make_data(types::DataMap value) {
     return std::make_shared<types::DataMapper>(std::move(value));
 }
 
+/**
+ * @brief Wrap a FlatDataMap in a DataPtr
+ * @param value FlatDataMap to wrap
+ * @return Value wrapped in DataPtr
+ */
+static inline types::DataPtr make_data(types::FlatDataMap value) {
+    return std::make_shared<types::DataMapper>(std::move(value));
+}
+
+/**
+ * @brief Wrap a generator factory in a DataPtr
+ * @param factory Callback that starts a new pass over the items
+ * @return Value wrapped in DataPtr
+ */
+static inline types::DataPtr make_data_stream(types::DataStream::Factory factory) {
+    return std::make_shared<types::DataStream>(std::move(factory));
+}
+
+/**
+ * @brief Wrap a callback in a DataPtr that computes the value on demand
+ * @param type Type of the value returned by the callback
+ * @param provider Callback that computes the value
+ * @return Value wrapped in DataPtr
+ */
+static inline types::DataPtr make_lazy_data(types::DataType type, types::LazyData::Provider provider) {
+    return std::make_shared<types::LazyData>(type, std::move(provider));
+}
+
 } // namespace templet
 
 #endif // TYPES_HPP